@@ -0,0 +1,126 @@
+#ifndef AVL_MAP_HEADER
+#define AVL_MAP_HEADER
+#include<utility>
+#include"AVLTree.hpp"
+#include"../Common/ValueStore.hpp"
+
+/*
+* Map on top of AVLTree. The nodes hold MapEntry (key + pointer) and the values live in a ValueStore,
+* so a search walks over keys only and touches the value once, when it is returned.
+* Value references stay valid until the key is erased.
+*/
+
+template<class K, class V>
+class AVLMap {
+private:
+	using Entry = MapEntry<K, V>;
+
+	ValueStore<V> values;
+	AVLTree<Entry> entries;
+
+	// Points the copied entries to copies of their values in this map's store.
+	void copyValues() {
+		for (Entry& entry : entries)
+			entry.value = values.emplace(*entry.value);
+	}
+
+public:
+	using ConstIterator = typename AVLTree<Entry>::ConstIterator;
+
+	AVLMap() = default;
+
+	AVLMap(const AVLMap& other) : entries(other.entries) {
+		copyValues();
+	}
+
+	AVLMap(AVLMap&&) noexcept = default;
+
+	AVLMap& operator=(const AVLMap& other) {
+		if (this != &other) {
+			AVLMap temp(other);
+			*this = std::move(temp);
+		}
+
+		return *this;
+	}
+
+	AVLMap& operator=(AVLMap&&) noexcept = default;
+
+	V* find(const K& key) {
+		const Entry* entry = entries.find(key);
+		return entry ? entry->value : nullptr;
+	}
+
+	const V* find(const K& key) const {
+		const Entry* entry = entries.find(key);
+		return entry ? entry->value : nullptr;
+	}
+
+	bool contains(const K& key) const {
+		return entries.find(key) != nullptr;
+	}
+
+	// Constructs the value from args only if key is not in the map. The flag tells if it was inserted.
+	template<class... Args>
+	std::pair<V&, bool> tryEmplace(const K& key, Args&&... args) {
+		if (const Entry* entry = entries.find(key))
+			return std::pair<V&, bool>(*entry->value, false);
+
+		V* value = values.emplace(std::forward<Args>(args)...);
+
+		// The slot is released if copying the key or allocating the node throws.
+		try {
+			entries.push(Entry(key, value));
+		}
+		catch (...) {
+			values.erase(value);
+			throw;
+		}
+
+		return std::pair<V&, bool>(*value, true);
+	}
+
+	template<class M>
+	V& insertOrAssign(const K& key, M&& value) {
+		std::pair<V&, bool> result = tryEmplace(key, std::forward<M>(value));
+
+		if (!result.second)
+			result.first = std::forward<M>(value);
+
+		return result.first;
+	}
+
+	bool erase(const K& key) {
+		const Entry* entry = entries.find(key);
+
+		if (!entry)
+			return false;
+
+		// The entry lives in the node that is about to be freed.
+		Entry toRemove = *entry;
+
+		entries.removeElement(toRemove);
+		values.erase(toRemove.value);
+
+		return true;
+	}
+
+	int size() const {
+		return entries.getNodesCount();
+	}
+
+	bool empty() const {
+		return entries.isEmpty();
+	}
+
+	// Iterates the entries in key order: entry.key and *entry.value.
+	ConstIterator begin() const {
+		return entries.begin();
+	}
+
+	ConstIterator end() const {
+		return entries.end();
+	}
+};
+
+#endif // !AVL_MAP_HEADER
@@ -5,10 +5,21 @@
 #include<fstream>
 #include<stack>
 #include<exception>
+#include<future>
+#include<thread>
+#include<stdexcept>
+#include<vector>
+#include"../Common/BatchSort.hpp"
+#include"../Common/BloomFilter.hpp"
+#include"../Common/FrozenSet.hpp"
+#include"../Common/NodeMemory.hpp"
+#include"../Common/OrderedSet.hpp"
+#include"../Common/ShapeReport.hpp"
+#include"BalancePolicy.hpp"
 
 // BF = height(right) - height(left) \in {-1, 0, 1}
 
-template<class T>
+template<class T, class Balance = AVLBalance>
 class AVLTree {
 private:
 	struct Node {
@@ -77,10 +88,29 @@ private:
 		}
 
 		Node(const T& data, Node* l = nullptr, Node* r = nullptr, int h = 1) : data(data), left(l), right(r), height(h) {}
+
+		// From NodeMemory, a huge-page range if one is installed.
+		static void* operator new(size_t bytes) { return NodeMemory::allocate(bytes); }
+
+		static void operator delete(void* block, size_t bytes) { NodeMemory::deallocate(block, bytes); }
 	};
 
 	Node* root;
-	int nodesCount;
+
+	// unknownCount after split until getNodesCount() recounts the tree.
+	mutable int nodesCount;
+
+	static const int unknownCount = -1;
+
+	// Optional, nullptr unless enableBloomFilter was called.
+	OptionalBloomFilter<T>* filter;
+	int filterRemovals;
+
+	void rebuildFilter();
+
+	void noteFilterRemovals(int removed);
+
+	void addToFilter(const Node* r);
 
 	int pushRec(const T& elem, Node*& r);
 
@@ -100,9 +130,59 @@ private:
 
 	int searchForLeftDisbalance(Node*& r);
 
+	// WAVLBalance counterparts of pushRec and removeRec, in rank differences (see BalancePolicy.hpp).
+	static int rankDifference(const Node* parent, const Node* child) {
+		return parent->height - Node::getHeight(child);
+	}
+
+	int rankPushRec(const T& elem, Node*& r);
+
+	int rankRemoveRec(Node*& r, const T& elem);
+
+	Node* rankRemoveMin(Node*& r);
+
+	// True if r was promoted, false if a rotation ended the rebalancing.
+	bool fixRankAfterInsert(Node*& r, bool leftGrew);
+
+	void fixRankAfterRemove(Node*& r);
+
 	void free();
 
 	void recFillFileStream(std::ofstream& outFile, const Node* r) const; 
+
+	// Join-based primitives. They take ownership of the given subtrees.
+	Node* join(Node* left, Node* middle, Node* right);
+
+	void joinRight(Node*& r, Node* middle, Node* right);
+
+	void joinLeft(Node*& r, Node* left, Node* middle);
+
+	Node* join2(Node* left, Node* right);
+
+	Node* splitRec(Node* r, const T& key, Node*& left, Node*& right);
+
+	Node* unionRec(Node* first, Node* second, int& matches, int forkDepth);
+
+	Node* intersectRec(Node* first, Node* second, int& matches, int forkDepth);
+
+	Node* differenceRec(Node* first, Node* second, int& matches, int forkDepth);
+
+	// Balanced tree of sorted[from, to).
+	static Node* buildBalanced(const std::vector<T>& sorted, size_t from, size_t to);
+
+	// unionWith with at most forkDepth levels of forks.
+	void unionWith(AVLTree&& other, int forkDepth);
+
+	// insertBatch after the sort, with at most forkDepth levels of forks in the union.
+	int insertSorted(const std::vector<T>& sorted, int forkDepth);
+
+	// Subtrees lower than this are never processed in parallel.
+	static const int parallelHeightCutoff = 14;
+
+	static int initialForkDepth();
+
+	template<class Left, class Right>
+	static void forkJoin(bool fork, Left&& left, Right&& right);
 public:
 	class NodeProxy {
 	private:
@@ -239,14 +319,14 @@ public:
 		}
 
 		bool operator!=(const ConstIterator& other) const {
-			return !(this->operator!=(other));
+			return !(this->operator==(other));
 		}
 
 		ConstIterator& operator++() {
 			if(emptyStack())
 				return *this;
 			
-			Node* current = currentNodes.top();
+			const Node* current = currentNodes.top();
 			currentNodes.pop();
 			init(current->right);
 
@@ -254,7 +334,7 @@ public:
 		}
 
 		ConstIterator operator++(int) {
-			Iterator temp = *this;
+			ConstIterator temp = *this;
 			++*this;
 			return temp;
 		}
@@ -269,9 +349,9 @@ public:
 		friend class AVLTree;
 	};
 
-	AVLTree() : root(nullptr), nodesCount(0) {}
+	AVLTree() : root(nullptr), nodesCount(0), filter(nullptr), filterRemovals(0) {}
 
-	AVLTree(const T& data) : root(new Node(data)), nodesCount(1) {}
+	AVLTree(const T& data) : root(new Node(data)), nodesCount(1), filter(nullptr), filterRemovals(0) {}
 
 	AVLTree(const AVLTree& other) {
 		copy(other);
@@ -285,6 +365,16 @@ public:
 
 	bool exists(const T& elem) const;
 
+	// The stored element equal to key, nullptr if there is none.
+	// key can be of any type that compares with T both ways, so a map can look up an entry by key alone.
+	template<class Key>
+	const T* find(const Key& key) const;
+
+	// Calls change on the stored element equal to key and returns true, false if there is none.
+	// change must leave the element comparing the same way, so the order is not broken.
+	template<class Key, class Change>
+	bool update(const Key& key, Change change);
+
 	int getNodesCount() const;
 
 	int removeElement(const T& elem);
@@ -316,23 +406,72 @@ public:
 
 	int push(const T& elem);
 
+	// With WAVLBalance this is the rank of the root + 1, an upper bound of the height.
 	int getHeight() const;
 
 	bool isEmpty() const;
 
 	void exportToTex(const char* filePath) const;
 
+	// Depth histogram, search path lengths and balance factors, in one O(n) pass without recursion.
+	TreeShape analyze() const;
+
+	// Attaches a Bloom filter sized for expectedElements keys (or the current count if larger)
+	// at the given false positive rate. exists consults it first, so most misses
+	// never walk the tree. Removals make it rebuild once they reach half of its capacity.
+	void enableBloomFilter(int expectedElements, double falsePositiveRate = 0.01);
+
+	void disableBloomFilter();
+
+	// Set operations built on split/join in O(m log(n/m + 1)) work.
+	// Large subtrees are processed in parallel.
+	// The rvalue overloads reuse the nodes of other instead of copying them.
+	void unionWith(const AVLTree& other);
+
+	void unionWith(AVLTree&& other);
+
+	void intersect(const AVLTree& other);
+
+	void intersect(AVLTree&& other);
+
+	void difference(const AVLTree& other);
+
+	void difference(AVLTree&& other);
+
+	// Moves the elements < key into first and the elements >= key into second in O(log n).
+	// This tree is left empty. The node counts of the parts are recounted lazily.
+	std::pair<AVLTree, AVLTree> split(const T& key);
+
+	// Every element of left must be smaller than every element of right.
+	// Throws std::invalid_argument otherwise. O(log n).
+	static AVLTree concat(AVLTree&& left, AVLTree&& right);
+
+	// Inserts the elements of batch (any range of T). The batch is sorted and deduplicated
+	// (in parallel when large), built into a balanced tree in O(m) and united with this one,
+	// O(m log(n/m + 1)) instead of m separate pushes. Returns how many elements were new.
+	// With WAVLBalance the sorted elements are pushed one by one.
+	template<class Range>
+	int insertBatch(const Range& batch);
+
+	// insertBatch for a batch already in ascending order without repeated keys, all on the calling thread:
+	// no sort and no forks in the union, for callers that run batches in parallel themselves.
+	int insertSortedBatch(const std::vector<T>& sorted);
+
+	// Read-only copy in Eytzinger order for read-heavy phases, O(n).
+	FrozenSet<T> freeze() const;
+
+	// Builds a perfectly balanced tree from the keys of frozen, O(n).
+	static AVLTree thaw(const FrozenSet<T>& frozen);
+
 	~AVLTree();
 };
 
-#endif // !AVL_TREE_HEADER
-
 //-1 Провалено вмъкване
 // 1 Вмъкването е ок
 // 2 Вмъкването е ок и сме направили ротация
 
-template<class T>
-int AVLTree<T>::pushRec(const T& elem, Node*& r) {
+template<class T, class Balance>
+int AVLTree<T, Balance>::pushRec(const T& elem, Node*& r) {
 	int res = 0;
 
 	if (r == nullptr) {
@@ -365,8 +504,77 @@ int AVLTree<T>::pushRec(const T& elem, Node*& r) {
 	return res;
 }
 
-template<class T>
-void AVLTree<T>::freeRec(Node* r) {
+// Same codes as pushRec. r->left or r->right may now have the rank of r (a 0-child).
+template<class T, class Balance>
+int AVLTree<T, Balance>::rankPushRec(const T& elem, Node*& r) {
+	if (r == nullptr) {
+		r = new Node(elem);
+		return 1;
+	}
+
+	if (r->data == elem)
+		return -1;
+
+	bool toLeft = elem < r->data;
+	int res = rankPushRec(elem, toLeft ? r->left : r->right);
+
+	if (res != 1)
+		return res;
+
+	// No 0-child: nothing left to fix, but only a rotation returns 2.
+	if (rankDifference(r, toLeft ? r->left : r->right) != 0)
+		return 1;
+
+	return fixRankAfterInsert(r, toLeft) ? 1 : 2;
+}
+
+/*
+* The child on the leftGrew side (x) has the rank of r.
+* If the sibling is a 1-child we promote r and the problem may move up.
+* Otherwise one rotation (the inner child of x is a 2-child) or two (it is a 1-child)
+* fix it for good, exactly as in AVL.
+*/
+template<class T, class Balance>
+bool AVLTree<T, Balance>::fixRankAfterInsert(Node*& r, bool leftGrew) {
+	Node* x = leftGrew ? r->left : r->right;
+	Node* sibling = leftGrew ? r->right : r->left;
+
+	if (rankDifference(r, sibling) == 1) {
+		++r->height;
+		return true;
+	}
+
+	Node* inner = leftGrew ? x->right : x->left;
+	Node* old = r;
+
+	if (rankDifference(x, inner) == 2) {
+		if (leftGrew)
+			Node::rotateRight(r);
+		else
+			Node::rotateLeft(r);
+
+		--old->height;
+		return false;
+	}
+
+	if (leftGrew) {
+		Node::rotateLeft(r->left);
+		Node::rotateRight(r);
+	}
+	else {
+		Node::rotateRight(r->right);
+		Node::rotateLeft(r);
+	}
+
+	++inner->height;
+	--x->height;
+	--old->height;
+
+	return false;
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::freeRec(Node* r) {
 	if (!r)
 		return;
 	freeRec(r->left);
@@ -375,14 +583,17 @@ void AVLTree<T>::freeRec(Node* r) {
 	delete r;
 }
 
-template<class T>
-void AVLTree<T>::copy(const AVLTree<T>& other) {
+template<class T, class Balance>
+void AVLTree<T, Balance>::copy(const AVLTree<T, Balance>& other) {
 	this->root = Node::copyDynamic(other.root);
 	nodesCount = other.nodesCount;
+
+	filter = other.filter ? new OptionalBloomFilter<T>(*other.filter) : nullptr;
+	filterRemovals = other.filterRemovals;
 }
 
-template<class T>
-int AVLTree<T>::removeRec(Node*& r, const T& elem) {
+template<class T, class Balance>
+int AVLTree<T, Balance>::removeRec(Node*& r, const T& elem) {
 	if (r == nullptr)
 		return -1;
 
@@ -434,11 +645,129 @@ int AVLTree<T>::removeRec(Node*& r, const T& elem) {
 	return res;
 }
 
+template<class T, class Balance>
+int AVLTree<T, Balance>::rankRemoveRec(Node*& r, const T& elem) {
+	if (r == nullptr)
+		return -1;
+
+	if (r->data == elem) {
+		if (!r->left || !r->right) {
+			Node* child = r->left ? r->left : r->right;
+
+			delete r;
+			r = child;
+
+			return 1;
+		}
+
+		Node* minNode = rankRemoveMin(r->right);
+
+		minNode->left = r->left;
+		minNode->right = r->right;
+		minNode->height = r->height;
+
+		delete r;
+		r = minNode;
+	}
+	else {
+		int res = rankRemoveRec(elem < r->data ? r->left : r->right, elem);
+
+		if (res != 1)
+			return res;
+	}
+
+	fixRankAfterRemove(r);
+
+	return 1;
+}
+
+template<class T, class Balance>
+typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::rankRemoveMin(Node*& r) {
+	if (r->left == nullptr) {
+		Node* minNode = r;
+		r = r->right;
+
+		return minNode;
+	}
+
+	Node* minNode = rankRemoveMin(r->left);
+
+	fixRankAfterRemove(r);
+
+	return minNode;
+}
+
+/*
+* A child of r lost a rank (or was removed), so r may be a leaf of rank 1
+* or have a 3-child x. With y the sibling of x:
+* - y is a 2-child: demote r, the problem may move up.
+* - y is a 1-child with two 2-children: demote r and y, the problem may move up.
+* - otherwise one rotation (the outer child of y is a 1-child) or two fix it for good.
+*/
+template<class T, class Balance>
+void AVLTree<T, Balance>::fixRankAfterRemove(Node*& r) {
+	if (!r->left && !r->right) {
+		r->height = 1;
+		return;
+	}
+
+	bool leftShrank = rankDifference(r, r->left) == 3;
+
+	if (!leftShrank && rankDifference(r, r->right) != 3)
+		return;
+
+	Node* y = leftShrank ? r->right : r->left;
+
+	if (rankDifference(r, y) == 2) {
+		--r->height;
+		return;
+	}
+
+	Node* outer = leftShrank ? y->right : y->left;
+	Node* inner = leftShrank ? y->left : y->right;
+
+	if (rankDifference(y, outer) == 2 && rankDifference(y, inner) == 2) {
+		--r->height;
+		--y->height;
+		return;
+	}
+
+	Node* old = r;
+
+	if (rankDifference(y, outer) == 1) {
+		if (leftShrank)
+			Node::rotateLeft(r);
+		else
+			Node::rotateRight(r);
+
+		++y->height;
+		--old->height;
+
+		if (!old->left && !old->right)
+			--old->height;
+
+		return;
+	}
+
+	if (leftShrank) {
+		Node::rotateRight(r->right);
+		Node::rotateLeft(r);
+	}
+	else {
+		Node::rotateLeft(r->left);
+		Node::rotateRight(r);
+	}
+
+	inner->height += 2;
+	--y->height;
+	old->height -= 2;
+}
+
 // We do double work here as we first
 // find the minNode and then we use backtracking to
 // balance the tree.
-template<class T>
-inline typename AVLTree<T>::Node* AVLTree<T>::balanceLeftPathAndGetMinNode(Node* rightOfRoot, Node*& minNode) {
+template<class T, class Balance>
+inline typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::balanceLeftPathAndGetMinNode(Node* rightOfRoot, Node*& minNode) {
 	if (rightOfRoot->left == nullptr) {
 		minNode = rightOfRoot;
 		return minNode->right;
@@ -453,8 +782,8 @@ inline typename AVLTree<T>::Node* AVLTree<T>::balanceLeftPathAndGetMinNode(Node*
 	return rightOfRoot;
 }
 
-template<class T>
-inline void AVLTree<T>::innerVertexRemovalCase(Node*& rootNode, Node*& rightOfRoot) {
+template<class T, class Balance>
+inline void AVLTree<T, Balance>::innerVertexRemovalCase(Node*& rootNode, Node*& rightOfRoot) {
 	Node* toDelete = rootNode;
 
 	Node* minNode;
@@ -468,8 +797,8 @@ inline void AVLTree<T>::innerVertexRemovalCase(Node*& rootNode, Node*& rightOfRo
 	delete toDelete;
 }
 
-template<class T>
-bool AVLTree<T>::existRec(const T& elem, const Node* r) const {
+template<class T, class Balance>
+bool AVLTree<T, Balance>::existRec(const T& elem, const Node* r) const {
 	if (r == nullptr)
 		return false;
 	else if (r->data == elem)
@@ -480,8 +809,8 @@ bool AVLTree<T>::existRec(const T& elem, const Node* r) const {
 		return existRec(elem, r->left);
 }
 
-template<class T>
-int AVLTree<T>::searchForLeftDisbalance(Node*& r) {
+template<class T, class Balance>
+int AVLTree<T, Balance>::searchForLeftDisbalance(Node*& r) {
 	assert(r);
 
 	int balance = Node::getBalanceFactor(r);
@@ -505,8 +834,8 @@ int AVLTree<T>::searchForLeftDisbalance(Node*& r) {
 	return 0;
 }
 
-template<class T>
-int AVLTree<T>::searchForRightDisbalance(Node*& r) {
+template<class T, class Balance>
+int AVLTree<T, Balance>::searchForRightDisbalance(Node*& r) {
 	assert(r);
 
 	int balance = Node::getBalanceFactor(r);
@@ -531,87 +860,160 @@ int AVLTree<T>::searchForRightDisbalance(Node*& r) {
 	return 0;
 }
 
-template<class T>
-void AVLTree<T>::free() {
+template<class T, class Balance>
+void AVLTree<T, Balance>::free() {
 	freeRec(root);
 }
 
-template<class T>
-AVLTree<T>::AVLTree(AVLTree<T>&& other) noexcept {
+template<class T, class Balance>
+AVLTree<T, Balance>::AVLTree(AVLTree<T, Balance>&& other) noexcept {
 	this->root = other.root;
 	other.root = nullptr;
 	nodesCount = other.nodesCount;
+
+	filter = other.filter;
+	filterRemovals = other.filterRemovals;
+	other.filter = nullptr;
 }
 
-template<class T>
-AVLTree<T>& AVLTree<T>::operator=(const AVLTree<T>& other) {
+template<class T, class Balance>
+AVLTree<T, Balance>& AVLTree<T, Balance>::operator=(const AVLTree<T, Balance>& other) {
 	if (this != &other) {
 		free();
+		delete filter;
 		copy(other);
 	}
 
 	return *this;
 }
 
-template<class T>
-AVLTree<T>& AVLTree<T>::operator=(AVLTree<T>&& other) noexcept {
+template<class T, class Balance>
+AVLTree<T, Balance>& AVLTree<T, Balance>::operator=(AVLTree<T, Balance>&& other) noexcept {
 	if (this != &other) {
 		free();
+		delete filter;
 
 		this->root = other.root;
 		other.root = nullptr;
 		nodesCount = other.nodesCount;
+
+		filter = other.filter;
+		filterRemovals = other.filterRemovals;
+		other.filter = nullptr;
 	}
 	return *this;
 }
 
-template<class T>
-bool AVLTree<T>::exists(const T& elem) const {
+template<class T, class Balance>
+bool AVLTree<T, Balance>::exists(const T& elem) const {
+	if (filter && !filter->mayContain(elem))
+		return false;
+
 	return existRec(elem, root);
 }
 
-template<class T>
-int AVLTree<T>::getNodesCount() const {
+template<class T, class Balance>
+template<class Key>
+const T* AVLTree<T, Balance>::find(const Key& key) const {
+	const Node* it = root;
+
+	while (it) {
+		if (it->data == key)
+			return &it->data;
+
+		it = (key < it->data) ? it->left : it->right;
+	}
+
+	return nullptr;
+}
+
+template<class T, class Balance>
+template<class Key, class Change>
+bool AVLTree<T, Balance>::update(const Key& key, Change change) {
+	// The node's data is not const, only the pointer find hands out.
+	T* found = const_cast<T*>(find(key));
+
+	if (!found)
+		return false;
+
+	change(*found);
+	return true;
+}
+
+template<class T, class Balance>
+int AVLTree<T, Balance>::getNodesCount() const {
+	if (nodesCount == unknownCount) {
+		std::stack<const Node*> toVisit;
+		nodesCount = 0;
+
+		if (root)
+			toVisit.push(root);
+
+		while (!toVisit.empty()) {
+			const Node* current = toVisit.top();
+			toVisit.pop();
+			++nodesCount;
+
+			if (current->left)
+				toVisit.push(current->left);
+			if (current->right)
+				toVisit.push(current->right);
+		}
+	}
+
 	return nodesCount;
 }
 
-template<class T>
-int AVLTree<T>::removeElement(const T& elem) {
-	int res = removeRec(root, elem);
+template<class T, class Balance>
+int AVLTree<T, Balance>::removeElement(const T& elem) {
+	int res = Balance::relaxed ? rankRemoveRec(root, elem) : removeRec(root, elem);
+
+	if (res != -1) {
+		if (nodesCount != unknownCount)
+			nodesCount--;
 
-	if (res != -1)
-		nodesCount--;
+		noteFilterRemovals(1);
+	}
 
 	return res;
 }
 
-template<class T>
-typename AVLTree<T>::NodeProxy AVLTree<T>::rootProxy() const {
+template<class T, class Balance>
+typename AVLTree<T, Balance>::NodeProxy AVLTree<T, Balance>::rootProxy() const {
 	return AVLTree::NodeProxy(*this);
 }
 
-template<class T>
-int AVLTree<T>::push(const T& elem) {
-	int res = pushRec(elem, root);
+template<class T, class Balance>
+int AVLTree<T, Balance>::push(const T& elem) {
+	int res = Balance::relaxed ? rankPushRec(elem, root) : pushRec(elem, root);
 
-	if (res != -1)
-		++nodesCount;
+	if (res != -1) {
+		if (nodesCount != unknownCount)
+			++nodesCount;
+
+		if (filter) {
+			filter->add(elem);
+
+			if (filter->addedCount() > filter->capacity())
+				rebuildFilter();
+		}
+	}
 
 	return res;
 }
 
-template<class T>
-int AVLTree<T>::getHeight() const {
+template<class T, class Balance>
+int AVLTree<T, Balance>::getHeight() const {
 	return root ? root->height : 0;
 }
 
-template<class T>
-bool AVLTree<T>::isEmpty() const {
+template<class T, class Balance>
+bool AVLTree<T, Balance>::isEmpty() const {
 	return (root == nullptr);
 }
 
-template<class T>
-void AVLTree<T>::recFillFileStream(std::ofstream& outFile, const Node* r) const {
+template<class T, class Balance>
+void AVLTree<T, Balance>::recFillFileStream(std::ofstream& outFile, const Node* r) const {
 	if(r == nullptr)
 		return;
 
@@ -622,8 +1024,44 @@ void AVLTree<T>::recFillFileStream(std::ofstream& outFile, const Node* r) const
 	outFile << "]";
 }
 
-template<class T>
-void AVLTree<T>::exportToTex(const char* filePath) const {
+template<class T, class Balance>
+TreeShape AVLTree<T, Balance>::analyze() const {
+	TreeShape shape;
+	if (!root)
+		return shape;
+
+	size_t pathLengths = 0;
+	std::stack<std::pair<const Node*, size_t>> toVisit;
+	toVisit.push({ root, 0 });
+
+	while (!toVisit.empty()) {
+		const Node* current = toVisit.top().first;
+		size_t depth = toVisit.top().second;
+		toVisit.pop();
+
+		// The parent was counted before, so depth is at most the current size.
+		if (depth == shape.depthHistogram.size())
+			shape.depthHistogram.push_back(0);
+
+		++shape.depthHistogram[depth];
+		++shape.balanceFactors[Node::getBalanceFactor(current)];
+		++shape.nodes;
+		pathLengths += depth + 1;
+
+		if (current->left)
+			toVisit.push({ current->left, depth + 1 });
+		if (current->right)
+			toVisit.push({ current->right, depth + 1 });
+	}
+
+	shape.maxPathLength = shape.depthHistogram.size();
+	shape.averagePathLength = static_cast<double>(pathLengths) / shape.nodes;
+
+	return shape;
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::exportToTex(const char* filePath) const {
 	std::ofstream outFile(filePath, std::ios::trunc);
 
 	outFile << "\\documentclass[tikz,border=10pt]{standalone}" << std::endl;
@@ -637,7 +1075,552 @@ void AVLTree<T>::exportToTex(const char* filePath) const {
 	outFile << "\\end{document}";
 }
 
-template<class T>
-AVLTree<T>::~AVLTree() {
+/*
+* join(left, middle, right) requires left < middle < right.
+*
+* If the heights differ by more than one we walk down the spine of the higher tree
+* until we reach a subtree whose height is close to the lower one, hang the lower tree there
+* with middle as the new root and fix the balance on the way back up.
+* The walk is O(|height(left) - height(right)|).
+*/
+template<class T, class Balance>
+typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::join(Node* left, Node* middle, Node* right) {
+	static_assert(!Balance::relaxed, "split, concat and the set operations need AVLBalance: they join subtrees by height");
+
+	int leftHeight = Node::getHeight(left);
+	int rightHeight = Node::getHeight(right);
+
+	if (leftHeight > rightHeight + 1) {
+		joinRight(left, middle, right);
+		return left;
+	}
+
+	if (rightHeight > leftHeight + 1) {
+		joinLeft(right, left, middle);
+		return right;
+	}
+
+	middle->left = left;
+	middle->right = right;
+	Node::updateHeight(middle);
+
+	return middle;
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::joinRight(Node*& r, Node* middle, Node* right) {
+	if (Node::getHeight(r->right) <= Node::getHeight(right) + 1) {
+		middle->left = r->right;
+		middle->right = right;
+		Node::updateHeight(middle);
+
+		r->right = middle;
+	}
+	else {
+		joinRight(r->right, middle, right);
+	}
+
+	Node::updateHeight(r);
+	searchForRightDisbalance(r);
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::joinLeft(Node*& r, Node* left, Node* middle) {
+	if (Node::getHeight(r->left) <= Node::getHeight(left) + 1) {
+		middle->left = left;
+		middle->right = r->left;
+		Node::updateHeight(middle);
+
+		r->left = middle;
+	}
+	else {
+		joinLeft(r->left, left, middle);
+	}
+
+	Node::updateHeight(r);
+	searchForLeftDisbalance(r);
+}
+
+template<class T, class Balance>
+typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::join2(Node* left, Node* right) {
+	if (!left)
+		return right;
+
+	if (!right)
+		return left;
+
+	Node* minNode;
+	right = balanceLeftPathAndGetMinNode(right, minNode);
+
+	return join(left, minNode, right);
+}
+
+// Splits r into left (< key) and right (> key).
+// Returns the node holding key (detached) or nullptr if there is none.
+template<class T, class Balance>
+typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::splitRec(Node* r, const T& key, Node*& left, Node*& right) {
+	if (r == nullptr) {
+		left = right = nullptr;
+		return nullptr;
+	}
+
+	Node* rLeft = r->left;
+	Node* rRight = r->right;
+
+	if (r->data == key) {
+		left = rLeft;
+		right = rRight;
+
+		r->left = r->right = nullptr;
+		r->height = 1;
+
+		return r;
+	}
+
+	Node* found;
+
+	if (key < r->data) {
+		Node* middlePart;
+		found = splitRec(rLeft, key, left, middlePart);
+		right = join(middlePart, r, rRight);
+	}
+	else {
+		Node* middlePart;
+		found = splitRec(rRight, key, middlePart, right);
+		left = join(rLeft, r, middlePart);
+	}
+
+	return found;
+}
+
+// matches counts the keys found in both trees.
+template<class T, class Balance>
+typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::unionRec(Node* first, Node* second, int& matches, int forkDepth) {
+	if (!first)
+		return second;
+
+	if (!second)
+		return first;
+
+	Node* secondLeft;
+	Node* secondRight;
+
+	Node* found = splitRec(second, first->data, secondLeft, secondRight);
+
+	if (found) {
+		delete found;
+		++matches;
+	}
+
+	Node* left;
+	Node* right;
+	int leftMatches = 0, rightMatches = 0;
+
+	forkJoin(forkDepth > 0 && Node::getHeight(first) >= parallelHeightCutoff,
+		[&]() { left = unionRec(first->left, secondLeft, leftMatches, forkDepth - 1); },
+		[&]() { right = unionRec(first->right, secondRight, rightMatches, forkDepth - 1); });
+
+	matches += leftMatches + rightMatches;
+
+	return join(left, first, right);
+}
+
+template<class T, class Balance>
+typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::intersectRec(Node* first, Node* second, int& matches, int forkDepth) {
+	if (!first || !second) {
+		freeRec(first);
+		freeRec(second);
+		return nullptr;
+	}
+
+	Node* secondLeft;
+	Node* secondRight;
+
+	Node* found = splitRec(second, first->data, secondLeft, secondRight);
+
+	Node* left;
+	Node* right;
+	int leftMatches = 0, rightMatches = 0;
+
+	forkJoin(forkDepth > 0 && Node::getHeight(first) >= parallelHeightCutoff,
+		[&]() { left = intersectRec(first->left, secondLeft, leftMatches, forkDepth - 1); },
+		[&]() { right = intersectRec(first->right, secondRight, rightMatches, forkDepth - 1); });
+
+	matches += leftMatches + rightMatches;
+
+	if (found) {
+		delete found;
+		++matches;
+
+		return join(left, first, right);
+	}
+
+	delete first;
+
+	return join2(left, right);
+}
+
+template<class T, class Balance>
+typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::differenceRec(Node* first, Node* second, int& matches, int forkDepth) {
+	if (!first || !second) {
+		freeRec(second);
+		return first;
+	}
+
+	Node* firstLeft;
+	Node* firstRight;
+
+	Node* found = splitRec(first, second->data, firstLeft, firstRight);
+
+	Node* left;
+	Node* right;
+	int leftMatches = 0, rightMatches = 0;
+
+	forkJoin(forkDepth > 0 && Node::getHeight(second) >= parallelHeightCutoff,
+		[&]() { left = differenceRec(firstLeft, second->left, leftMatches, forkDepth - 1); },
+		[&]() { right = differenceRec(firstRight, second->right, rightMatches, forkDepth - 1); });
+
+	matches += leftMatches + rightMatches;
+
+	delete second;
+
+	if (found) {
+		delete found;
+		++matches;
+	}
+
+	return join2(left, right);
+}
+
+// Enough levels of forking to give every hardware thread a task.
+template<class T, class Balance>
+int AVLTree<T, Balance>::initialForkDepth() {
+	unsigned threads = std::thread::hardware_concurrency();
+	int depth = 0;
+
+	while ((1u << depth) < threads)
+		++depth;
+
+	return depth;
+}
+
+template<class T, class Balance>
+template<class Left, class Right>
+void AVLTree<T, Balance>::forkJoin(bool fork, Left&& left, Right&& right) {
+	if (!fork) {
+		left();
+		right();
+		return;
+	}
+
+	std::future<void> pending = std::async(std::launch::async, std::forward<Left>(left));
+	right();
+	pending.get();
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::unionWith(const AVLTree<T, Balance>& other) {
+	unionWith(AVLTree<T, Balance>(other));
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::unionWith(AVLTree<T, Balance>&& other) {
+	unionWith(std::move(other), initialForkDepth());
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::unionWith(AVLTree<T, Balance>&& other, int forkDepth) {
+	if (this == &other)
+		return;
+
+	int matches = 0;
+
+	if (filter)
+		addToFilter(other.root);
+
+	root = unionRec(root, other.root, matches, forkDepth);
+
+	if (nodesCount != unknownCount && other.nodesCount != unknownCount)
+		nodesCount += other.nodesCount - matches;
+	else
+		nodesCount = unknownCount;
+
+	if (filter && filter->addedCount() > filter->capacity())
+		rebuildFilter();
+
+	other.root = nullptr;
+	other.nodesCount = 0;
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::intersect(const AVLTree<T, Balance>& other) {
+	intersect(AVLTree<T, Balance>(other));
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::intersect(AVLTree<T, Balance>&& other) {
+	if (this == &other)
+		return;
+
+	int matches = 0;
+	int countBefore = filter ? getNodesCount() : 0;
+
+	root = intersectRec(root, other.root, matches, initialForkDepth());
+	nodesCount = matches;
+
+	noteFilterRemovals(countBefore - matches);
+
+	other.root = nullptr;
+	other.nodesCount = 0;
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::difference(const AVLTree<T, Balance>& other) {
+	difference(AVLTree<T, Balance>(other));
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::difference(AVLTree<T, Balance>&& other) {
+	if (this == &other) {
+		free();
+		root = nullptr;
+		nodesCount = 0;
+
+		if (filter) {
+			filter->clear();
+			filterRemovals = 0;
+		}
+		return;
+	}
+
+	int matches = 0;
+
+	root = differenceRec(root, other.root, matches, initialForkDepth());
+
+	if (nodesCount != unknownCount)
+		nodesCount -= matches;
+
+	noteFilterRemovals(matches);
+
+	other.root = nullptr;
+	other.nodesCount = 0;
+}
+
+template<class T, class Balance>
+std::pair<AVLTree<T, Balance>, AVLTree<T, Balance>> AVLTree<T, Balance>::split(const T& key) {
+	std::pair<AVLTree<T, Balance>, AVLTree<T, Balance>> parts;
+
+	Node* found = splitRec(root, key, parts.first.root, parts.second.root);
+
+	if (found)
+		parts.second.root = join(nullptr, found, parts.second.root);
+
+	parts.first.nodesCount = parts.second.nodesCount = unknownCount;
+
+	root = nullptr;
+	nodesCount = 0;
+
+	if (filter) {
+		filter->clear();
+		filterRemovals = 0;
+	}
+
+	return parts;
+}
+
+template<class T, class Balance>
+AVLTree<T, Balance> AVLTree<T, Balance>::concat(AVLTree<T, Balance>&& left, AVLTree<T, Balance>&& right) {
+	AVLTree<T, Balance> result;
+
+	if (left.root && right.root) {
+		const Node* leftMax = left.root;
+		while (leftMax->right)
+			leftMax = leftMax->right;
+
+		const Node* rightMin = right.root;
+		while (rightMin->left)
+			rightMin = rightMin->left;
+
+		if (!(leftMax->data < rightMin->data))
+			throw std::invalid_argument("concat: left and right overlap!");
+	}
+
+	result.root = result.join2(left.root, right.root);
+
+	if (left.nodesCount != unknownCount && right.nodesCount != unknownCount)
+		result.nodesCount = left.nodesCount + right.nodesCount;
+	else
+		result.nodesCount = unknownCount;
+
+	left.root = right.root = nullptr;
+	left.nodesCount = right.nodesCount = 0;
+
+	left.disableBloomFilter();
+	right.disableBloomFilter();
+
+	return result;
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::enableBloomFilter(int expectedElements, double falsePositiveRate) {
+	static_assert(IsHashable<T>::value, "enableBloomFilter needs a std::hash specialization for the key type");
+
+	int count = getNodesCount();
+
+	delete filter;
+	filter = new OptionalBloomFilter<T>(expectedElements > count ? expectedElements : count, falsePositiveRate);
+	filterRemovals = 0;
+
+	addToFilter(root);
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::disableBloomFilter() {
+	delete filter;
+	filter = nullptr;
+}
+
+// Doubles the capacity if the filter is full, so the false positive rate stays on target.
+template<class T, class Balance>
+void AVLTree<T, Balance>::rebuildFilter() {
+	if constexpr (IsHashable<T>::value) {
+		int count = getNodesCount();
+		int capacity = static_cast<int>(filter->capacity());
+
+		if (count >= capacity)
+			capacity = 2 * count;
+
+		enableBloomFilter(capacity, filter->falsePositiveRate());
+	}
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::noteFilterRemovals(int removed) {
+	if (!filter)
+		return;
+
+	filterRemovals += removed;
+
+	if (filterRemovals > static_cast<int>(filter->capacity() / 2))
+		rebuildFilter();
+}
+
+template<class T, class Balance>
+void AVLTree<T, Balance>::addToFilter(const Node* r) {
+	std::stack<const Node*> toVisit;
+
+	if (r)
+		toVisit.push(r);
+
+	while (!toVisit.empty()) {
+		const Node* current = toVisit.top();
+		toVisit.pop();
+
+		filter->add(current->data);
+
+		if (current->left)
+			toVisit.push(current->left);
+		if (current->right)
+			toVisit.push(current->right);
+	}
+}
+
+template<class T, class Balance>
+typename AVLTree<T, Balance>::Node* AVLTree<T, Balance>::buildBalanced(const std::vector<T>& sorted, size_t from, size_t to) {
+	if (from >= to)
+		return nullptr;
+
+	size_t middle = from + (to - from) / 2;
+
+	Node* left = buildBalanced(sorted, from, middle);
+	Node* right = buildBalanced(sorted, middle + 1, to);
+
+	Node* result = new Node(sorted[middle], left, right);
+	Node::updateHeight(result);
+
+	return result;
+}
+
+template<class T, class Balance>
+template<class Range>
+int AVLTree<T, Balance>::insertBatch(const Range& batch) {
+	return insertSorted(BatchSort::sortedUnique<T>(batch), initialForkDepth());
+}
+
+template<class T, class Balance>
+int AVLTree<T, Balance>::insertSortedBatch(const std::vector<T>& sorted) {
+	return insertSorted(sorted, 0);
+}
+
+template<class T, class Balance>
+int AVLTree<T, Balance>::insertSorted(const std::vector<T>& sorted, int forkDepth) {
+	if (sorted.empty())
+		return 0;
+
+	// The union joins by height, so a relaxed tree takes the sorted keys one by one.
+	if constexpr (Balance::relaxed) {
+		int inserted = 0;
+
+		for (const T& elem : sorted) {
+			if (push(elem) != -1)
+				++inserted;
+		}
+
+		return inserted;
+	}
+	else {
+		AVLTree<T, Balance> built;
+		built.root = buildBalanced(sorted, 0, sorted.size());
+		built.nodesCount = static_cast<int>(sorted.size());
+
+		int before = getNodesCount();
+		unionWith(std::move(built), forkDepth);
+
+		return getNodesCount() - before;
+	}
+}
+
+template<class T, class Balance>
+FrozenSet<T> AVLTree<T, Balance>::freeze() const {
+	std::vector<T> sorted;
+
+	for (ConstIterator it = begin(); it != end(); ++it)
+		sorted.push_back(*it);
+
+	return FrozenSet<T>::fromSorted(std::move(sorted));
+}
+
+template<class T, class Balance>
+AVLTree<T, Balance> AVLTree<T, Balance>::thaw(const FrozenSet<T>& frozen) {
+	std::vector<T> sorted = frozen.toSorted();
+
+	AVLTree<T, Balance> result;
+	result.root = buildBalanced(sorted, 0, sorted.size());
+	result.nodesCount = static_cast<int>(sorted.size());
+
+	return result;
+}
+
+template<class T, class Balance>
+AVLTree<T, Balance>::~AVLTree() {
 	free();
-}
\ No newline at end of file
+	delete filter;
+}
+
+template<class T, class Balance>
+struct OrderedSetTraits<AVLTree<T, Balance>> {
+	using ValueType = T;
+	using Engine = AVLTree<T, Balance>;
+
+	static constexpr bool uniqueKeys = true;
+
+	static bool insert(Engine& engine, const T& elem) { return engine.push(elem) != -1; }
+
+	static bool contains(const Engine& engine, const T& elem) { return engine.exists(elem); }
+
+	static bool remove(Engine& engine, const T& elem) { return engine.removeElement(elem) != -1; }
+
+	static size_t size(const Engine& engine) { return static_cast<size_t>(engine.getNodesCount()); }
+};
+
+#endif // !AVL_TREE_HEADER
@@ -0,0 +1,29 @@
+/*
+* Balance policies for AVLTree.
+*
+* Both keep a rank in every node (the height field, rank + 1, so a missing node is 0)
+* and rebalance with the same rotations. They differ in the rank differences they allow
+* between a node and its children:
+*
+* AVLBalance: the rank is the height, siblings differ by at most one.
+* A delete may rotate on every level of its path, O(log n) rotations.
+*
+* WAVLBalance (weak AVL, Haeupler, Sen and Tarjan): every rank difference is 1 or 2
+* and a leaf has rank 0. Inserts do exactly what AVL does, so a tree that only grows
+* is an AVL tree. A delete demotes ranks on its way up and stops after at most
+* two rotations, O(1) amortized rebalancing steps. The height stays below 2 log2(n).
+* The join-based operations need true heights and are AVL only.
+*/
+
+#ifndef BALANCE_POLICY_HEADER
+#define BALANCE_POLICY_HEADER
+
+struct AVLBalance {
+	static constexpr bool relaxed = false;
+};
+
+struct WAVLBalance {
+	static constexpr bool relaxed = true;
+};
+
+#endif // !BALANCE_POLICY_HEADER
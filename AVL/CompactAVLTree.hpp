@@ -0,0 +1,412 @@
+#ifndef COMPACT_AVL_TREE_HEADER
+#define COMPACT_AVL_TREE_HEADER
+#include<cstdint>
+#include<stack>
+#include<stdexcept>
+#include<utility>
+#include<vector>
+#include"../Common/OrderedSet.hpp"
+
+/*
+* AVL tree stored in one growable array.
+*
+* Children are 32-bit indices into the array and the height is one byte
+* (an AVL tree of 2^32 nodes is less than 64 levels high), so with int keys
+* a node takes 16 bytes instead of the 32 of AVLTree::Node.
+* More nodes fit in a cache line and in the cache, and there is a single allocation.
+*
+* Removed slots are chained in a free list (through left) and reused by the next push.
+* A copy is a copy of the array, a single memcpy when T is trivially copyable.
+* Pushing may move the array, so no reference into it is kept across a push.
+*
+* BF = height(right) - height(left) \in {-1, 0, 1}
+*/
+
+template<class T>
+class CompactAVLTree {
+private:
+	using Index = std::uint32_t;
+
+	static const Index nil = UINT32_MAX;
+
+	struct Node {
+		T data;
+		Index left;
+		Index right;
+		std::int8_t height;
+
+		Node(const T& data) : data(data), left(nil), right(nil), height(1) {}
+	};
+
+	std::vector<Node> nodes;
+	Index root;
+	Index freeList;
+	int nodesCount;
+
+	int getHeight(Index r) const {
+		return r == nil ? 0 : nodes[r].height;
+	}
+
+	void updateHeight(Index r) {
+		int leftHeight = getHeight(nodes[r].left);
+		int rightHeight = getHeight(nodes[r].right);
+
+		nodes[r].height = static_cast<std::int8_t>(((leftHeight > rightHeight) ? leftHeight : rightHeight) + 1);
+	}
+
+	int getBalanceFactor(Index r) const {
+		return getHeight(nodes[r].right) - getHeight(nodes[r].left);
+	}
+
+	Index allocate(const T& elem);
+
+	void release(Index r);
+
+	Index rotateLeft(Index r);
+
+	Index rotateRight(Index r);
+
+	Index balance(Index r);
+
+	Index pushRec(Index r, const T& elem, bool& inserted);
+
+	Index removeRec(Index r, const T& elem, bool& removed);
+
+	Index removeMin(Index r, Index& minNode);
+
+public:
+	class ConstIterator {
+	private:
+		const std::vector<Node>* nodes;
+		std::stack<Index> currentNodes;
+
+		ConstIterator(const std::vector<Node>* nodes, Index startNode) : nodes(nodes) {
+			init(startNode);
+		}
+
+		void init(Index initializeFrom) {
+			while (initializeFrom != nil) {
+				currentNodes.push(initializeFrom);
+				initializeFrom = (*nodes)[initializeFrom].left;
+			}
+		}
+
+		bool emptyStack() const { return currentNodes.empty(); }
+	public:
+		bool operator==(const ConstIterator& other) const {
+			if (emptyStack() && other.emptyStack())
+				return true;
+
+			else if (emptyStack() || other.emptyStack()) {
+				return false;
+			}
+
+			return (currentNodes.top() == other.currentNodes.top());
+		}
+
+		bool operator!=(const ConstIterator& other) const {
+			return !(this->operator==(other));
+		}
+
+		ConstIterator& operator++() {
+			if (emptyStack())
+				return *this;
+
+			Index current = currentNodes.top();
+			currentNodes.pop();
+			init((*nodes)[current].right);
+
+			return *this;
+		}
+
+		ConstIterator operator++(int) {
+			ConstIterator temp = *this;
+			++*this;
+			return temp;
+		}
+
+		const T& operator*() const {
+			if (emptyStack())
+				throw std::runtime_error("Reached end of collection!");
+
+			return (*nodes)[currentNodes.top()].data;
+		}
+
+		friend class CompactAVLTree;
+	};
+
+	CompactAVLTree() : root(nil), freeList(nil), nodesCount(0) {}
+
+	// The indices are positions in the array, so copying the array copies the tree.
+	CompactAVLTree(const CompactAVLTree&) = default;
+	CompactAVLTree& operator=(const CompactAVLTree&) = default;
+
+	CompactAVLTree(CompactAVLTree&& other) noexcept : nodes(std::move(other.nodes)), root(other.root), freeList(other.freeList), nodesCount(other.nodesCount) {
+		other.root = other.freeList = nil;
+		other.nodesCount = 0;
+	}
+
+	CompactAVLTree& operator=(CompactAVLTree&& other) noexcept {
+		if (this != &other) {
+			nodes = std::move(other.nodes);
+			root = other.root;
+			freeList = other.freeList;
+			nodesCount = other.nodesCount;
+
+			other.nodes.clear();
+			other.root = other.freeList = nil;
+			other.nodesCount = 0;
+		}
+
+		return *this;
+	}
+
+	// 1 if elem was inserted, -1 if it was already there.
+	int push(const T& elem);
+
+	// 1 if elem was removed, -1 if it was not found.
+	int removeElement(const T& elem);
+
+	bool exists(const T& elem) const;
+
+	// Allocates room for count nodes up front, so pushing them never moves the array.
+	void reserve(size_t count) {
+		nodes.reserve(count);
+	}
+
+	int getNodesCount() const {
+		return nodesCount;
+	}
+
+	int getHeight() const {
+		return getHeight(root);
+	}
+
+	bool isEmpty() const {
+		return root == nil;
+	}
+
+	// Bytes taken by the node array, free slots included.
+	size_t memoryUsage() const {
+		return nodes.capacity() * sizeof(Node);
+	}
+
+	ConstIterator begin() const {
+		return ConstIterator(&nodes, root);
+	}
+
+	ConstIterator end() const {
+		return ConstIterator(&nodes, nil);
+	}
+};
+
+template<class T>
+typename CompactAVLTree<T>::Index CompactAVLTree<T>::allocate(const T& elem) {
+	if (freeList != nil) {
+		Index reused = freeList;
+		freeList = nodes[reused].left;
+
+		nodes[reused] = Node(elem);
+		return reused;
+	}
+
+	if (nodes.size() == nil)
+		throw std::length_error("CompactAVLTree is full!");
+
+	nodes.emplace_back(elem);
+	return static_cast<Index>(nodes.size() - 1);
+}
+
+template<class T>
+void CompactAVLTree<T>::release(Index r) {
+	nodes[r].left = freeList;
+	freeList = r;
+}
+
+template<class T>
+typename CompactAVLTree<T>::Index CompactAVLTree<T>::rotateLeft(Index r) {
+	Index originalRight = nodes[r].right;
+
+	nodes[r].right = nodes[originalRight].left;
+	nodes[originalRight].left = r;
+
+	updateHeight(r);
+	updateHeight(originalRight);
+
+	return originalRight;
+}
+
+template<class T>
+typename CompactAVLTree<T>::Index CompactAVLTree<T>::rotateRight(Index r) {
+	Index originalLeft = nodes[r].left;
+
+	nodes[r].left = nodes[originalLeft].right;
+	nodes[originalLeft].right = r;
+
+	updateHeight(r);
+	updateHeight(originalLeft);
+
+	return originalLeft;
+}
+
+// The subtrees of r are AVL trees whose heights differ by at most 2.
+template<class T>
+typename CompactAVLTree<T>::Index CompactAVLTree<T>::balance(Index r) {
+	updateHeight(r);
+
+	int balanceFactor = getBalanceFactor(r);
+
+	if (balanceFactor > 1) {
+		if (getBalanceFactor(nodes[r].right) < 0)
+			nodes[r].right = rotateRight(nodes[r].right);
+
+		return rotateLeft(r);
+	}
+
+	if (balanceFactor < -1) {
+		if (getBalanceFactor(nodes[r].left) > 0)
+			nodes[r].left = rotateLeft(nodes[r].left);
+
+		return rotateRight(r);
+	}
+
+	return r;
+}
+
+// The child index is assigned after the recursive call returns, because allocate may move the array.
+template<class T>
+typename CompactAVLTree<T>::Index CompactAVLTree<T>::pushRec(Index r, const T& elem, bool& inserted) {
+	if (r == nil) {
+		inserted = true;
+		return allocate(elem);
+	}
+
+	if (nodes[r].data == elem)
+		return r;
+
+	if (elem < nodes[r].data) {
+		Index newLeft = pushRec(nodes[r].left, elem, inserted);
+		nodes[r].left = newLeft;
+	}
+	else {
+		Index newRight = pushRec(nodes[r].right, elem, inserted);
+		nodes[r].right = newRight;
+	}
+
+	if (!inserted)
+		return r;
+
+	return balance(r);
+}
+
+// Returns r without its minimum, which is unlinked (not released) and stored in minNode.
+template<class T>
+typename CompactAVLTree<T>::Index CompactAVLTree<T>::removeMin(Index r, Index& minNode) {
+	if (nodes[r].left == nil) {
+		minNode = r;
+		return nodes[r].right;
+	}
+
+	nodes[r].left = removeMin(nodes[r].left, minNode);
+
+	return balance(r);
+}
+
+template<class T>
+typename CompactAVLTree<T>::Index CompactAVLTree<T>::removeRec(Index r, const T& elem, bool& removed) {
+	if (r == nil)
+		return nil;
+
+	if (nodes[r].data == elem) {
+		removed = true;
+
+		Index left = nodes[r].left;
+		Index right = nodes[r].right;
+
+		release(r);
+
+		if (left == nil)
+			return right;
+
+		if (right == nil)
+			return left;
+
+		Index minNode;
+		Index newRight = removeMin(right, minNode);
+
+		nodes[minNode].left = left;
+		nodes[minNode].right = newRight;
+
+		return balance(minNode);
+	}
+
+	if (elem < nodes[r].data)
+		nodes[r].left = removeRec(nodes[r].left, elem, removed);
+	else
+		nodes[r].right = removeRec(nodes[r].right, elem, removed);
+
+	if (!removed)
+		return r;
+
+	return balance(r);
+}
+
+template<class T>
+int CompactAVLTree<T>::push(const T& elem) {
+	bool inserted = false;
+
+	root = pushRec(root, elem, inserted);
+
+	if (!inserted)
+		return -1;
+
+	++nodesCount;
+	return 1;
+}
+
+template<class T>
+int CompactAVLTree<T>::removeElement(const T& elem) {
+	bool removed = false;
+
+	root = removeRec(root, elem, removed);
+
+	if (!removed)
+		return -1;
+
+	--nodesCount;
+	return 1;
+}
+
+template<class T>
+bool CompactAVLTree<T>::exists(const T& elem) const {
+	Index it = root;
+
+	while (it != nil) {
+		const Node& node = nodes[it];
+
+		if (node.data == elem)
+			return true;
+
+		it = (elem < node.data) ? node.left : node.right;
+	}
+
+	return false;
+}
+
+template<class T>
+struct OrderedSetTraits<CompactAVLTree<T>> {
+	using ValueType = T;
+	using Engine = CompactAVLTree<T>;
+
+	static constexpr bool uniqueKeys = true;
+
+	static bool insert(Engine& engine, const T& elem) { return engine.push(elem) != -1; }
+
+	static bool contains(const Engine& engine, const T& elem) { return engine.exists(elem); }
+
+	static bool remove(Engine& engine, const T& elem) { return engine.removeElement(elem) != -1; }
+
+	static size_t size(const Engine& engine) { return static_cast<size_t>(engine.getNodesCount()); }
+};
+
+#endif // !COMPACT_AVL_TREE_HEADER
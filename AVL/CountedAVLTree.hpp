@@ -0,0 +1,95 @@
+#ifndef COUNTED_AVL_TREE_HEADER
+#define COUNTED_AVL_TREE_HEADER
+#include<cstddef>
+#include"AVLTree.hpp"
+#include"../Common/CountedEntry.hpp"
+
+/*
+* Multiset on top of AVLTree that keeps one node per distinct key with an occurrence count.
+*
+* AVLTree::push rejects duplicates. Here a repeated push finds the node and bumps
+* its count in place: no allocation and no rebalancing.
+* push, count and decrement are O(log n).
+*/
+
+template<class T>
+class CountedAVLTree {
+private:
+	using Entry = CountedEntry<T>;
+
+	AVLTree<Entry> entries;
+	size_t total = 0;
+
+public:
+	using ConstIterator = typename AVLTree<Entry>::ConstIterator;
+
+	// Returns the number of occurrences of elem after the push.
+	size_t push(const T& elem) {
+		++total;
+
+		size_t occurrences = 0;
+		if (entries.update(elem, [&occurrences](Entry& entry) { occurrences = ++entry.count; }))
+			return occurrences;
+
+		entries.push(Entry(elem, 1));
+		return 1;
+	}
+
+	size_t count(const T& elem) const {
+		const Entry* entry = entries.find(elem);
+		return entry ? entry->count : 0;
+	}
+
+	// Removes one occurrence of elem, and its node with the last one. False if elem is not there.
+	bool decrement(const T& elem) {
+		size_t occurrences = 0;
+
+		if (!entries.update(elem, [&occurrences](Entry& entry) { occurrences = --entry.count; }))
+			return false;
+
+		--total;
+
+		if (occurrences == 0)
+			entries.removeElement(Entry(elem, 0));
+
+		return true;
+	}
+
+	// Removes every occurrence of elem. Returns how many there were.
+	size_t removeAll(const T& elem) {
+		const Entry* entry = entries.find(elem);
+
+		if (!entry)
+			return 0;
+
+		size_t removed = entry->count;
+		total -= removed;
+		entries.removeElement(Entry(elem, 0));
+
+		return removed;
+	}
+
+	// Occurrences of all keys.
+	size_t size() const {
+		return total;
+	}
+
+	size_t distinctCount() const {
+		return static_cast<size_t>(entries.getNodesCount());
+	}
+
+	bool empty() const {
+		return total == 0;
+	}
+
+	// Iterates the distinct keys in order: entry.key and entry.count.
+	ConstIterator begin() const {
+		return entries.begin();
+	}
+
+	ConstIterator end() const {
+		return entries.end();
+	}
+};
+
+#endif // !COUNTED_AVL_TREE_HEADER
@@ -0,0 +1,105 @@
+#ifndef INTERNED_AVL_TREE_HEADER
+#define INTERNED_AVL_TREE_HEADER
+#include"AVLTree.hpp"
+#include"../Common/StringArena.hpp"
+
+/*
+* AVL tree of strings whose bytes live in a per-tree StringArena.
+* The nodes hold 16-byte ArenaString handles instead of std::string.
+* Lookups wrap the caller's string_view in a handle, so they never copy or allocate.
+*
+* push stores the key before inserting it. If the key is already there
+* the bytes are rolled back, which is free because they are the last ones stored.
+* The arena is compacted when removals leave more dead than live bytes.
+*/
+
+class InternedAVLTree {
+private:
+	StringArena arena;
+	AVLTree<ArenaString> tree;
+
+	void compactIfNeeded() {
+		if (arena.needsCompaction())
+			arena.compact(tree);
+	}
+
+public:
+	using ConstIterator = AVLTree<ArenaString>::ConstIterator;
+
+	InternedAVLTree() = default;
+
+	InternedAVLTree(const InternedAVLTree& other) : tree(other.tree) {
+		arena.compact(tree);
+	}
+
+	InternedAVLTree(InternedAVLTree&&) noexcept = default;
+
+	InternedAVLTree& operator=(const InternedAVLTree& other) {
+		if (this != &other) {
+			InternedAVLTree temp(other);
+			*this = std::move(temp);
+		}
+
+		return *this;
+	}
+
+	InternedAVLTree& operator=(InternedAVLTree&&) noexcept = default;
+
+	// Same return codes as AVLTree::push.
+	int push(std::string_view elem) {
+		ArenaString stored = arena.store(elem);
+		int result = tree.push(stored);
+
+		if (result == -1)
+			arena.rollback(stored);
+
+		return result;
+	}
+
+	bool exists(std::string_view elem) const {
+		return tree.exists(ArenaString(elem));
+	}
+
+	// Same return codes as AVLTree::removeElement.
+	int removeElement(std::string_view elem) {
+		int result = tree.removeElement(ArenaString(elem));
+
+		if (result != -1) {
+			arena.release(ArenaString(elem));
+			compactIfNeeded();
+		}
+
+		return result;
+	}
+
+	// Copies the live keys next to each other in sorted order.
+	void compact() {
+		arena.compact(tree);
+	}
+
+	int getNodesCount() const {
+		return tree.getNodesCount();
+	}
+
+	int getHeight() const {
+		return tree.getHeight();
+	}
+
+	bool isEmpty() const {
+		return tree.isEmpty();
+	}
+
+	const StringArena& keyArena() const {
+		return arena;
+	}
+
+	ConstIterator begin() const {
+		return tree.begin();
+	}
+
+	ConstIterator end() const {
+		return tree.end();
+	}
+};
+
+#endif // !INTERNED_AVL_TREE_HEADER
@@ -0,0 +1,357 @@
+#ifndef PERSISTENT_AVL_TREE_HEADER
+#define PERSISTENT_AVL_TREE_HEADER
+#include<memory>
+#include<stack>
+#include<stdexcept>
+
+/*
+* Persistent AVL tree.
+*
+* Nodes are immutable and reference counted, so a tree never changes a node it shares.
+* push/removeElement copy only the nodes on the root-to-leaf path (O(log n) new nodes)
+* and point them to the unchanged subtrees of the previous version.
+*
+* A snapshot is a copy of the root pointer: O(1) time and memory.
+* Snapshots can be read from other threads while this tree keeps changing,
+* because the reference counts are atomic and no shared node is ever written.
+*
+* BF = height(right) - height(left) \in {-1, 0, 1}
+*/
+
+template<class T>
+class PersistentAVLTree {
+private:
+	struct Node;
+
+	using NodePtr = std::shared_ptr<const Node>;
+
+	struct Node {
+		T data;
+		NodePtr left;
+		NodePtr right;
+		int height;
+
+		Node(const T& data, NodePtr l, NodePtr r) : data(data), left(std::move(l)), right(std::move(r)) {
+			int leftHeight = getHeight(left);
+			int rightHeight = getHeight(right);
+
+			height = ((leftHeight > rightHeight) ? leftHeight : rightHeight) + 1;
+		}
+	};
+
+	NodePtr root;
+	int nodesCount;
+
+	static int getHeight(const NodePtr& r) {
+		return r ? r->height : 0;
+	}
+
+	static NodePtr makeNode(const T& data, NodePtr l, NodePtr r) {
+		return std::make_shared<const Node>(data, std::move(l), std::move(r));
+	}
+
+	static NodePtr balance(const T& data, NodePtr l, NodePtr r);
+
+	static NodePtr pushRec(const NodePtr& r, const T& elem, bool& inserted);
+
+	static NodePtr removeRec(const NodePtr& r, const T& elem, bool& removed);
+
+	static NodePtr removeMin(const NodePtr& r, const T*& minData);
+
+public:
+	class NodeProxy {
+	private:
+		const Node* currNode;
+
+		NodeProxy(const Node* r) : currNode(r) {}
+	public:
+		NodeProxy() = delete;
+		NodeProxy(const NodeProxy&) = default;
+
+		NodeProxy(const PersistentAVLTree& tree) : currNode(tree.root.get()) {}
+
+		NodeProxy operator++() const {
+			if (isValid()) {
+				return NodeProxy(currNode->right.get());
+			}
+			return NodeProxy(currNode);
+		}
+
+		NodeProxy operator--() const {
+			if (isValid()) {
+				return NodeProxy(currNode->left.get());
+			}
+			return NodeProxy(currNode);
+		}
+
+		int getHeight() const {
+			if (!currNode)
+				return 0;
+
+			return currNode->height;
+		}
+
+		const T& operator*() const {
+			return currNode->data;
+		}
+
+		bool isValid() const {
+			return currNode != nullptr;
+		}
+	};
+
+	// The iterator does not own the nodes. Keep the tree (or a snapshot of it) alive while iterating.
+	class ConstIterator {
+	private:
+		std::stack<const Node*> currentNodes;
+
+		ConstIterator(const Node* startNode) {
+			init(startNode);
+		}
+
+		void init(const Node* initializeFrom) {
+			while (initializeFrom) {
+				currentNodes.push(initializeFrom);
+				initializeFrom = initializeFrom->left.get();
+			}
+		}
+
+		bool emptyStack() const { return currentNodes.empty(); }
+
+		ConstIterator() = default;
+	public:
+		bool operator==(const ConstIterator& other) const {
+			if (emptyStack() && other.emptyStack())
+				return true;
+
+			else if (emptyStack() || other.emptyStack()) {
+				return false;
+			}
+
+			return (currentNodes.top() == other.currentNodes.top());
+		}
+
+		bool operator!=(const ConstIterator& other) const {
+			return !(this->operator==(other));
+		}
+
+		ConstIterator& operator++() {
+			if (emptyStack())
+				return *this;
+
+			const Node* current = currentNodes.top();
+			currentNodes.pop();
+			init(current->right.get());
+
+			return *this;
+		}
+
+		ConstIterator operator++(int) {
+			ConstIterator temp = *this;
+			++*this;
+			return temp;
+		}
+
+		const T& operator*() const {
+			if (emptyStack())
+				throw std::runtime_error("Reached end of collection!");
+
+			return currentNodes.top()->data;
+		}
+
+		friend class PersistentAVLTree;
+	};
+
+	PersistentAVLTree() : root(nullptr), nodesCount(0) {}
+
+	// Copying shares every node: O(1).
+	PersistentAVLTree(const PersistentAVLTree&) = default;
+	PersistentAVLTree(PersistentAVLTree&&) noexcept = default;
+	PersistentAVLTree& operator=(const PersistentAVLTree&) = default;
+	PersistentAVLTree& operator=(PersistentAVLTree&&) noexcept = default;
+
+	PersistentAVLTree snapshot() const {
+		return *this;
+	}
+
+	// 1 if elem was inserted, -1 if it was already there (this version is kept as it is).
+	int push(const T& elem);
+
+	// 1 if elem was removed, -1 if it was not found.
+	int removeElement(const T& elem);
+
+	bool exists(const T& elem) const;
+
+	int getNodesCount() const {
+		return nodesCount;
+	}
+
+	int getHeight() const {
+		return getHeight(root);
+	}
+
+	bool isEmpty() const {
+		return root == nullptr;
+	}
+
+	NodeProxy rootProxy() const {
+		return NodeProxy(*this);
+	}
+
+	ConstIterator begin() const {
+		return ConstIterator(root.get());
+	}
+
+	ConstIterator end() const {
+		return ConstIterator();
+	}
+};
+
+// Builds a node from two AVL subtrees whose heights differ by at most 2,
+// rotating (on fresh copies) if they differ by exactly 2.
+template<class T>
+typename PersistentAVLTree<T>::NodePtr PersistentAVLTree<T>::balance(const T& data, NodePtr l, NodePtr r) {
+	int leftHeight = getHeight(l);
+	int rightHeight = getHeight(r);
+
+	if (leftHeight > rightHeight + 1) {
+		if (getHeight(l->left) >= getHeight(l->right))
+			return makeNode(l->data, l->left, makeNode(data, l->right, std::move(r)));
+
+		const NodePtr& lr = l->right;
+		return makeNode(lr->data, makeNode(l->data, l->left, lr->left), makeNode(data, lr->right, std::move(r)));
+	}
+
+	if (rightHeight > leftHeight + 1) {
+		if (getHeight(r->right) >= getHeight(r->left))
+			return makeNode(r->data, makeNode(data, std::move(l), r->left), r->right);
+
+		const NodePtr& rl = r->left;
+		return makeNode(rl->data, makeNode(data, std::move(l), rl->left), makeNode(r->data, rl->right, r->right));
+	}
+
+	return makeNode(data, std::move(l), std::move(r));
+}
+
+template<class T>
+typename PersistentAVLTree<T>::NodePtr PersistentAVLTree<T>::pushRec(const NodePtr& r, const T& elem, bool& inserted) {
+	if (!r) {
+		inserted = true;
+		return makeNode(elem, nullptr, nullptr);
+	}
+
+	if (r->data == elem)
+		return r;
+
+	if (elem < r->data) {
+		NodePtr newLeft = pushRec(r->left, elem, inserted);
+
+		if (!inserted)
+			return r;
+
+		return balance(r->data, std::move(newLeft), r->right);
+	}
+
+	NodePtr newRight = pushRec(r->right, elem, inserted);
+
+	if (!inserted)
+		return r;
+
+	return balance(r->data, r->left, std::move(newRight));
+}
+
+// Returns r without its minimum. minData points to the minimum, which stays alive in r.
+template<class T>
+typename PersistentAVLTree<T>::NodePtr PersistentAVLTree<T>::removeMin(const NodePtr& r, const T*& minData) {
+	if (!r->left) {
+		minData = &r->data;
+		return r->right;
+	}
+
+	NodePtr newLeft = removeMin(r->left, minData);
+
+	return balance(r->data, std::move(newLeft), r->right);
+}
+
+template<class T>
+typename PersistentAVLTree<T>::NodePtr PersistentAVLTree<T>::removeRec(const NodePtr& r, const T& elem, bool& removed) {
+	if (!r)
+		return r;
+
+	if (r->data == elem) {
+		removed = true;
+
+		if (!r->left)
+			return r->right;
+
+		if (!r->right)
+			return r->left;
+
+		const T* minData;
+		NodePtr newRight = removeMin(r->right, minData);
+
+		return balance(*minData, r->left, std::move(newRight));
+	}
+
+	if (elem < r->data) {
+		NodePtr newLeft = removeRec(r->left, elem, removed);
+
+		if (!removed)
+			return r;
+
+		return balance(r->data, std::move(newLeft), r->right);
+	}
+
+	NodePtr newRight = removeRec(r->right, elem, removed);
+
+	if (!removed)
+		return r;
+
+	return balance(r->data, r->left, std::move(newRight));
+}
+
+template<class T>
+int PersistentAVLTree<T>::push(const T& elem) {
+	bool inserted = false;
+
+	NodePtr newRoot = pushRec(root, elem, inserted);
+
+	if (!inserted)
+		return -1;
+
+	root = std::move(newRoot);
+	++nodesCount;
+
+	return 1;
+}
+
+template<class T>
+int PersistentAVLTree<T>::removeElement(const T& elem) {
+	bool removed = false;
+
+	NodePtr newRoot = removeRec(root, elem, removed);
+
+	if (!removed)
+		return -1;
+
+	root = std::move(newRoot);
+	--nodesCount;
+
+	return 1;
+}
+
+template<class T>
+bool PersistentAVLTree<T>::exists(const T& elem) const {
+	const Node* it = root.get();
+
+	while (it) {
+		if (it->data == elem)
+			return true;
+
+		it = (elem < it->data) ? it->left.get() : it->right.get();
+	}
+
+	return false;
+}
+
+#endif // !PERSISTENT_AVL_TREE_HEADER
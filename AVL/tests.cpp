@@ -1,5 +1,10 @@
 //www.github.com/doctest
 #include "AVLTree.hpp"
+#include "PersistentAVLTree.hpp"
+#include "InternedAVLTree.hpp"
+#include "CompactAVLTree.hpp"
+#include "AVLMap.hpp"
+#include "CountedAVLTree.hpp"
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include"../../doctest.h"
 #include<cmath>
@@ -7,6 +12,10 @@
 #include <chrono>       // std::chrono::system_clock
 #include<algorithm>
 #include<string>
+#include<set>
+#include<map>
+#include<vector>
+#include<iterator>
 
 template<class T>
 bool correctHeight(const AVLTree<T>& t) {
@@ -188,4 +197,646 @@ TEST_CASE("basic test on iterator") {
 	}
 
 	CHECK(std::is_sorted(t.begin(), t.end()));
-}
\ No newline at end of file
+}
+template<class T, class Balance>
+bool sameElements(const AVLTree<T, Balance>& t, const std::set<T>& expected) {
+	if (t.getNodesCount() != (int)expected.size())
+		return false;
+
+	for (const T& elem : expected)
+		if (!t.exists(elem))
+			return false;
+
+	return std::equal(expected.begin(), expected.end(), t.begin());
+}
+
+TEST_CASE("set operations match std::set") {
+	for (int i = 0; i < 50; i++) {
+		AVLTree<int> first, second;
+		std::set<int> firstSet, secondSet;
+
+		int firstSize = rand() % 3000, secondSize = rand() % 3000;
+
+		for (int j = 0; j < firstSize; j++) {
+			int elem = rand() % 5000;
+			first.push(elem);
+			firstSet.insert(elem);
+		}
+
+		for (int j = 0; j < secondSize; j++) {
+			int elem = rand() % 5000;
+			second.push(elem);
+			secondSet.insert(elem);
+		}
+
+		std::set<int> unionSet, intersectionSet, differenceSet;
+		std::set_union(firstSet.begin(), firstSet.end(), secondSet.begin(), secondSet.end(), std::inserter(unionSet, unionSet.end()));
+		std::set_intersection(firstSet.begin(), firstSet.end(), secondSet.begin(), secondSet.end(), std::inserter(intersectionSet, intersectionSet.end()));
+		std::set_difference(firstSet.begin(), firstSet.end(), secondSet.begin(), secondSet.end(), std::inserter(differenceSet, differenceSet.end()));
+
+		AVLTree<int> unionTree(first), intersectionTree(first), differenceTree(first);
+
+		unionTree.unionWith(second);
+		intersectionTree.intersect(second);
+		differenceTree.difference(std::move(second));
+
+		CHECK(isAVL<int>(unionTree.rootProxy()));
+		CHECK(isAVL<int>(intersectionTree.rootProxy()));
+		CHECK(isAVL<int>(differenceTree.rootProxy()));
+
+		CHECK(correctHeight(unionTree));
+		CHECK(correctHeight(intersectionTree));
+		CHECK(correctHeight(differenceTree));
+
+		CHECK(sameElements(unionTree, unionSet));
+		CHECK(sameElements(intersectionTree, intersectionSet));
+		CHECK(sameElements(differenceTree, differenceSet));
+		CHECK(second.isEmpty());
+	}
+}
+
+TEST_CASE("set operations on big trees") {
+	AVLTree<int> evens, thirds;
+
+	for (int i = 0; i < 300000; i += 2)
+		evens.push(i);
+
+	for (int i = 0; i < 300000; i += 3)
+		thirds.push(i);
+
+	AVLTree<int> both(evens);
+	both.intersect(thirds);
+
+	CHECK(both.getNodesCount() == 50000);
+	CHECK(isAVL<int>(both.rootProxy()));
+
+	evens.unionWith(thirds);
+
+	CHECK(evens.getNodesCount() == 200000);
+	CHECK(isAVL<int>(evens.rootProxy()));
+	CHECK(correctHeight(evens));
+
+	evens.difference(both);
+
+	CHECK(evens.getNodesCount() == 150000);
+	CHECK(evens.exists(2) && !evens.exists(6));
+	CHECK(isAVL<int>(evens.rootProxy()));
+}
+
+TEST_CASE("split and concat") {
+	for (int i = 0; i < 100; i++) {
+		AVLTree<int> t;
+		std::set<int> expected;
+
+		int size = rand() % 5000;
+
+		for (int j = 0; j < size; j++) {
+			int elem = rand() % 10000;
+			t.push(elem);
+			expected.insert(elem);
+		}
+
+		int key = rand() % 10000;
+
+		std::pair<AVLTree<int>, AVLTree<int>> parts = t.split(key);
+
+		std::set<int> lower(expected.begin(), expected.lower_bound(key));
+		std::set<int> upper(expected.lower_bound(key), expected.end());
+
+		CHECK(t.isEmpty());
+		CHECK(isAVL<int>(parts.first.rootProxy()));
+		CHECK(isAVL<int>(parts.second.rootProxy()));
+		CHECK(sameElements(parts.first, lower));
+		CHECK(sameElements(parts.second, upper));
+
+		AVLTree<int> glued = AVLTree<int>::concat(std::move(parts.first), std::move(parts.second));
+
+		CHECK(isAVL<int>(glued.rootProxy()));
+		CHECK(correctHeight(glued));
+		CHECK(sameElements(glued, expected));
+	}
+}
+
+TEST_CASE("concat of unbalanced sizes and overlapping trees") {
+	AVLTree<int> small, big;
+
+	small.push(-1);
+
+	for (int i = 0; i < 100000; i++)
+		big.push(i);
+
+	AVLTree<int> glued = AVLTree<int>::concat(std::move(small), std::move(big));
+
+	CHECK(glued.getNodesCount() == 100001);
+	CHECK(isAVL<int>(glued.rootProxy()));
+	CHECK(glued.exists(-1));
+
+	AVLTree<int> first, second;
+	first.push(5);
+	second.push(5);
+
+	CHECK_THROWS(AVLTree<int>::concat(std::move(first), std::move(second)));
+}
+
+template<class Proxy>
+bool isBalanced(const Proxy& t) {
+	if (!t.isValid())
+		return true;
+	int lHeight = (--t).getHeight();
+	int rHeight = (++t).getHeight();
+
+	return std::abs(rHeight - lHeight) < 2 && isBalanced(++t) && isBalanced(--t);
+}
+
+TEST_CASE("persistent tree keeps snapshots unchanged") {
+	PersistentAVLTree<int> t;
+	std::set<int> expected;
+	std::vector<PersistentAVLTree<int>> snapshots;
+	std::vector<std::set<int>> expectedSnapshots;
+
+	for (int i = 0; i < 5000; i++) {
+		int elem = rand() % 2000;
+
+		if (rand() % 3) {
+			CHECK((t.push(elem) == 1) == expected.insert(elem).second);
+		}
+		else {
+			CHECK((t.removeElement(elem) == 1) == (expected.erase(elem) == 1));
+		}
+
+		if (i % 500 == 0) {
+			snapshots.push_back(t.snapshot());
+			expectedSnapshots.push_back(expected);
+		}
+	}
+
+	CHECK(isBalanced(t.rootProxy()));
+	CHECK(t.getNodesCount() == (int)expected.size());
+	CHECK(std::equal(expected.begin(), expected.end(), t.begin()));
+
+	for (size_t i = 0; i < snapshots.size(); i++) {
+		CHECK(isBalanced(snapshots[i].rootProxy()));
+		CHECK(snapshots[i].getNodesCount() == (int)expectedSnapshots[i].size());
+		CHECK(std::equal(expectedSnapshots[i].begin(), expectedSnapshots[i].end(), snapshots[i].begin()));
+
+		for (int elem : expectedSnapshots[i])
+			CHECK(snapshots[i].exists(elem));
+	}
+}
+
+TEST_CASE("persistent tree height on big tree") {
+	PersistentAVLTree<int> t;
+	int nodesCount = 100000;
+
+	for (int i = 0; i < nodesCount; i++)
+		t.push(i);
+
+	PersistentAVLTree<int> before = t;
+
+	for (int i = 0; i < nodesCount; i += 2)
+		t.removeElement(i);
+
+	CHECK(isBalanced(t.rootProxy()));
+	CHECK(t.getNodesCount() == nodesCount / 2);
+	CHECK(before.getNodesCount() == nodesCount);
+	CHECK(before.exists(0) && !t.exists(0));
+	CHECK(t.getHeight() <= 2 * log2(t.getNodesCount() + 1) - 1);
+}
+
+TEST_CASE("bloom filter never hides existing elements") {
+	AVLTree<int> t;
+	std::set<int> expected;
+
+	t.enableBloomFilter(100, 0.01);
+
+	for (int i = 0; i < 20000; i++) {
+		int elem = rand() % 5000;
+
+		if (rand() % 3) {
+			t.push(elem);
+			expected.insert(elem);
+		}
+		else {
+			t.removeElement(elem);
+			expected.erase(elem);
+		}
+	}
+
+	AVLTree<int> copy(t), other;
+	other.push(-5);
+	copy.unionWith(other);
+
+	for (int i = 0; i < 5000; i++) {
+		CHECK(t.exists(i) == (expected.count(i) == 1));
+		CHECK(copy.exists(i) == (expected.count(i) == 1));
+	}
+
+	CHECK(copy.exists(-5));
+
+	copy.difference(t);
+	CHECK(copy.getNodesCount() == 1);
+	CHECK(copy.exists(-5));
+}
+
+// Only the comparisons, no std::hash: the tree must not need one unless its filter is enabled.
+struct OrderedOnly {
+	int value;
+
+	bool operator==(const OrderedOnly& other) const { return value == other.value; }
+	bool operator<(const OrderedOnly& other) const { return value < other.value; }
+	bool operator>(const OrderedOnly& other) const { return value > other.value; }
+};
+
+TEST_CASE("keys without std::hash work without a bloom filter") {
+	CHECK_FALSE(IsHashable<OrderedOnly>::value);
+
+	AVLTree<OrderedOnly> t;
+	std::set<int> expected;
+
+	for (int i = 0; i < 5000; i++) {
+		int elem = rand() % 1000;
+
+		if (rand() % 3) {
+			t.push({ elem });
+			expected.insert(elem);
+		}
+		else {
+			t.removeElement({ elem });
+			expected.erase(elem);
+		}
+	}
+
+	AVLTree<OrderedOnly> copy(t);
+	for (int i = 0; i < 1000; i++)
+		CHECK(copy.exists({ i }) == (expected.count(i) == 1));
+
+	CHECK(copy.getNodesCount() == static_cast<int>(expected.size()));
+}
+
+TEST_CASE("interned tree keeps keys after compaction") {
+	InternedAVLTree t;
+	std::set<std::string> expected;
+
+	for (int i = 0; i < 30000; i++) {
+		std::string key = "key-" + std::to_string(rand() % 8000) + std::string(rand() % 40, 'x');
+
+		if (rand() % 2) {
+			CHECK((t.push(key) != -1) == expected.insert(key).second);
+		}
+		else {
+			CHECK((t.removeElement(key) != -1) == (expected.erase(key) == 1));
+		}
+	}
+
+	CHECK(t.getNodesCount() == (int)expected.size());
+	CHECK(t.keyArena().deadBytes() <= t.keyArena().liveBytes() + 64 * 1024);
+
+	InternedAVLTree copy(t);
+	t.compact();
+
+	CHECK(t.keyArena().deadBytes() == 0);
+	CHECK(copy.getNodesCount() == (int)expected.size());
+
+	auto sameKey = [](const std::string& str, const ArenaString& key) { return key.view() == str; };
+	CHECK(std::equal(expected.begin(), expected.end(), t.begin(), sameKey));
+	CHECK(std::equal(expected.begin(), expected.end(), copy.begin(), sameKey));
+
+	for (const std::string& key : expected)
+		CHECK(t.exists(key));
+	CHECK(!t.exists("missing"));
+}
+
+template<class T>
+bool sameElements(const CompactAVLTree<T>& t, const std::set<T>& expected) {
+	if (t.getNodesCount() != (int)expected.size())
+		return false;
+
+	for (const T& elem : expected)
+		if (!t.exists(elem))
+			return false;
+
+	return std::equal(expected.begin(), expected.end(), t.begin());
+}
+
+TEST_CASE("compact tree matches std::set and reuses freed slots") {
+	CompactAVLTree<int> t;
+	std::set<int> expected;
+
+	for (int i = 0; i < 100000; i++) {
+		int elem = rand() % 20000;
+
+		if (rand() % 2) {
+			CHECK((t.push(elem) == 1) == expected.insert(elem).second);
+		}
+		else {
+			CHECK((t.removeElement(elem) == 1) == (expected.erase(elem) == 1));
+		}
+	}
+
+	CHECK(sameElements(t, expected));
+	CHECK(t.getHeight() <= 1.45 * log2(t.getNodesCount() + 2));
+
+	CompactAVLTree<int> copy(t);
+	size_t memory = t.memoryUsage();
+
+	for (int elem : expected)
+		t.removeElement(elem);
+
+	for (int elem : expected)
+		t.push(elem);
+
+	CHECK(t.memoryUsage() == memory);
+	CHECK(sameElements(t, expected));
+	CHECK(sameElements(copy, expected));
+
+	CompactAVLTree<int> moved(std::move(copy));
+	CHECK(copy.isEmpty());
+	CHECK(sameElements(moved, expected));
+}
+
+TEST_CASE("compact tree height on big tree") {
+	int nodesCount = 1000000;
+
+	CompactAVLTree<int> t;
+	t.reserve(nodesCount);
+
+	for (int i = 0; i < nodesCount; i++)
+		t.push(i);
+
+	CHECK(t.getNodesCount() == nodesCount);
+	CHECK(t.getHeight() == 20);
+	CHECK(t.exists(0) && t.exists(nodesCount - 1) && !t.exists(nodesCount));
+}
+
+TEST_CASE("freeze and thaw keep the elements") {
+	AVLTree<int> t;
+	std::set<int> expected;
+
+	for (int i = 0; i < 50000; i++) {
+		int elem = rand() % 100000;
+		t.push(elem);
+		expected.insert(elem);
+	}
+
+	FrozenSet<int> frozen = t.freeze();
+	CHECK(frozen.size() == expected.size());
+
+	for (int i = -1; i <= 100001; i++) {
+		std::set<int>::const_iterator bound = expected.lower_bound(i);
+		const int* frozenBound = frozen.lowerBound(i);
+
+		CHECK(frozen.contains(i) == (expected.count(i) == 1));
+		CHECK((frozenBound == nullptr) == (bound == expected.end()));
+		if (frozenBound && bound != expected.end())
+			CHECK(*frozenBound == *bound);
+	}
+
+	AVLTree<int> thawed = AVLTree<int>::thaw(frozen);
+	CHECK(sameElements(thawed, expected));
+	CHECK(isAVL<int>(thawed.rootProxy()));
+	CHECK(thawed.getHeight() == (int)std::ceil(log2(expected.size() + 1)));
+
+	FrozenSet<int> empty = AVLTree<int>().freeze();
+	CHECK(!empty.contains(0));
+	CHECK(empty.lowerBound(0) == nullptr);
+	CHECK(AVLTree<int>::thaw(empty).isEmpty());
+}
+
+TEST_CASE("map keeps values out of the nodes") {
+	AVLMap<std::string, std::vector<int>> map;
+	std::map<std::string, std::vector<int>> expected;
+
+	for (int i = 0; i < 20000; i++) {
+		std::string key = std::to_string(rand() % 3000);
+		int op = rand() % 4;
+
+		if (op == 0) {
+			std::vector<int>& value = map.insertOrAssign(key, std::vector<int>(3, i));
+			expected[key] = std::vector<int>(3, i);
+			CHECK(value == expected[key]);
+		}
+		else if (op == 1) {
+			std::pair<std::vector<int>&, bool> result = map.tryEmplace(key, 2, i);
+			bool inserted = expected.emplace(key, std::vector<int>(2, i)).second;
+			CHECK(result.second == inserted);
+			CHECK(result.first == expected[key]);
+		}
+		else if (op == 2) {
+			CHECK(map.erase(key) == (expected.erase(key) == 1));
+		}
+		else {
+			std::vector<int>* value = map.find(key);
+			CHECK((value != nullptr) == (expected.count(key) == 1));
+			if (value)
+				value->push_back(i), expected[key].push_back(i);
+		}
+	}
+
+	CHECK(map.size() == (int)expected.size());
+
+	AVLMap<std::string, std::vector<int>> copy(map);
+	map.insertOrAssign("changed", std::vector<int>());
+
+	CHECK(!copy.contains("changed"));
+	CHECK(std::equal(expected.begin(), expected.end(), copy.begin(),
+		[](const std::pair<const std::string, std::vector<int>>& pair, const MapEntry<std::string, std::vector<int>>& entry) {
+			return pair.first == entry.key && pair.second == *entry.value;
+		}));
+}
+
+TEST_CASE("counted tree keeps one node per key") {
+	CountedAVLTree<int> tree;
+	std::map<int, size_t> expected;
+	size_t total = 0;
+
+	for (int i = 0; i < 20000; i++) {
+		int elem = rand() % 500;
+
+		if (rand() % 3) {
+			CHECK(tree.push(elem) == ++expected[elem]);
+			++total;
+		}
+		else {
+			bool present = expected.count(elem) == 1;
+			CHECK(tree.decrement(elem) == present);
+
+			if (present) {
+				--total;
+				if (--expected[elem] == 0)
+					expected.erase(elem);
+			}
+		}
+
+		CHECK(tree.count(elem) == (expected.count(elem) ? expected[elem] : 0));
+	}
+
+	CHECK(tree.size() == total);
+	CHECK(tree.distinctCount() == expected.size());
+	CHECK(std::equal(expected.begin(), expected.end(), tree.begin(),
+		[](const std::pair<const int, size_t>& pair, const CountedEntry<int>& entry) {
+			return pair.first == entry.key && pair.second == entry.count;
+		}));
+
+	int key = expected.begin()->first;
+	CHECK(tree.removeAll(key) == expected[key]);
+	CHECK(tree.count(key) == 0);
+}
+
+// Every rank difference is 1 or 2 and every leaf has rank 0 (height field 1).
+template<class T>
+bool isWAVL(const typename AVLTree<T, WAVLBalance>::NodeProxy& t) {
+	if (!t.isValid())
+		return true;
+
+	int leftDifference = t.getHeight() - (--t).getHeight();
+	int rightDifference = t.getHeight() - (++t).getHeight();
+	bool leaf = !(--t).isValid() && !(++t).isValid();
+
+	return 1 <= leftDifference && leftDifference <= 2 && 1 <= rightDifference && rightDifference <= 2
+		&& (!leaf || t.getHeight() == 1) && isWAVL<T>(--t) && isWAVL<T>(++t);
+}
+
+TEST_CASE("batch insert matches single pushes") {
+	AVLTree<int> batched;
+	AVLTree<int, WAVLBalance> weak;
+	std::set<int> expected;
+
+	for (int round = 0; round < 20; round++) {
+		std::vector<int> batch;
+		int batchSize = (round % 5 == 0) ? 40000 : rand() % 300;
+
+		for (int i = 0; i < batchSize; i++)
+			batch.push_back(rand() % 100000);
+
+		size_t before = expected.size();
+		expected.insert(batch.begin(), batch.end());
+
+		CHECK(batched.insertBatch(batch) == (int)(expected.size() - before));
+		CHECK(batched.getNodesCount() == (int)expected.size());
+		CHECK(isAVL<int>(batched.rootProxy()));
+
+		CHECK(weak.insertBatch(batch) == (int)(expected.size() - before));
+		CHECK(weak.getNodesCount() == (int)expected.size());
+		CHECK(isWAVL<int>(weak.rootProxy()));
+	}
+
+	CHECK(sameElements(batched, expected));
+	CHECK(sameElements(weak, expected));
+	CHECK(batched.insertBatch(std::vector<int>()) == 0);
+	CHECK(weak.insertBatch(std::vector<int>()) == 0);
+}
+
+template<class T, class Balance>
+bool sameShape(const typename AVLTree<T, AVLBalance>::NodeProxy& first, const typename AVLTree<T, Balance>::NodeProxy& second) {
+	if (!first.isValid() || !second.isValid())
+		return first.isValid() == second.isValid();
+
+	return *first == *second && first.getHeight() == second.getHeight()
+		&& sameShape<T, Balance>(--first, --second) && sameShape<T, Balance>(++first, ++second);
+}
+
+TEST_CASE("weak AVL grows exactly like AVL") {
+	AVLTree<int> avl;
+	AVLTree<int, WAVLBalance> wavl;
+
+	for (int i = 0; i < 50000; i++) {
+		int elem = rand() % 100000;
+		CHECK(avl.push(elem) == wavl.push(elem));
+	}
+
+	CHECK(sameShape<int, WAVLBalance>(avl.rootProxy(), wavl.rootProxy()));
+}
+
+TEST_CASE("weak AVL stays valid under deletes") {
+	AVLTree<int, WAVLBalance> tree;
+	std::set<int> expected;
+
+	for (int i = 0; i < 200000; i++) {
+		int elem = rand() % 5000;
+
+		if (rand() % 2)
+			CHECK((tree.push(elem) != -1) == expected.insert(elem).second);
+		else
+			CHECK((tree.removeElement(elem) != -1) == (expected.erase(elem) == 1));
+
+		if (i % 10000 == 0)
+			CHECK(isWAVL<int>(tree.rootProxy()));
+	}
+
+	CHECK(isWAVL<int>(tree.rootProxy()));
+	CHECK(sameElements(tree, expected));
+	CHECK(tree.getHeight() <= 2 * log2(tree.getNodesCount() + 1));
+
+	for (int elem : std::vector<int>(expected.begin(), expected.end()))
+		CHECK(tree.removeElement(elem) != -1);
+
+	CHECK(tree.isEmpty());
+}
+
+TEST_CASE("analyze reports the shape of the tree") {
+	AVLTree<int> perfect;
+	for (int i = 1; i <= 7; i++)
+		perfect.push(i);
+
+	TreeShape shape = perfect.analyze();
+
+	CHECK(shape.nodes == 7);
+	CHECK(shape.depthHistogram == std::vector<size_t>{ 1, 2, 4 });
+	CHECK(shape.maxPathLength == 3);
+	CHECK(std::fabs(shape.averagePathLength - 17.0 / 7) < 1e-9);
+	CHECK(shape.balanceFactors == std::map<int, size_t>{ { 0, 7 } });
+	CHECK(shape.toJson() == "{\"engine\":\"avl\",\"nodes\":7,\"depthHistogram\":[1,2,4],\"averagePathLength\":2.42857,\"maxPathLength\":3,\"balanceFactors\":{\"0\":7}}");
+
+	CHECK(AVLTree<int>().analyze().nodes == 0);
+
+	AVLTree<int> big;
+	for (int i = 0; i < (1 << 21); i++)
+		big.push(rand());
+
+	shape = big.analyze();
+	size_t counted = 0;
+	for (size_t count : shape.depthHistogram)
+		counted += count;
+
+	CHECK(counted == static_cast<size_t>(big.getNodesCount()));
+	CHECK(shape.maxPathLength == static_cast<size_t>(big.getHeight()));
+	CHECK(shape.balanceFactors.begin()->first >= -1);
+	CHECK(shape.balanceFactors.rbegin()->first <= 1);
+}
+
+TEST_CASE("nodes can live in a huge-page resource") {
+	HugePageResource resource(size_t(1) << 28);
+	AVLTree<int> tree;
+	std::set<int> expected;
+
+	{
+		NodeMemory::Scope scope(resource);
+		CHECK(NodeMemory::current() == &resource);
+
+		for (int i = 0; i < 100000; i++) {
+			int elem = rand() % 50000;
+			CHECK((tree.push(elem) != -1) == expected.insert(elem).second);
+		}
+	}
+
+	CHECK(NodeMemory::current() == nullptr);
+	if (resource.available())
+		CHECK(resource.used() >= expected.size() * sizeof(int));
+
+	// Freed into the resource after the scope ended, mixed with nodes from operator new.
+	for (int i = 0; i < 50000; i++) {
+		int elem = rand() % 60000;
+
+		if (rand() % 2)
+			CHECK((tree.push(elem) != -1) == expected.insert(elem).second);
+		else
+			CHECK((tree.removeElement(elem) != -1) == (expected.erase(elem) == 1));
+	}
+
+	CHECK(isAVL<int>(tree.rootProxy()));
+	CHECK(sameElements(tree, expected));
+
+	AVLTree<int> copy(tree);
+	tree = AVLTree<int>();
+	CHECK(sameElements(copy, expected));
+}
@@ -0,0 +1,138 @@
+/*
+* Log-bucketed (HDR style) latency histogram.
+*
+* Values below 2^subBucketBits are counted exactly. Above that every power of two
+* is split into 2^subBucketBits linear sub-buckets, so the relative error of a
+* reported value is at most 1 / 2^subBucketBits (~3% with the default 5 bits).
+* The whole 64-bit range fits in (65 - subBucketBits) * 2^subBucketBits counters,
+* so recording is a couple of shifts and an increment with no allocation.
+*
+* Percentiles report the upper bound of the bucket they fall in (capped by max()),
+* so they never underestimate the tail.
+*/
+
+#ifndef LATENCY_HISTOGRAM_HEADER_
+#define LATENCY_HISTOGRAM_HEADER_
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+
+template<unsigned subBucketBits = 5>
+class LatencyHistogram {
+private:
+	static constexpr std::uint64_t subBuckets = 1ull << subBucketBits;
+	static constexpr unsigned groups = 65 - subBucketBits;
+
+	std::vector<std::uint64_t> counts;
+	std::uint64_t total;
+	std::uint64_t minValue;
+	std::uint64_t maxValue;
+	long double sum;
+
+	static unsigned mostSignificantBit(std::uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+		return 63 - __builtin_clzll(v | 1);
+#else
+		unsigned msb = 0;
+		while (v >>= 1)
+			++msb;
+		return msb;
+#endif
+	}
+
+	static size_t bucketIndex(std::uint64_t value) {
+		unsigned msb = mostSignificantBit(value);
+
+		if (msb < subBucketBits)
+			return static_cast<size_t>(value);
+
+		unsigned shift = msb - subBucketBits;
+		return static_cast<size_t>((shift + 1) * subBuckets + ((value >> shift) - subBuckets));
+	}
+
+	// Largest value that maps to the given bucket.
+	static std::uint64_t bucketUpperBound(size_t index) {
+		size_t group = index / subBuckets;
+		std::uint64_t offset = index % subBuckets;
+
+		if (group == 0)
+			return offset;
+
+		unsigned shift = static_cast<unsigned>(group - 1);
+		return ((subBuckets + offset) << shift) + ((1ull << shift) - 1);
+	}
+
+public:
+	LatencyHistogram() : counts(groups * subBuckets, 0) {
+		reset();
+	}
+
+	void record(std::uint64_t value, std::uint64_t times = 1) {
+		counts[bucketIndex(value)] += times;
+		total += times;
+		sum += static_cast<long double>(value) * times;
+
+		if (value < minValue)
+			minValue = value;
+		if (value > maxValue)
+			maxValue = value;
+	}
+
+	void merge(const LatencyHistogram& other) {
+		for (size_t i = 0; i < counts.size(); i++)
+			counts[i] += other.counts[i];
+
+		total += other.total;
+		sum += other.sum;
+
+		if (other.minValue < minValue)
+			minValue = other.minValue;
+		if (other.maxValue > maxValue)
+			maxValue = other.maxValue;
+	}
+
+	void reset() {
+		for (std::uint64_t& c : counts)
+			c = 0;
+
+		total = 0;
+		sum = 0;
+		minValue = UINT64_MAX;
+		maxValue = 0;
+	}
+
+	// p is in [0, 100].
+	std::uint64_t percentile(double p) const {
+		if (total == 0)
+			return 0;
+
+		std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * total + 0.5);
+		if (rank == 0)
+			rank = 1;
+		if (rank > total)
+			rank = total;
+
+		std::uint64_t seen = 0;
+
+		for (size_t i = 0; i < counts.size(); i++) {
+			seen += counts[i];
+
+			if (seen >= rank) {
+				std::uint64_t bound = bucketUpperBound(i);
+				return bound < maxValue ? bound : maxValue;
+			}
+		}
+
+		return maxValue;
+	}
+
+	std::uint64_t count() const { return total; }
+
+	std::uint64_t min() const { return total ? minValue : 0; }
+
+	std::uint64_t max() const { return maxValue; }
+
+	double mean() const { return total ? static_cast<double>(sum / total) : 0.0; }
+};
+
+#endif // !LATENCY_HISTOGRAM_HEADER_
@@ -0,0 +1,512 @@
+/*
+* Scoped hierarchical profiler.
+*
+* Usage:
+*
+*	{
+*		PROFILE_ZONE("insert");
+*		list.insert(x);
+*	}
+*	profiler::Profiler::instance().dumpJson(std::cout);
+*
+* Zones nest: a zone opened while another one is active becomes its child.
+* Nothing is printed while measuring. Every zone accumulates its calls, time and
+* (optionally) hardware counters in memory, and the whole tree is written once by dumpJson.
+*
+* Build flags:
+*
+* PROFILER_DISABLED		  -> PROFILE_ZONE expands to nothing.
+* PROFILER_USE_TSC		  -> time with rdtsc instead of std::chrono::steady_clock (x86 only).
+*						     Ticks are converted to nanoseconds when the results are dumped.
+* PROFILER_PERF_COUNTERS  -> on Linux read cycles, cache misses, branch misses and dTLB load misses
+*						     per zone through perf_event_open. If the kernel refuses (perf_event_paranoid)
+*						     the counters are reported as unavailable and only time is measured.
+*						     A CPU without a dTLB event reports 0 dTLB misses and keeps the others.
+*						     Zones read the counters with rdpmc from the mmapped event pages, no system call.
+*						     Where the kernel does not allow rdpmc (or off x86) zones measure time only;
+*						     PerfCounterGroup::read still works for coarse measurements around a whole run.
+*
+* Zone names are compared by address first, so pass string literals.
+* The profiler is per thread; each thread gets its own tree.
+*/
+
+#ifndef PROFILER_HEADER_
+#define PROFILER_HEADER_
+#include<chrono>
+#include<cstdint>
+#include<cstring>
+#include<ostream>
+#include<string>
+#include<vector>
+
+#if defined(PROFILER_USE_TSC) && (defined(__x86_64__) || defined(__i386__))
+#include<x86intrin.h>
+#define PROFILER_TSC_AVAILABLE
+#endif
+
+#if defined(PROFILER_PERF_COUNTERS) && defined(__linux__)
+#include<linux/perf_event.h>
+#include<sys/ioctl.h>
+#include<sys/syscall.h>
+#include<unistd.h>
+#define PROFILER_PERF_AVAILABLE
+#endif
+
+#if defined(PROFILER_PERF_AVAILABLE) && (defined(__x86_64__) || defined(__i386__))
+#include<atomic>
+#include<sys/mman.h>
+#include<x86intrin.h>
+#define PROFILER_RDPMC_AVAILABLE
+#endif
+
+namespace profiler {
+
+class Clock {
+public:
+	static std::uint64_t now() {
+#ifdef PROFILER_TSC_AVAILABLE
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	static std::uint64_t steadyNanoseconds() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+};
+
+// Group of hardware counters read with a single read() call.
+// The first event is the group leader, so all of them are scheduled together.
+// The dTLB event is optional: the group is opened without it if the CPU has none.
+class PerfCounterGroup {
+public:
+	enum Event { Cycles = 0, CacheMisses, BranchMisses, DTLBMisses, Count };
+
+	static const char* eventName(unsigned e) {
+		static const char* names[Count] = { "cycles", "cache_misses", "branch_misses", "dtlb_misses" };
+		return names[e];
+	}
+
+	PerfCounterGroup() : userReadable(false) {
+		for (unsigned i = 0; i < Count; i++)
+			fds[i] = -1;
+
+#ifdef PROFILER_RDPMC_AVAILABLE
+		for (unsigned i = 0; i < Count; i++)
+			pages[i] = nullptr;
+#endif
+
+#ifdef PROFILER_PERF_AVAILABLE
+		const std::uint32_t types[Count] = {
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HW_CACHE
+		};
+
+		const std::uint64_t configs[Count] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES,
+			PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+		};
+
+		for (unsigned i = 0; i < Count; i++) {
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[i];
+			attr.config = configs[i];
+			attr.disabled = (i == 0);
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+
+			fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0));
+
+			if (fds[i] == -1 && i != DTLBMisses) {
+				close();
+				return;
+			}
+		}
+
+		ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+
+#ifdef PROFILER_RDPMC_AVAILABLE
+		mapPages();
+#endif
+	}
+
+	PerfCounterGroup(const PerfCounterGroup&) = delete;
+	PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+	bool available() const {
+		return fds[0] != -1;
+	}
+
+	// Fills out[0..Count). Returns false (and zeroes out) if the counters are not available.
+	bool read(std::uint64_t* out) const {
+#ifdef PROFILER_PERF_AVAILABLE
+		if (available()) {
+			// The values come in the order the events were opened, the missing ones left out.
+			std::uint64_t buffer[1 + Count];
+			unsigned opened = 0;
+			for (unsigned i = 0; i < Count; i++)
+				opened += (fds[i] != -1);
+
+			ssize_t expected = static_cast<ssize_t>((1 + opened) * sizeof(std::uint64_t));
+
+			if (::read(fds[0], buffer, sizeof(buffer)) == expected) {
+				for (unsigned i = 0, next = 1; i < Count; i++)
+					out[i] = (fds[i] != -1) ? buffer[next++] : 0;
+				return true;
+			}
+		}
+#endif
+		for (unsigned i = 0; i < Count; i++)
+			out[i] = 0;
+		return false;
+	}
+
+	// True if readFast can read the counters from user space, without a system call.
+	bool fastReadable() const {
+		return userReadable;
+	}
+
+	// Like read, with rdpmc when fastReadable(). An event that is not on a hardware counter
+	// right now (multiplexed out) cannot be read that way, then this falls back to read.
+	bool readFast(std::uint64_t* out) const {
+#ifdef PROFILER_RDPMC_AVAILABLE
+		if (userReadable && readPages(out))
+			return true;
+#endif
+		return read(out);
+	}
+
+	~PerfCounterGroup() { close(); }
+
+private:
+	int fds[Count];
+	bool userReadable;
+
+#ifdef PROFILER_RDPMC_AVAILABLE
+	perf_event_mmap_page* pages[Count];
+
+	// The first page of every event tells which hardware counter holds it.
+	void mapPages() {
+		if (!available())
+			return;
+
+		size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+		for (unsigned i = 0; i < Count; i++) {
+			if (fds[i] == -1)
+				continue;
+
+			void* mapped = mmap(nullptr, pageSize, PROT_READ, MAP_SHARED, fds[i], 0);
+			if (mapped == MAP_FAILED)
+				return;
+
+			pages[i] = static_cast<perf_event_mmap_page*>(mapped);
+		}
+
+		std::uint64_t probe[Count];
+		userReadable = true;
+		userReadable = readPages(probe);
+	}
+
+	// The seqlock protocol of perf_event_mmap_page: retry if the kernel updated the page meanwhile.
+	static bool readPage(const volatile perf_event_mmap_page* page, std::uint64_t& value) {
+		std::uint32_t sequence;
+
+		do {
+			sequence = page->lock;
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+
+			std::uint32_t index = page->index;
+			if (!page->cap_user_rdpmc || index == 0)
+				return false;
+
+			unsigned shift = 64 - page->pmc_width;
+			std::int64_t counter = static_cast<std::int64_t>(static_cast<std::uint64_t>(__rdpmc(static_cast<int>(index - 1))) << shift) >> shift;
+			value = static_cast<std::uint64_t>(page->offset + counter);
+
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+		} while (page->lock != sequence);
+
+		return true;
+	}
+
+	bool readPages(std::uint64_t* out) const {
+		for (unsigned i = 0; i < Count; i++) {
+			if (fds[i] == -1) {
+				out[i] = 0;
+				continue;
+			}
+
+			if (!pages[i] || !readPage(pages[i], out[i]))
+				return false;
+		}
+
+		return true;
+	}
+#endif
+
+	void close() {
+#ifdef PROFILER_RDPMC_AVAILABLE
+		size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+		for (unsigned i = 0; i < Count; i++) {
+			if (pages[i])
+				munmap(pages[i], pageSize);
+			pages[i] = nullptr;
+		}
+#endif
+		userReadable = false;
+
+#ifdef PROFILER_PERF_AVAILABLE
+		for (unsigned i = 0; i < Count; i++) {
+			if (fds[i] != -1)
+				::close(fds[i]);
+			fds[i] = -1;
+		}
+#endif
+	}
+};
+
+class Profiler {
+public:
+	struct Zone {
+		const char* name;
+		Zone* parent;
+		std::vector<Zone*> children;
+
+		std::uint64_t calls = 0;
+		std::uint64_t ticks = 0;
+		std::uint64_t counters[PerfCounterGroup::Count] = {};
+
+		Zone(const char* name, Zone* parent) : name(name), parent(parent) {}
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+		~Zone() {
+			for (Zone* child : children)
+				delete child;
+		}
+	};
+
+	static Profiler& instance() {
+		static thread_local Profiler profiler;
+		return profiler;
+	}
+
+	Zone* enter(const char* name) {
+		for (Zone* child : current->children) {
+			if (child->name == name || std::strcmp(child->name, name) == 0) {
+				current = child;
+				return child;
+			}
+		}
+
+		Zone* created = new Zone(name, current);
+		current->children.push_back(created);
+		current = created;
+
+		return created;
+	}
+
+	void exit(Zone* zone, std::uint64_t elapsedTicks, const std::uint64_t* counterDeltas) {
+		zone->calls++;
+		zone->ticks += elapsedTicks;
+
+		for (unsigned i = 0; i < PerfCounterGroup::Count; i++)
+			zone->counters[i] += counterDeltas[i];
+
+		current = zone->parent;
+	}
+
+	const PerfCounterGroup& counters() const {
+		return perf;
+	}
+
+	// True if the zones accumulate hardware counters (see PROFILER_PERF_COUNTERS).
+	bool zoneCounters() const {
+		return perf.fastReadable();
+	}
+
+	// Deletes every zone. Refused (returns false) while a zone is open on this thread:
+	// its ScopedZone still points into the tree.
+	bool reset() {
+		if (current != &root)
+			return false;
+
+		for (Zone* child : root.children)
+			delete child;
+
+		root.children.clear();
+
+		startTicks = Clock::now();
+		startNanoseconds = Clock::steadyNanoseconds();
+
+		return true;
+	}
+
+	void dumpJson(std::ostream& out) const;
+
+private:
+	Zone root;
+	Zone* current;
+	PerfCounterGroup perf;
+
+	// Used to convert TSC ticks to nanoseconds.
+	std::uint64_t startTicks;
+	std::uint64_t startNanoseconds;
+
+	Profiler() : root("root", nullptr), current(&root) {
+		startTicks = Clock::now();
+		startNanoseconds = Clock::steadyNanoseconds();
+	}
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	double nanosecondsPerTick() const;
+
+	static void writeEscaped(std::ostream& out, const char* str);
+
+	void dumpZone(std::ostream& out, const Zone* zone, double nsPerTick, unsigned indent) const;
+};
+
+class ScopedZone {
+public:
+	explicit ScopedZone(const char* name) : owner(Profiler::instance()) {
+		zone = owner.enter(name);
+
+		if (owner.zoneCounters())
+			owner.counters().readFast(startCounters);
+
+		start = Clock::now();
+	}
+
+	ScopedZone(const ScopedZone&) = delete;
+	ScopedZone& operator=(const ScopedZone&) = delete;
+
+	~ScopedZone() {
+		std::uint64_t end = Clock::now();
+		std::uint64_t endCounters[PerfCounterGroup::Count] = {};
+
+		if (owner.zoneCounters()) {
+			owner.counters().readFast(endCounters);
+
+			for (unsigned i = 0; i < PerfCounterGroup::Count; i++)
+				endCounters[i] -= startCounters[i];
+		}
+
+		owner.exit(zone, end - start, endCounters);
+	}
+
+private:
+	Profiler& owner;
+	Profiler::Zone* zone;
+	std::uint64_t start;
+	std::uint64_t startCounters[PerfCounterGroup::Count] = {};
+};
+
+inline double Profiler::nanosecondsPerTick() const {
+#ifdef PROFILER_TSC_AVAILABLE
+	std::uint64_t ticks = Clock::now() - startTicks;
+	std::uint64_t ns = Clock::steadyNanoseconds() - startNanoseconds;
+
+	return ticks ? static_cast<double>(ns) / ticks : 0.0;
+#else
+	return 1.0;
+#endif
+}
+
+inline void Profiler::writeEscaped(std::ostream& out, const char* str) {
+	out << '"';
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			out << '\\';
+		out << *str;
+	}
+	out << '"';
+}
+
+inline void Profiler::dumpZone(std::ostream& out, const Zone* zone, double nsPerTick, unsigned indent) const {
+	std::string pad(indent, '\t');
+
+	double totalNs = zone->ticks * nsPerTick;
+
+	out << pad << "{\n";
+	out << pad << "\t\"name\": ";
+	writeEscaped(out, zone->name);
+	out << ",\n";
+	out << pad << "\t\"calls\": " << zone->calls << ",\n";
+	out << pad << "\t\"total_ns\": " << static_cast<std::uint64_t>(totalNs) << ",\n";
+	out << pad << "\t\"avg_ns\": " << (zone->calls ? totalNs / zone->calls : 0.0) << ",\n";
+
+	if (zoneCounters()) {
+		out << pad << "\t\"counters\": {";
+		for (unsigned i = 0; i < PerfCounterGroup::Count; i++) {
+			out << (i ? ", " : " ") << '"' << PerfCounterGroup::eventName(i) << "\": " << zone->counters[i];
+		}
+		out << " },\n";
+	}
+
+	out << pad << "\t\"children\": [";
+
+	for (size_t i = 0; i < zone->children.size(); i++) {
+		out << (i ? ",\n" : "\n");
+		dumpZone(out, zone->children[i], nsPerTick, indent + 2);
+	}
+
+	if (!zone->children.empty())
+		out << "\n" << pad << "\t";
+
+	out << "]\n" << pad << "}";
+}
+
+inline void Profiler::dumpJson(std::ostream& out) const {
+	double nsPerTick = nanosecondsPerTick();
+
+	out << "{\n";
+	out << "\t\"clock\": \"" <<
+#ifdef PROFILER_TSC_AVAILABLE
+		"tsc"
+#else
+		"steady_clock"
+#endif
+		<< "\",\n";
+	out << "\t\"perf_counters\": " << (zoneCounters() ? "true" : "false") << ",\n";
+	out << "\t\"zones\": [";
+
+	for (size_t i = 0; i < root.children.size(); i++) {
+		out << (i ? ",\n" : "\n");
+		dumpZone(out, root.children[i], nsPerTick, 2);
+	}
+
+	if (!root.children.empty())
+		out << "\n\t";
+
+	out << "]\n}" << std::endl;
+}
+
+} // namespace profiler
+
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name) ::profiler::ScopedZone PROFILER_CONCAT(profilerZone, __LINE__)(name)
+#endif
+
+#endif // !PROFILER_HEADER_
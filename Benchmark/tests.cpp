@@ -0,0 +1,132 @@
+#include "LatencyHistogram.h"
+#include "Profiler.h"
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include"../../doctest.h"
+#include<cstdint>
+#include<random>
+#include<sstream>
+#include<string>
+
+TEST_CASE("values below 2^subBucketBits are counted exactly") {
+	LatencyHistogram<> histogram;
+
+	for (std::uint64_t value = 0; value < 32; value++)
+		histogram.record(value);
+
+	CHECK(histogram.count() == 32);
+	CHECK(histogram.min() == 0);
+	CHECK(histogram.max() == 31);
+
+	// The (v + 1)-th smallest value is v itself.
+	for (std::uint64_t value = 0; value < 32; value++)
+		CHECK(histogram.percentile(100.0 * (value + 1) / 32) == value);
+
+	LatencyHistogram<3> narrow;
+	narrow.record(7, 3);
+	narrow.record(5);
+
+	CHECK(narrow.percentile(25) == 5);
+	CHECK(narrow.percentile(50) == 7);
+}
+
+TEST_CASE("values above 2^subBucketBits are within the relative error") {
+	std::mt19937_64 random(7);
+
+	for (int i = 0; i < 100000; i++) {
+		std::uint64_t value = 32 + random() % (1ull << (6 + i % 50));
+
+		// A bigger second value, so the bucket bound is not capped by max().
+		LatencyHistogram<> histogram;
+		histogram.record(value);
+		histogram.record(UINT64_MAX / 2);
+
+		std::uint64_t reported = histogram.percentile(50);
+
+		CHECK(reported >= value);
+		CHECK(reported - value <= value / 32);
+	}
+
+	// One bucket of width 16 holds both, the bound is capped at max().
+	LatencyHistogram<> histogram;
+	histogram.record(1000);
+	histogram.record(1001);
+	CHECK(histogram.percentile(50) == histogram.percentile(100));
+}
+
+TEST_CASE("percentile(100) is max()") {
+	std::mt19937_64 random(11);
+
+	for (int round = 0; round < 100; round++) {
+		LatencyHistogram<> histogram;
+		for (int i = 0; i < 1000; i++)
+			histogram.record(random() >> (random() % 64));
+
+		CHECK(histogram.percentile(100) == histogram.max());
+		CHECK(histogram.percentile(0) <= histogram.percentile(50));
+		CHECK(histogram.percentile(50) <= histogram.percentile(100));
+	}
+
+	LatencyHistogram<> empty;
+	CHECK(empty.percentile(100) == 0);
+	CHECK(empty.max() == 0);
+}
+
+// Position of the first "name": "zone" in the dump, npos if it is not there.
+size_t zonePosition(const std::string& json, const std::string& zone) {
+	return json.find("\"name\": \"" + zone + "\"");
+}
+
+TEST_CASE("profiler zones nest and are dumped once as JSON") {
+	profiler::Profiler& profiler = profiler::Profiler::instance();
+	REQUIRE(profiler.reset());
+
+	for (int i = 0; i < 3; i++) {
+		PROFILE_ZONE("outer");
+
+		for (int j = 0; j < 10; j++) {
+			PROFILE_ZONE("inner");
+		}
+
+		{
+			PROFILE_ZONE("other \"quoted\"");
+
+			// Open zones still point into the tree, so it is not cleared under them.
+			CHECK_FALSE(profiler.reset());
+		}
+	}
+
+	{
+		PROFILE_ZONE("inner");
+	}
+
+	std::ostringstream out;
+	profiler.dumpJson(out);
+	std::string json = out.str();
+
+	size_t outer = zonePosition(json, "outer");
+	size_t nested = zonePosition(json, "inner");
+	size_t quoted = json.find("\"name\": \"other \\\"quoted\\\"\"");
+
+	REQUIRE(outer != std::string::npos);
+	REQUIRE(nested != std::string::npos);
+	REQUIRE(quoted != std::string::npos);
+
+	// Children come after their parent; the top-level "inner" is a second zone of its own.
+	CHECK(outer < nested);
+	CHECK(nested < quoted);
+	size_t topLevel = json.find("\"name\": \"inner\"", quoted);
+	REQUIRE(topLevel != std::string::npos);
+
+	CHECK(json.find("\"calls\": 3,", outer) == json.find("\"calls\"", outer));
+	CHECK(json.find("\"calls\": 30,", nested) == json.find("\"calls\"", nested));
+	CHECK(json.find("\"calls\": 3,", quoted) == json.find("\"calls\"", quoted));
+	CHECK(json.find("\"calls\": 1,", topLevel) == json.find("\"calls\"", topLevel));
+	CHECK(json.front() == '{');
+	CHECK(json.find("\"zones\": [") != std::string::npos);
+
+	CHECK(profiler.reset());
+
+	std::ostringstream empty;
+	profiler.dumpJson(empty);
+	CHECK(zonePosition(empty.str(), "outer") == std::string::npos);
+}
@@ -0,0 +1,70 @@
+/*
+* Sorting of insert batches for AVLTree::insertBatch and SkipList::insertBatch.
+*
+* Batches are sorted with a merge sort whose halves run on separate threads
+* (std::async, like the set operations of AVLTree) until every hardware thread
+* has a part. Parts below parallelCutoff elements are sorted in place with std::sort,
+* where a thread would cost more than it saves.
+*/
+
+#ifndef BATCH_SORT_HEADER_
+#define BATCH_SORT_HEADER_
+#include<algorithm>
+#include<cstddef>
+#include<future>
+#include<iterator>
+#include<thread>
+#include<vector>
+
+namespace BatchSort {
+	const size_t parallelCutoff = 1 << 14;
+
+	template<class Iterator>
+	void sortRange(Iterator first, Iterator last, int forkDepth) {
+		size_t count = static_cast<size_t>(last - first);
+
+		if (forkDepth <= 0 || count < 2 * parallelCutoff) {
+			std::sort(first, last);
+			return;
+		}
+
+		Iterator middle = first + count / 2;
+
+		std::future<void> pending = std::async(std::launch::async, [=]() { sortRange(first, middle, forkDepth - 1); });
+		sortRange(middle, last, forkDepth - 1);
+		pending.get();
+
+		std::inplace_merge(first, middle, last);
+	}
+
+	// Enough levels of forking to give every hardware thread a part.
+	inline int forkDepth() {
+		unsigned threads = std::thread::hardware_concurrency();
+		int depth = 0;
+
+		while ((1u << depth) < threads)
+			++depth;
+
+		return depth;
+	}
+
+	// The elements of batch in ascending order, repeated ones included.
+	template<class T, class Range>
+	std::vector<T> sorted(const Range& batch) {
+		std::vector<T> result(std::begin(batch), std::end(batch));
+		sortRange(result.begin(), result.end(), forkDepth());
+
+		return result;
+	}
+
+	// The elements of batch in ascending order, each once.
+	template<class T, class Range>
+	std::vector<T> sortedUnique(const Range& batch) {
+		std::vector<T> result = sorted<T>(batch);
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+
+		return result;
+	}
+}
+
+#endif // !BATCH_SORT_HEADER_
@@ -0,0 +1,156 @@
+/*
+* Blocked Bloom filter.
+*
+* Every key maps to a single 64-byte block (one cache line) and sets all of its bits inside it,
+* so a lookup costs one cache miss no matter how many hash functions we use.
+* The price is a slightly higher false positive rate than a classic Bloom filter of the same size.
+*
+* The filter is sized from the expected number of keys n and the target false positive rate p:
+* m = -n ln(p) / ln(2)^2 bits and k = m / n * ln(2) bits per key.
+*
+* There are no false negatives, so removing keys from the owner only makes the filter less useful.
+* The owners rebuild it when enough keys were removed or when it is over capacity.
+*
+* The owners hold an OptionalBloomFilter<T>: the filter itself when std::hash<T> exists,
+* otherwise NoBloomFilter<T>, which does nothing. So a key type needs only its comparisons
+* until someone calls enableBloomFilter on it.
+*/
+
+#ifndef BLOOM_FILTER_HEADER_
+#define BLOOM_FILTER_HEADER_
+#include<cmath>
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+template<class T, class Hash = std::hash<T>>
+class BloomFilter {
+private:
+	static const unsigned bitsPerBlock = 512;
+	static const unsigned maxHashes = 16;
+
+	struct alignas(64) Block {
+		std::uint64_t words[bitsPerBlock / 64];
+	};
+
+	std::vector<Block> blocks;
+	unsigned hashes;
+	size_t expectedElements;
+	double targetRate;
+	size_t added;
+
+	// std::hash is the identity for integers, so we mix the bits before using them.
+	static std::uint64_t mix(std::uint64_t x) {
+		x += 0x9e3779b97f4a7c15ull;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+	size_t blockIndex(std::uint64_t hash) const {
+		return static_cast<size_t>(((hash >> 32) * blocks.size()) >> 32);
+	}
+
+	// k positions inside the block by double hashing: h1 + i * h2.
+	template<class Visit>
+	void forEachBit(std::uint64_t hash, Visit visit) const {
+		std::uint32_t h1 = static_cast<std::uint32_t>(hash);
+		std::uint32_t h2 = static_cast<std::uint32_t>(mix(hash) >> 32) | 1;
+
+		for (unsigned i = 0; i < hashes; i++) {
+			unsigned bit = (h1 + i * h2) % bitsPerBlock;
+			visit(bit / 64, 1ull << (bit % 64));
+		}
+	}
+
+public:
+	BloomFilter(size_t expectedElements, double falsePositiveRate) : expectedElements(expectedElements ? expectedElements : 1), targetRate(falsePositiveRate), added(0) {
+		const double ln2 = std::log(2.0);
+
+		double bits = -static_cast<double>(this->expectedElements) * std::log(targetRate) / (ln2 * ln2);
+		size_t blockCount = static_cast<size_t>(std::ceil(bits / bitsPerBlock));
+
+		blocks.resize(blockCount ? blockCount : 1);
+
+		double perKey = static_cast<double>(blocks.size()) * bitsPerBlock / this->expectedElements;
+		hashes = static_cast<unsigned>(std::lround(perKey * ln2));
+
+		if (hashes < 1)
+			hashes = 1;
+		if (hashes > maxHashes)
+			hashes = maxHashes;
+
+		clear();
+	}
+
+	void add(const T& elem) {
+		std::uint64_t hash = mix(Hash()(elem));
+		Block& block = blocks[blockIndex(hash)];
+
+		forEachBit(hash, [&](unsigned word, std::uint64_t mask) { block.words[word] |= mask; });
+
+		++added;
+	}
+
+	bool mayContain(const T& elem) const {
+		std::uint64_t hash = mix(Hash()(elem));
+		const Block& block = blocks[blockIndex(hash)];
+
+		bool all = true;
+		forEachBit(hash, [&](unsigned word, std::uint64_t mask) { all &= (block.words[word] & mask) != 0; });
+
+		return all;
+	}
+
+	void clear() {
+		for (Block& block : blocks)
+			for (std::uint64_t& word : block.words)
+				word = 0;
+
+		added = 0;
+	}
+
+	size_t capacity() const { return expectedElements; }
+
+	size_t addedCount() const { return added; }
+
+	double falsePositiveRate() const { return targetRate; }
+
+	size_t memoryUsage() const { return blocks.size() * sizeof(Block); }
+};
+
+// Stands in for the filter of a key type without std::hash. The owners never create one:
+// their enableBloomFilter static_asserts on IsHashable<T>.
+template<class T>
+class NoBloomFilter {
+public:
+	NoBloomFilter(size_t, double) {}
+
+	void add(const T&) {}
+
+	bool mayContain(const T&) const { return true; }
+
+	void clear() {}
+
+	size_t capacity() const { return 0; }
+
+	size_t addedCount() const { return 0; }
+
+	double falsePositiveRate() const { return 1.0; }
+
+	size_t memoryUsage() const { return 0; }
+};
+
+template<class T, class = void>
+struct IsHashable : std::false_type {};
+
+template<class T>
+struct IsHashable<T, std::void_t<decltype(std::hash<T>()(std::declval<const T&>()))>> : std::true_type {};
+
+template<class T>
+using OptionalBloomFilter = typename std::conditional<IsHashable<T>::value, BloomFilter<T>, NoBloomFilter<T>>::type;
+
+#endif // !BLOOM_FILTER_HEADER_
@@ -0,0 +1,34 @@
+/*
+* Element of the counted multisets: a key and the number of times it was inserted.
+*
+* Compared by key only, so the engines keep one node per distinct key.
+* The count is not part of the order, so the adapters bump it in place
+* through the engines' update.
+*/
+
+#ifndef COUNTED_ENTRY_HEADER_
+#define COUNTED_ENTRY_HEADER_
+#include<cstddef>
+
+template<class K>
+struct CountedEntry {
+	K key;
+	size_t count;
+
+	CountedEntry(const K& key, size_t count) : key(key), count(count) {}
+
+	bool operator==(const CountedEntry& other) const { return key == other.key; }
+
+	bool operator<(const CountedEntry& other) const { return key < other.key; }
+
+	bool operator>(const CountedEntry& other) const { return other.key < key; }
+
+	// Heterogeneous comparisons, so the engines can find an entry by its key alone.
+	friend bool operator==(const CountedEntry& entry, const K& key) { return entry.key == key; }
+
+	friend bool operator<(const CountedEntry& entry, const K& key) { return entry.key < key; }
+
+	friend bool operator<(const K& key, const CountedEntry& entry) { return key < entry.key; }
+};
+
+#endif // !COUNTED_ENTRY_HEADER_
@@ -0,0 +1,134 @@
+/*
+* Immutable sorted set in Eytzinger (BFS) order.
+*
+* The keys are laid out like a binary heap: the children of position k are 2k and 2k+1
+* (position 0 is unused). A search is the same walk as in a perfectly balanced tree,
+* but without pointers, and the next level is chosen with arithmetic instead of a branch:
+*
+*	k = 2 * k + (tree[k] < elem)
+*
+* so there are no mispredictions. The 2^d descendants of k on the level d steps below
+* are contiguous (positions k * 2^d ... k * 2^d + 2^d - 1), so one prefetch pulls in
+* the node we visit d steps later while we are still comparing here.
+*
+* The last turn to the left is the lower bound: it is found by dropping the trailing
+* right turns (the trailing 1 bits of k) and one more bit.
+*
+* Built from AVLTree::freeze() or SkipList::freeze(), turned back with their thaw().
+*/
+
+#ifndef FROZEN_SET_HEADER_
+#define FROZEN_SET_HEADER_
+#include<algorithm>
+#include<cstddef>
+#include<cstdint>
+#include<utility>
+#include<vector>
+
+template<class T>
+class FrozenSet {
+private:
+	// tree[0] is a copy of the first key that only pads the array, so it can be 1-indexed.
+	std::vector<T> tree;
+	size_t count;
+
+	// Number of keys in a cache line, rounded down to a power of two.
+	static constexpr size_t keysPerLine() {
+		size_t keys = 1;
+		while (keys * 2 * sizeof(T) <= 64)
+			keys *= 2;
+
+		return keys;
+	}
+
+	size_t fill(const std::vector<T>& sorted, size_t next, size_t k) {
+		if (k <= count) {
+			next = fill(sorted, next, 2 * k);
+			tree[k] = sorted[next++];
+			next = fill(sorted, next, 2 * k + 1);
+		}
+
+		return next;
+	}
+
+	void collect(std::vector<T>& out, size_t k) const {
+		if (k <= count) {
+			collect(out, 2 * k);
+			out.push_back(tree[k]);
+			collect(out, 2 * k + 1);
+		}
+	}
+
+	static size_t dropRightTurns(size_t k) {
+#if defined(__GNUC__) || defined(__clang__)
+		return k >> __builtin_ffsll(static_cast<long long>(~k));
+#else
+		while (k & 1)
+			k >>= 1;
+		return k >> 1;
+#endif
+	}
+
+	// Position of the first key >= elem, 0 if there is none.
+	size_t lowerBoundPosition(const T& elem) const {
+		const T* keys = tree.data();
+		size_t k = 1;
+
+		while (k <= count) {
+			// The descendants of k that fill one cache line, log2(keysPerLine()) levels below.
+			size_t ahead = k * keysPerLine();
+			if (ahead <= count) {
+#if defined(__GNUC__) || defined(__clang__)
+				__builtin_prefetch(keys + ahead);
+#endif
+			}
+
+			k = 2 * k + (keys[k] < elem);
+		}
+
+		return dropRightTurns(k);
+	}
+
+	explicit FrozenSet(std::vector<T>&& sorted) : count(sorted.size()) {
+		if (count == 0)
+			return;
+
+		tree.assign(count + 1, sorted[0]);
+		fill(sorted, 0, 1);
+	}
+
+public:
+	FrozenSet() : count(0) {}
+
+	// sorted must be in ascending order. Repeated keys are kept once.
+	static FrozenSet fromSorted(std::vector<T> sorted) {
+		sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+		return FrozenSet(std::move(sorted));
+	}
+
+	bool contains(const T& elem) const {
+		size_t k = lowerBoundPosition(elem);
+		return k != 0 && tree[k] == elem;
+	}
+
+	// The smallest key >= elem, nullptr if every key is smaller.
+	const T* lowerBound(const T& elem) const {
+		size_t k = lowerBoundPosition(elem);
+		return k != 0 ? &tree[k] : nullptr;
+	}
+
+	// The keys in ascending order.
+	std::vector<T> toSorted() const {
+		std::vector<T> result;
+		result.reserve(count);
+		collect(result, 1);
+
+		return result;
+	}
+
+	size_t size() const { return count; }
+
+	bool empty() const { return count == 0; }
+};
+
+#endif // !FROZEN_SET_HEADER_
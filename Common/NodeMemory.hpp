@@ -0,0 +1,278 @@
+/*
+* Optional huge-page backed memory for the nodes of AVLTree and SkipList.
+*
+* A search over millions of nodes touches a different 4 KB page at almost every step,
+* so it misses the dTLB as well as the cache. HugePageResource reserves one range of address
+* space, aligned to 2 MB, and asks for transparent huge pages on it with madvise(MADV_HUGEPAGE),
+* so one TLB entry covers 512 times more nodes. Node sizes are rounded to 16 bytes and served
+* from the range by a bump pointer; freed blocks go to a free list per size and are reused.
+*
+* The memory is mapped with MAP_NORESERVE and only backed once it is touched, so a big
+* reservation costs address space, not RAM. When THP is unavailable (the madvise fails) the
+* range is still used, with normal pages, and hugePages() is false. When the mmap itself fails,
+* or off Linux, available() is false and every allocation goes to operator new.
+*
+* Nodes allocate through NodeMemory. Nothing changes until a resource is installed:
+*
+*	HugePageResource resource;
+*	{
+*		NodeMemory::Scope scope(resource);
+*		for (int x : keys)
+*			tree.push(x);				// nodes from the huge-page range
+*	}
+*	tree.push(0);						// operator new again
+*
+* The installed resource is global, not per thread, so the workers of a ShardedOrderedSet
+* use it too. A node is freed into the resource it came from whether it is installed or not,
+* so the resource must outlive every structure that has nodes in it.
+*/
+
+#ifndef NODE_MEMORY_HEADER_
+#define NODE_MEMORY_HEADER_
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<mutex>
+#include<new>
+#include<vector>
+
+#if defined(__linux__)
+#include<sys/mman.h>
+#define NODE_MEMORY_MMAP_AVAILABLE
+#endif
+
+class HugePageResource {
+public:
+	static const size_t hugePageSize = size_t(1) << 21;
+
+	// Blocks bigger than this are not worth a size class and go to operator new.
+	static const size_t maxBlockSize = 512;
+
+	static const size_t granularity = 16;
+
+private:
+	// The whole mmap, and the 2 MB aligned range inside it that blocks come from.
+	char* mapping;
+	size_t mappingSize;
+	char* begin;
+	char* end;
+	char* next;
+	bool huge;
+
+	std::mutex lock;
+	std::vector<void*> freeBlocks[maxBlockSize / granularity];
+
+	static size_t classOf(size_t bytes) {
+		return (bytes + granularity - 1) / granularity - 1;
+	}
+
+	static char* alignUp(char* address, size_t alignment) {
+		std::uintptr_t value = reinterpret_cast<std::uintptr_t>(address);
+		return reinterpret_cast<char*>((value + alignment - 1) & ~(alignment - 1));
+	}
+
+public:
+	// Reserves capacity bytes of address space (4 GB by default).
+	explicit HugePageResource(size_t capacity = size_t(1) << 32);
+
+	HugePageResource(const HugePageResource&) = delete;
+	HugePageResource& operator=(const HugePageResource&) = delete;
+
+	bool available() const {
+		return begin != nullptr;
+	}
+
+	// True if the kernel accepted MADV_HUGEPAGE for the range.
+	bool hugePages() const {
+		return huge;
+	}
+
+	bool owns(const void* block) const {
+		return begin <= static_cast<const char*>(block) && static_cast<const char*>(block) < end;
+	}
+
+	// nullptr if the block does not fit in a size class or the range is used up.
+	void* allocate(size_t bytes);
+
+	void deallocate(void* block, size_t bytes);
+
+	// Bytes handed out from the range so far, freed blocks included.
+	size_t used() const {
+		return static_cast<size_t>(next - begin);
+	}
+
+	~HugePageResource();
+};
+
+class NodeMemory {
+private:
+	static const unsigned maxResources = 16;
+
+	static std::atomic<HugePageResource*>& installed() {
+		static std::atomic<HugePageResource*> resource(nullptr);
+		return resource;
+	}
+
+	// Every live resource, so a node can be freed into its own after the scope ended.
+	static std::atomic<HugePageResource*>* registered() {
+		static std::atomic<HugePageResource*> resources[maxResources] = {};
+		return resources;
+	}
+
+	static std::atomic<unsigned>& registeredCount() {
+		static std::atomic<unsigned> count(0);
+		return count;
+	}
+
+	friend class HugePageResource;
+
+	// False if maxResources are alive already.
+	static bool enroll(HugePageResource* resource) {
+		for (unsigned i = 0; i < maxResources; i++) {
+			HugePageResource* empty = nullptr;
+
+			if (registered()[i].compare_exchange_strong(empty, resource)) {
+				++registeredCount();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static void withdraw(HugePageResource* resource) {
+		for (unsigned i = 0; i < maxResources; i++) {
+			HugePageResource* expected = resource;
+
+			if (registered()[i].compare_exchange_strong(expected, nullptr)) {
+				--registeredCount();
+				return;
+			}
+		}
+	}
+
+public:
+	// Installs resource for the lifetime of the scope and puts back the previous one after it.
+	class Scope {
+	private:
+		HugePageResource* previous;
+
+	public:
+		explicit Scope(HugePageResource& resource) : previous(installed().exchange(&resource)) {}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		~Scope() {
+			installed().store(previous);
+		}
+	};
+
+	static HugePageResource* current() {
+		return installed().load(std::memory_order_relaxed);
+	}
+
+	static void* allocate(size_t bytes) {
+		HugePageResource* resource = current();
+
+		if (resource) {
+			void* block = resource->allocate(bytes);
+			if (block)
+				return block;
+		}
+
+		return ::operator new(bytes);
+	}
+
+	static void deallocate(void* block, size_t bytes) {
+		if (!block)
+			return;
+
+		if (registeredCount().load(std::memory_order_relaxed) != 0) {
+			for (unsigned i = 0; i < maxResources; i++) {
+				HugePageResource* resource = registered()[i].load(std::memory_order_relaxed);
+
+				if (resource && resource->owns(block)) {
+					resource->deallocate(block, bytes);
+					return;
+				}
+			}
+		}
+
+		::operator delete(block);
+	}
+};
+
+inline HugePageResource::HugePageResource(size_t capacity) : mapping(nullptr), mappingSize(0), begin(nullptr), end(nullptr), next(nullptr), huge(false) {
+#ifdef NODE_MEMORY_MMAP_AVAILABLE
+	// One extra huge page, so the range can start on a 2 MB boundary.
+	mappingSize = capacity + hugePageSize;
+	void* mapped = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (mapped == MAP_FAILED) {
+		mappingSize = 0;
+		return;
+	}
+
+	mapping = static_cast<char*>(mapped);
+
+	if (!NodeMemory::enroll(this)) {
+		munmap(mapping, mappingSize);
+		mapping = nullptr;
+		mappingSize = 0;
+		return;
+	}
+
+	begin = alignUp(mapping, hugePageSize);
+	end = begin + capacity;
+	next = begin;
+
+#ifdef MADV_HUGEPAGE
+	huge = madvise(begin, capacity, MADV_HUGEPAGE) == 0;
+#endif
+#else
+	(void)capacity;
+#endif
+}
+
+inline void* HugePageResource::allocate(size_t bytes) {
+	if (!available() || bytes == 0 || bytes > maxBlockSize)
+		return nullptr;
+
+	size_t sizeClass = classOf(bytes);
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (!freeBlocks[sizeClass].empty()) {
+		void* block = freeBlocks[sizeClass].back();
+		freeBlocks[sizeClass].pop_back();
+		return block;
+	}
+
+	size_t rounded = (sizeClass + 1) * granularity;
+	if (static_cast<size_t>(end - next) < rounded)
+		return nullptr;
+
+	void* block = next;
+	next += rounded;
+
+	return block;
+}
+
+inline void HugePageResource::deallocate(void* block, size_t bytes) {
+	std::lock_guard<std::mutex> guard(lock);
+	freeBlocks[classOf(bytes)].push_back(block);
+}
+
+inline HugePageResource::~HugePageResource() {
+	if (NodeMemory::current() == this)
+		NodeMemory::installed().store(nullptr);
+
+#ifdef NODE_MEMORY_MMAP_AVAILABLE
+	if (mapping) {
+		NodeMemory::withdraw(this);
+		munmap(mapping, mappingSize);
+	}
+#endif
+}
+
+#endif // !NODE_MEMORY_HEADER_
@@ -0,0 +1,67 @@
+/*
+* One interface over the ordered-set engines, for code that should work with any of them
+* (the benchmark harness, ShardedOrderedSet).
+*
+* The engines grew different APIs: push / exists / removeElement returning an int code on the
+* trees, insert / containsElement / removeElement returning bool on the lists. OrderedSetTraits<Engine>
+* maps them to the same static functions:
+*
+*	insert(engine, elem)	true if elem was stored. Engines with uniqueKeys == false store repeats too.
+*	contains(engine, elem)
+*	remove(engine, elem)	true if an elem was removed.
+*	size(engine)
+*
+* Iteration is the engine's own begin() / end(), which all of them have, in ascending order.
+*
+* Each engine specializes OrderedSetTraits at the end of its own header, so this one includes
+* none of them. A new engine joins the same way. OrderedSetEngine checks the result:
+* it is a concept when compiled as C++20, and isOrderedSet<Engine> is a bool in either standard.
+*/
+
+#ifndef ORDERED_SET_HEADER_
+#define ORDERED_SET_HEADER_
+#include<cstddef>
+#include<type_traits>
+#include<utility>
+
+#if defined(__cpp_concepts) && __cpp_concepts >= 201907L
+#include<concepts>
+#endif
+
+template<class Engine>
+struct OrderedSetTraits;
+
+// Only checks that the traits exist and that the engine can be iterated, enough for C++17 code to static_assert on.
+template<class Engine, class = void>
+struct HasOrderedSetTraits : std::false_type {};
+
+template<class Engine>
+struct HasOrderedSetTraits<Engine, std::void_t<
+	typename OrderedSetTraits<Engine>::ValueType,
+	decltype(std::declval<const Engine&>().begin() != std::declval<const Engine&>().end())>> : std::true_type {};
+
+#if defined(__cpp_concepts) && __cpp_concepts >= 201907L
+
+template<class Engine>
+concept OrderedSetEngine = HasOrderedSetTraits<Engine>::value &&
+	std::default_initializable<Engine> &&
+	requires(Engine& engine, const Engine& constEngine, const typename OrderedSetTraits<Engine>::ValueType& elem) {
+		{ OrderedSetTraits<Engine>::uniqueKeys } -> std::convertible_to<bool>;
+		{ OrderedSetTraits<Engine>::insert(engine, elem) } -> std::same_as<bool>;
+		{ OrderedSetTraits<Engine>::contains(constEngine, elem) } -> std::same_as<bool>;
+		{ OrderedSetTraits<Engine>::remove(engine, elem) } -> std::same_as<bool>;
+		{ OrderedSetTraits<Engine>::size(constEngine) } -> std::same_as<size_t>;
+		{ *constEngine.begin() } -> std::convertible_to<const typename OrderedSetTraits<Engine>::ValueType&>;
+	};
+
+template<class Engine>
+constexpr bool isOrderedSet = OrderedSetEngine<Engine>;
+
+#else
+
+template<class Engine>
+constexpr bool isOrderedSet = HasOrderedSetTraits<Engine>::value && std::is_default_constructible<Engine>::value;
+
+#endif
+
+#endif // !ORDERED_SET_HEADER_
@@ -0,0 +1,104 @@
+/*
+* Shape of a live structure, as returned by AVLTree::analyze() and SkipList::analyze().
+*
+* Both are filled by one iterative pass (no recursion on the depth or the length),
+* so they work on structures of millions of elements. writeJson prints one JSON object,
+* for benchmark reports and scripts:
+*
+*	{"engine":"avl","nodes":7,"depthHistogram":[1,2,4],"averagePathLength":2.42857,...}
+*/
+
+#ifndef SHAPE_REPORT_HEADER_
+#define SHAPE_REPORT_HEADER_
+#include<cstddef>
+#include<map>
+#include<ostream>
+#include<sstream>
+#include<string>
+#include<vector>
+
+namespace ShapeJson {
+	template<class Number>
+	void writeArray(std::ostream& out, const std::vector<Number>& values) {
+		out << "[";
+		for (size_t i = 0; i < values.size(); i++)
+			out << (i ? "," : "") << values[i];
+		out << "]";
+	}
+}
+
+struct TreeShape {
+	size_t nodes = 0;
+
+	// Element d is the number of nodes at depth d, the root is at depth 0.
+	std::vector<size_t> depthHistogram;
+
+	// A successful search for a node at depth d compares with d + 1 nodes.
+	double averagePathLength = 0;
+	size_t maxPathLength = 0;
+
+	// Height of the right subtree minus height of the left one -> number of nodes.
+	// With WAVLBalance the heights are ranks, so this is the difference of the children's ranks.
+	std::map<int, size_t> balanceFactors;
+
+	void writeJson(std::ostream& out) const {
+		out << "{\"engine\":\"avl\",\"nodes\":" << nodes;
+		out << ",\"depthHistogram\":";
+		ShapeJson::writeArray(out, depthHistogram);
+		out << ",\"averagePathLength\":" << averagePathLength;
+		out << ",\"maxPathLength\":" << maxPathLength;
+		out << ",\"balanceFactors\":{";
+
+		bool first = true;
+		for (const auto& factor : balanceFactors) {
+			out << (first ? "" : ",") << "\"" << factor.first << "\":" << factor.second;
+			first = false;
+		}
+
+		out << "}}";
+	}
+
+	std::string toJson() const {
+		std::ostringstream out;
+		writeJson(out);
+		return out.str();
+	}
+};
+
+struct ListShape {
+	size_t elements = 0;
+	size_t tombstones = 0;
+
+	// Element i is the number of nodes with exactly i + 1 levels. Tombstones included.
+	std::vector<size_t> towerHistogram;
+
+	// Element i is the average number of forward moves on level i (level 0 at the bottom)
+	// of a search for a live element, counted exactly over all of them.
+	std::vector<double> averageHopsPerLevel;
+
+	// In steps (forward moves plus moves down), averaged over the live elements.
+	double actualSearchCost = 0;
+
+	// Pugh's bound for the same list: log_{1/p}(n) / p + 1 / (1 - p).
+	double expectedSearchCost = 0;
+
+	void writeJson(std::ostream& out) const {
+		out << "{\"engine\":\"skiplist\",\"elements\":" << elements;
+		out << ",\"tombstones\":" << tombstones;
+		out << ",\"towerHistogram\":";
+		ShapeJson::writeArray(out, towerHistogram);
+		out << ",\"averageHopsPerLevel\":";
+		ShapeJson::writeArray(out, averageHopsPerLevel);
+		out << ",\"actualSearchCost\":" << actualSearchCost;
+		out << ",\"expectedSearchCost\":" << expectedSearchCost;
+		out << "}";
+	}
+
+	std::string toJson() const {
+		std::ostringstream out;
+		writeJson(out);
+		return out.str();
+	}
+};
+
+#endif // !SHAPE_REPORT_HEADER_
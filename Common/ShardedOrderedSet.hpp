@@ -0,0 +1,468 @@
+/*
+* Ordered set split by key range into shards, so several threads can use it at once.
+*
+* Shard i holds the keys in [bounds[i - 1], bounds[i]) and has its own spin lock,
+* so operations on different shards never wait for each other. The bounds come from
+* a sample of the expected keys (quantiles) and are recomputed online: when a shard
+* grows past 1.5 times its fair share, all keys are redistributed evenly in O(n),
+* which a shard has to gain n / (2 * shards) keys to trigger again.
+*
+* The layout (bounds and shards) is guarded by a shared mutex. Operations take it shared,
+* the redistribution takes it exclusive. The batch operations take it once per batch,
+* sort or group the keys by shard and run one task per shard on a work-stealing ThreadPool.
+*
+* Every key is kept once, whatever the engine. Iteration visits the shards in key order,
+* which is the sorted order of the whole set since the shards do not overlap.
+*
+* Engine is any engine with OrderedSetTraits. AVLTree loads a shard with insertSortedBatch
+* and SkipList with a finger, the others one key at a time (see ShardTraits). Neither forks:
+* a shard task already runs on a pool thread, and forking there would oversubscribe the machine.
+*/
+
+#ifndef SHARDED_ORDERED_SET_HEADER_
+#define SHARDED_ORDERED_SET_HEADER_
+#include<algorithm>
+#include<atomic>
+#include<cstddef>
+#include<memory>
+#include<mutex>
+#include<shared_mutex>
+#include<thread>
+#include<vector>
+#include"BatchSort.hpp"
+#include"OrderedSet.hpp"
+#include"ThreadPool.hpp"
+#include"../AVL/AVLTree.hpp"
+#include"../SkipList/SkipList.hpp"
+
+// Test-and-test-and-set lock. The critical sections are single tree or list operations,
+// shorter than putting a thread to sleep.
+class SpinLock {
+private:
+	std::atomic<bool> locked;
+
+public:
+	SpinLock() : locked(false) {}
+
+	void lock() {
+		while (locked.exchange(true, std::memory_order_acquire)) {
+			while (locked.load(std::memory_order_relaxed))
+				std::this_thread::yield();
+		}
+	}
+
+	void unlock() {
+		locked.store(false, std::memory_order_release);
+	}
+};
+
+// OrderedSetTraits with set semantics, plus the bulk insert of a shard.
+// Engines without a batch insert go one key at a time.
+template<class Engine>
+struct ShardTraits : OrderedSetTraits<Engine> {
+	using Base = OrderedSetTraits<Engine>;
+	using ValueType = typename Base::ValueType;
+
+	static bool insert(Engine& engine, const ValueType& elem) {
+		if (!Base::uniqueKeys && Base::contains(engine, elem))
+			return false;
+
+		return Base::insert(engine, elem);
+	}
+
+	// sorted is in ascending order without repeated keys. Returns how many were new.
+	static size_t insertSorted(Engine& engine, const std::vector<ValueType>& sorted) {
+		size_t added = 0;
+
+		for (const ValueType& elem : sorted) {
+			if (insert(engine, elem))
+				++added;
+		}
+
+		return added;
+	}
+};
+
+template<class T, class Balance>
+struct ShardTraits<AVLTree<T, Balance>> : OrderedSetTraits<AVLTree<T, Balance>> {
+	static size_t insertSorted(AVLTree<T, Balance>& engine, const std::vector<T>& sorted) {
+		return static_cast<size_t>(engine.insertSortedBatch(sorted));
+	}
+};
+
+template<class T, unsigned maxLevel, class Promotion>
+struct ShardTraits<SkipList<T, maxLevel, Promotion>> : OrderedSetTraits<SkipList<T, maxLevel, Promotion>> {
+	using Engine = SkipList<T, maxLevel, Promotion>;
+
+	static bool insert(Engine& engine, const T& elem) {
+		if (engine.containsElement(elem))
+			return false;
+
+		engine.insert(elem);
+		return true;
+	}
+
+	// The keys are sorted already, so a finger links each one in O(log d) like insertBatch,
+	// without its sort.
+	static size_t insertSorted(Engine& engine, const std::vector<T>& sorted) {
+		typename Engine::Finger finger = engine.finger();
+		size_t added = 0;
+
+		for (const T& elem : sorted) {
+			if (!engine.containsElement(elem, finger)) {
+				engine.insert(elem, finger);
+				++added;
+			}
+		}
+
+		return added;
+	}
+};
+
+template<class Engine>
+class ShardedOrderedSet {
+private:
+	using Traits = ShardTraits<Engine>;
+	using T = typename Traits::ValueType;
+
+	// Shards smaller than this are never worth a redistribution.
+	static const size_t minRebalanceSize = 1 << 12;
+
+	struct alignas(64) Shard {
+		SpinLock lock;
+		Engine engine;
+		size_t count = 0;
+	};
+
+	std::vector<std::unique_ptr<Shard>> shards;
+	std::vector<T> bounds;
+	size_t targetShards;
+
+	mutable std::shared_mutex layoutLock;
+	mutable ThreadPool pool;
+	std::atomic<size_t> total;
+
+	size_t shardOf(const T& elem) const {
+		return static_cast<size_t>(std::upper_bound(bounds.begin(), bounds.end(), elem) - bounds.begin());
+	}
+
+	bool overloaded(size_t count) const {
+		return count > minRebalanceSize && 2 * count * targetShards > 3 * total.load();
+	}
+
+	// Splits the sorted keys at the bounds: keys [from[i], from[i + 1]) go to shard i.
+	std::vector<size_t> splitSorted(const std::vector<T>& sorted) const;
+
+	// Key indices grouped by shard.
+	std::vector<std::vector<size_t>> groupByShard(const std::vector<T>& keys) const;
+
+	void rebalanceIfOverloaded();
+
+	void redistribute();
+
+public:
+	// shardCount = 0 uses one shard per hardware thread, threads = 0 one pool worker per hardware thread.
+	// sample is a sample of the expected keys. Without one all keys start in one shard
+	// and are spread once there are enough of them.
+	explicit ShardedOrderedSet(size_t shardCount = 0, size_t threads = 0, const std::vector<T>& sample = std::vector<T>());
+
+	ShardedOrderedSet(const ShardedOrderedSet&) = delete;
+	ShardedOrderedSet& operator=(const ShardedOrderedSet&) = delete;
+
+	// True if elem was not in the set.
+	bool insert(const T& elem);
+
+	bool contains(const T& elem) const;
+
+	// True if elem was in the set.
+	bool remove(const T& elem);
+
+	// Returns how many keys of batch were new.
+	template<class Range>
+	size_t insertBatch(const Range& batch);
+
+	// found[i] != 0 if keys[i] is in the set.
+	std::vector<char> containsBatch(const std::vector<T>& keys) const;
+
+	// Returns how many keys of batch were in the set.
+	size_t removeBatch(const std::vector<T>& keys);
+
+	// Visits every key in ascending order. The set must not be modified from visit.
+	template<class Visit>
+	void forEach(Visit visit) const;
+
+	std::vector<T> toSorted() const;
+
+	size_t size() const {
+		return total.load();
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+
+	size_t shardsCount() const {
+		std::shared_lock<std::shared_mutex> layout(layoutLock);
+		return shards.size();
+	}
+
+	// Keys in every shard, in key order. Shows how even the last redistribution left them.
+	std::vector<size_t> shardSizes() const;
+};
+
+template<class Engine>
+ShardedOrderedSet<Engine>::ShardedOrderedSet(size_t shardCount, size_t threads, const std::vector<T>& sample) : pool(threads), total(0) {
+	if (shardCount == 0)
+		shardCount = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+
+	targetShards = shardCount;
+
+	std::vector<T> keys = BatchSort::sortedUnique<T>(sample);
+	size_t used = std::min(shardCount, std::max<size_t>(keys.size(), 1));
+
+	for (size_t i = 1; i < used; i++)
+		bounds.push_back(keys[i * keys.size() / used]);
+
+	for (size_t i = 0; i < used; i++)
+		shards.emplace_back(new Shard());
+}
+
+template<class Engine>
+std::vector<size_t> ShardedOrderedSet<Engine>::splitSorted(const std::vector<T>& sorted) const {
+	std::vector<size_t> from(shards.size() + 1);
+
+	from[0] = 0;
+	for (size_t i = 0; i < bounds.size(); i++)
+		from[i + 1] = static_cast<size_t>(std::lower_bound(sorted.begin() + from[i], sorted.end(), bounds[i]) - sorted.begin());
+	from[shards.size()] = sorted.size();
+
+	return from;
+}
+
+template<class Engine>
+std::vector<std::vector<size_t>> ShardedOrderedSet<Engine>::groupByShard(const std::vector<T>& keys) const {
+	std::vector<std::vector<size_t>> groups(shards.size());
+
+	for (size_t i = 0; i < keys.size(); i++)
+		groups[shardOf(keys[i])].push_back(i);
+
+	return groups;
+}
+
+template<class Engine>
+bool ShardedOrderedSet<Engine>::insert(const T& elem) {
+	bool inserted;
+	bool rebalance = false;
+
+	{
+		std::shared_lock<std::shared_mutex> layout(layoutLock);
+		Shard& shard = *shards[shardOf(elem)];
+		std::lock_guard<SpinLock> guard(shard.lock);
+
+		inserted = Traits::insert(shard.engine, elem);
+
+		if (inserted) {
+			++shard.count;
+			++total;
+			rebalance = overloaded(shard.count);
+		}
+	}
+
+	if (rebalance)
+		rebalanceIfOverloaded();
+
+	return inserted;
+}
+
+template<class Engine>
+bool ShardedOrderedSet<Engine>::contains(const T& elem) const {
+	std::shared_lock<std::shared_mutex> layout(layoutLock);
+	Shard& shard = *shards[shardOf(elem)];
+	std::lock_guard<SpinLock> guard(shard.lock);
+
+	return Traits::contains(shard.engine, elem);
+}
+
+template<class Engine>
+bool ShardedOrderedSet<Engine>::remove(const T& elem) {
+	std::shared_lock<std::shared_mutex> layout(layoutLock);
+	Shard& shard = *shards[shardOf(elem)];
+	std::lock_guard<SpinLock> guard(shard.lock);
+
+	if (!Traits::remove(shard.engine, elem))
+		return false;
+
+	--shard.count;
+	--total;
+
+	return true;
+}
+
+template<class Engine>
+template<class Range>
+size_t ShardedOrderedSet<Engine>::insertBatch(const Range& batch) {
+	std::vector<T> sorted = BatchSort::sortedUnique<T>(batch);
+	std::atomic<size_t> inserted(0);
+	std::atomic<bool> rebalance(false);
+
+	{
+		std::shared_lock<std::shared_mutex> layout(layoutLock);
+		std::vector<size_t> from = splitSorted(sorted);
+
+		pool.parallelFor(shards.size(), [&](size_t i) {
+			if (from[i] == from[i + 1])
+				return;
+
+			std::vector<T> part(sorted.begin() + from[i], sorted.begin() + from[i + 1]);
+			Shard& shard = *shards[i];
+			std::lock_guard<SpinLock> guard(shard.lock);
+
+			size_t added = Traits::insertSorted(shard.engine, part);
+			shard.count += added;
+			total += added;
+			inserted += added;
+		});
+
+		for (const std::unique_ptr<Shard>& shard : shards) {
+			std::lock_guard<SpinLock> guard(shard->lock);
+			if (overloaded(shard->count))
+				rebalance = true;
+		}
+	}
+
+	if (rebalance)
+		rebalanceIfOverloaded();
+
+	return inserted.load();
+}
+
+template<class Engine>
+std::vector<char> ShardedOrderedSet<Engine>::containsBatch(const std::vector<T>& keys) const {
+	std::vector<char> found(keys.size(), 0);
+
+	std::shared_lock<std::shared_mutex> layout(layoutLock);
+	std::vector<std::vector<size_t>> groups = groupByShard(keys);
+
+	pool.parallelFor(shards.size(), [&](size_t i) {
+		if (groups[i].empty())
+			return;
+
+		Shard& shard = *shards[i];
+		std::lock_guard<SpinLock> guard(shard.lock);
+
+		for (size_t key : groups[i])
+			found[key] = Traits::contains(shard.engine, keys[key]);
+	});
+
+	return found;
+}
+
+template<class Engine>
+size_t ShardedOrderedSet<Engine>::removeBatch(const std::vector<T>& keys) {
+	std::atomic<size_t> removed(0);
+
+	std::shared_lock<std::shared_mutex> layout(layoutLock);
+	std::vector<std::vector<size_t>> groups = groupByShard(keys);
+
+	pool.parallelFor(shards.size(), [&](size_t i) {
+		if (groups[i].empty())
+			return;
+
+		Shard& shard = *shards[i];
+		std::lock_guard<SpinLock> guard(shard.lock);
+		size_t fromShard = 0;
+
+		for (size_t key : groups[i]) {
+			if (Traits::remove(shard.engine, keys[key]))
+				++fromShard;
+		}
+
+		shard.count -= fromShard;
+		total -= fromShard;
+		removed += fromShard;
+	});
+
+	return removed.load();
+}
+
+template<class Engine>
+template<class Visit>
+void ShardedOrderedSet<Engine>::forEach(Visit visit) const {
+	std::shared_lock<std::shared_mutex> layout(layoutLock);
+
+	for (const std::unique_ptr<Shard>& shard : shards) {
+		std::lock_guard<SpinLock> guard(shard->lock);
+
+		for (const T& elem : shard->engine)
+			visit(elem);
+	}
+}
+
+template<class Engine>
+std::vector<typename ShardTraits<Engine>::ValueType> ShardedOrderedSet<Engine>::toSorted() const {
+	std::vector<T> result;
+	result.reserve(size());
+
+	forEach([&result](const T& elem) { result.push_back(elem); });
+
+	return result;
+}
+
+template<class Engine>
+std::vector<size_t> ShardedOrderedSet<Engine>::shardSizes() const {
+	std::shared_lock<std::shared_mutex> layout(layoutLock);
+	std::vector<size_t> sizes;
+
+	for (const std::unique_ptr<Shard>& shard : shards) {
+		std::lock_guard<SpinLock> guard(shard->lock);
+		sizes.push_back(shard->count);
+	}
+
+	return sizes;
+}
+
+// Another thread may have redistributed the keys between our check and the exclusive lock.
+template<class Engine>
+void ShardedOrderedSet<Engine>::rebalanceIfOverloaded() {
+	std::unique_lock<std::shared_mutex> layout(layoutLock);
+
+	for (const std::unique_ptr<Shard>& shard : shards) {
+		if (overloaded(shard->count)) {
+			redistribute();
+			return;
+		}
+	}
+}
+
+// Called with layoutLock held exclusively, so no shard lock is needed.
+// The new bounds are the quantiles of the keys, every shard is rebuilt from its sorted part.
+template<class Engine>
+void ShardedOrderedSet<Engine>::redistribute() {
+	std::vector<T> keys;
+	keys.reserve(total.load());
+
+	for (const std::unique_ptr<Shard>& shard : shards) {
+		for (const T& elem : shard->engine)
+			keys.push_back(elem);
+	}
+
+	size_t used = std::min(targetShards, std::max<size_t>(keys.size(), 1));
+
+	bounds.clear();
+	for (size_t i = 1; i < used; i++)
+		bounds.push_back(keys[i * keys.size() / used]);
+
+	shards.clear();
+	for (size_t i = 0; i < used; i++)
+		shards.emplace_back(new Shard());
+
+	std::vector<size_t> from = splitSorted(keys);
+
+	pool.parallelFor(shards.size(), [&](size_t i) {
+		std::vector<T> part(keys.begin() + from[i], keys.begin() + from[i + 1]);
+
+		shards[i]->count = Traits::insertSorted(shards[i]->engine, part);
+	});
+}
+
+#endif // !SHARDED_ORDERED_SET_HEADER_
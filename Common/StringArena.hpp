@@ -0,0 +1,196 @@
+/*
+* Append-only arena for string keys.
+*
+* A std::string key costs a 32-byte object in the node and, above the SSO limit,
+* a separate heap block somewhere else. Here the bytes of every key are appended
+* to big chunks and the node holds only an ArenaString: a pointer and a length (16 bytes).
+* Keys inserted one after another end up next to each other in memory.
+*
+* Chunks are never moved or freed while the arena lives, so handles stay valid.
+* Removing a key only marks its bytes as dead. When the dead bytes outgrow the live ones
+* the owner calls compact(), which copies the live keys into a fresh arena
+* and rewrites the handles in place (the order of the keys does not change).
+*
+* An ArenaString can also point to bytes outside of any arena, which is how lookups
+* compare against a caller's string_view without copying it.
+*/
+
+#ifndef STRING_ARENA_HEADER_
+#define STRING_ARENA_HEADER_
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
+#include<functional>
+#include<memory>
+#include<stdexcept>
+#include<string_view>
+#include<utility>
+#include<vector>
+
+class ArenaString {
+private:
+	const char* bytes;
+	std::uint32_t length;
+
+public:
+	ArenaString() : bytes(nullptr), length(0) {}
+
+	// Does not copy: str must outlive the handle.
+	explicit ArenaString(std::string_view str) : bytes(str.data()), length(static_cast<std::uint32_t>(str.size())) {}
+
+	std::string_view view() const { return std::string_view(bytes, length); }
+
+	const char* data() const { return bytes; }
+
+	size_t size() const { return length; }
+
+	bool operator==(const ArenaString& other) const {
+		return length == other.length && (length == 0 || std::memcmp(bytes, other.bytes, length) == 0);
+	}
+
+	bool operator!=(const ArenaString& other) const { return !(*this == other); }
+
+	bool operator<(const ArenaString& other) const { return view() < other.view(); }
+
+	bool operator>(const ArenaString& other) const { return other < *this; }
+
+	bool operator<=(const ArenaString& other) const { return !(other < *this); }
+
+	bool operator>=(const ArenaString& other) const { return !(*this < other); }
+};
+
+namespace std {
+	template<>
+	struct hash<ArenaString> {
+		size_t operator()(const ArenaString& str) const {
+			return hash<string_view>()(str.view());
+		}
+	};
+}
+
+class StringArena {
+private:
+	static const size_t defaultChunkSize = 64 * 1024;
+
+	std::vector<std::unique_ptr<char[]>> chunks;
+	size_t chunkSize;
+
+	// Free space of the last regular chunk.
+	char* cursor;
+	char* limit;
+
+	size_t reserved;
+	size_t live;
+	size_t dead;
+
+	char* allocate(size_t bytes) {
+		if (bytes > static_cast<size_t>(limit - cursor)) {
+			// Keys bigger than a quarter chunk get a chunk of their own, so they do not waste the current one.
+			if (bytes > chunkSize / 4) {
+				chunks.emplace_back(new char[bytes]);
+				reserved += bytes;
+				return chunks.back().get();
+			}
+
+			chunks.emplace_back(new char[chunkSize]);
+			reserved += chunkSize;
+			cursor = chunks.back().get();
+			limit = cursor + chunkSize;
+		}
+
+		char* result = cursor;
+		cursor += bytes;
+		return result;
+	}
+
+public:
+	explicit StringArena(size_t chunkSize = defaultChunkSize) : chunkSize(chunkSize ? chunkSize : defaultChunkSize), cursor(nullptr), limit(nullptr), reserved(0), live(0), dead(0) {}
+
+	// Copying would leave the handles pointing to the source.
+	StringArena(const StringArena&) = delete;
+	StringArena& operator=(const StringArena&) = delete;
+
+	StringArena(StringArena&& other) noexcept : chunks(std::move(other.chunks)), chunkSize(other.chunkSize), cursor(other.cursor), limit(other.limit), reserved(other.reserved), live(other.live), dead(other.dead) {
+		other.cursor = other.limit = nullptr;
+		other.reserved = other.live = other.dead = 0;
+	}
+
+	StringArena& operator=(StringArena&& other) noexcept {
+		if (this != &other) {
+			StringArena temp(std::move(other));
+			swap(temp);
+		}
+
+		return *this;
+	}
+
+	void swap(StringArena& other) noexcept {
+		std::swap(chunks, other.chunks);
+		std::swap(chunkSize, other.chunkSize);
+		std::swap(cursor, other.cursor);
+		std::swap(limit, other.limit);
+		std::swap(reserved, other.reserved);
+		std::swap(live, other.live);
+		std::swap(dead, other.dead);
+	}
+
+	ArenaString store(std::string_view str) {
+		if (str.size() > UINT32_MAX)
+			throw std::length_error("Key is too long for the arena!");
+
+		char* bytes = str.empty() ? nullptr : allocate(str.size());
+		if (bytes)
+			std::memcpy(bytes, str.data(), str.size());
+
+		live += str.size();
+		return ArenaString(std::string_view(bytes, str.size()));
+	}
+
+	// The key is no longer referenced. Its bytes are reclaimed by the next compact().
+	void release(const ArenaString& str) {
+		live -= str.size();
+		dead += str.size();
+	}
+
+	// Undoes a store() whose key was rejected by the owner.
+	// The bytes are reused right away if it was the last store(), otherwise they become dead.
+	void rollback(const ArenaString& str) {
+		if (str.size() != 0 && str.data() + str.size() == cursor) {
+			cursor -= str.size();
+			live -= str.size();
+			return;
+		}
+
+		release(str);
+	}
+
+	bool needsCompaction() const {
+		return dead > live && dead >= chunkSize;
+	}
+
+	// Copies every key of keys into a fresh arena in iteration order and points the handles there.
+	// keys is any range whose iterators dereference to ArenaString&.
+	template<class Range>
+	void compact(Range& keys) {
+		StringArena fresh(chunkSize);
+
+		for (ArenaString& key : keys)
+			key = fresh.store(key.view());
+
+		swap(fresh);
+	}
+
+	void clear() {
+		chunks.clear();
+		cursor = limit = nullptr;
+		reserved = live = dead = 0;
+	}
+
+	size_t liveBytes() const { return live; }
+
+	size_t deadBytes() const { return dead; }
+
+	size_t reservedBytes() const { return reserved; }
+};
+
+#endif // !STRING_ARENA_HEADER_
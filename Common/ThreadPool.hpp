@@ -0,0 +1,200 @@
+/*
+* Work-stealing thread pool for the batch operations of ShardedOrderedSet.
+*
+* Every worker has its own deque of tasks. A worker takes the newest task from
+* the back of its own deque and, when that is empty, steals the oldest task from the
+* front of another worker's deque, so uneven tasks (a hot shard) do not leave threads idle.
+* Idle workers sleep on a condition variable until a task is submitted.
+*
+* parallelFor(count, body) runs body(0) ... body(count - 1) as tasks and returns when all are done.
+* The first exception thrown by body is rethrown there, after the other tasks finished.
+* The calling thread runs queued tasks too, so a pool of one worker still uses two threads
+* and a task may call parallelFor without deadlocking; when nothing is left to take it sleeps
+* until the last of its tasks finishes.
+*/
+
+#ifndef THREAD_POOL_HEADER_
+#define THREAD_POOL_HEADER_
+#include<atomic>
+#include<condition_variable>
+#include<cstddef>
+#include<deque>
+#include<exception>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+class ThreadPool {
+private:
+	using Task = std::function<void()>;
+
+	struct alignas(64) Queue {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+
+	// Tasks submitted and not taken yet. Increased under sleepLock, so a sleeping worker cannot miss it,
+	// and before the task is pushed, so a thief cannot decrease it first.
+	std::atomic<size_t> queued;
+	std::atomic<size_t> nextQueue;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	bool stopping;
+
+	bool popBack(size_t queue, Task& task) {
+		std::lock_guard<std::mutex> guard(queues[queue]->lock);
+
+		if (queues[queue]->tasks.empty())
+			return false;
+
+		task = std::move(queues[queue]->tasks.back());
+		queues[queue]->tasks.pop_back();
+		--queued;
+
+		return true;
+	}
+
+	bool stealFront(size_t queue, Task& task) {
+		std::lock_guard<std::mutex> guard(queues[queue]->lock);
+
+		if (queues[queue]->tasks.empty())
+			return false;
+
+		task = std::move(queues[queue]->tasks.front());
+		queues[queue]->tasks.pop_front();
+		--queued;
+
+		return true;
+	}
+
+	// Own queue first, then the others starting from the next one.
+	bool takeTask(size_t own, Task& task) {
+		if (popBack(own, task))
+			return true;
+
+		for (size_t i = 1; i < queues.size(); i++) {
+			if (stealFront((own + i) % queues.size(), task))
+				return true;
+		}
+
+		return false;
+	}
+
+	void submit(Task task) {
+		size_t queue = nextQueue++ % queues.size();
+
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			++queued;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(queues[queue]->lock);
+			queues[queue]->tasks.push_back(std::move(task));
+		}
+
+		wake.notify_one();
+	}
+
+	void run(size_t own) {
+		Task task;
+
+		while (true) {
+			if (takeTask(own, task)) {
+				task();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> guard(sleepLock);
+			wake.wait(guard, [this]() { return stopping || queued > 0; });
+
+			if (stopping && queued == 0)
+				return;
+		}
+	}
+
+public:
+	// threads = 0 uses one worker per hardware thread.
+	explicit ThreadPool(size_t threads = 0) : queued(0), nextQueue(0), stopping(false) {
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+
+		for (size_t i = 0; i < threads; i++)
+			queues.emplace_back(new Queue());
+
+		for (size_t i = 0; i < threads; i++)
+			workers.emplace_back([this, i]() { run(i); });
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t threadsCount() const {
+		return workers.size();
+	}
+
+	template<class Body>
+	void parallelFor(size_t count, Body body) {
+		if (count == 0)
+			return;
+
+		// remaining is changed and read under doneLock, so the last task has notified
+		// before this call can see 0 and destroy the locals the tasks refer to.
+		size_t remaining = count;
+		std::mutex doneLock;
+		std::condition_variable done;
+		std::mutex errorLock;
+		std::exception_ptr error;
+
+		for (size_t i = 0; i < count; i++) {
+			submit([&body, &remaining, &doneLock, &done, &errorLock, &error, i]() {
+				try {
+					body(i);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> guard(errorLock);
+					if (!error)
+						error = std::current_exception();
+				}
+
+				std::lock_guard<std::mutex> guard(doneLock);
+				if (--remaining == 0)
+					done.notify_all();
+			});
+		}
+
+		// Help with any queued task, ours or not. Once none is queued, ours are all taken
+		// (they are never queued again), so sleep until the workers running them finish.
+		Task task;
+		size_t start = 0;
+
+		while (takeTask(start++ % queues.size(), task))
+			task();
+
+		std::unique_lock<std::mutex> guard(doneLock);
+		done.wait(guard, [&remaining]() { return remaining == 0; });
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			stopping = true;
+		}
+
+		wake.notify_all();
+
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+};
+
+#endif // !THREAD_POOL_HEADER_
@@ -0,0 +1,158 @@
+/*
+* Out-of-line value storage for the map adapters.
+*
+* A map node holds a MapEntry: the key and a pointer to its value.
+* The values live in a ValueStore, in chunks that are never moved,
+* so a search only touches keys and the value is read once, at the end.
+*
+* Erased slots are kept in a free list and reused by the next emplace.
+*/
+
+#ifndef VALUE_STORE_HEADER_
+#define VALUE_STORE_HEADER_
+#include<cstddef>
+#include<memory>
+#include<new>
+#include<utility>
+#include<vector>
+
+template<class V>
+class ValueStore {
+private:
+	static const size_t chunkSize = 256;
+
+	struct Slot {
+		alignas(V) unsigned char storage[sizeof(V)];
+		Slot* nextFree;
+		bool live;
+
+		V* value() { return std::launder(reinterpret_cast<V*>(storage)); }
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> chunks;
+	size_t usedInLastChunk;
+	Slot* freeList;
+	size_t liveCount;
+
+	Slot* slotOf(V* value) {
+		// storage is the first member of Slot.
+		return reinterpret_cast<Slot*>(reinterpret_cast<unsigned char*>(value));
+	}
+
+	Slot* takeSlot() {
+		if (freeList) {
+			Slot* slot = freeList;
+			freeList = slot->nextFree;
+			return slot;
+		}
+
+		if (chunks.empty() || usedInLastChunk == chunkSize) {
+			chunks.emplace_back(new Slot[chunkSize]);
+			usedInLastChunk = 0;
+		}
+
+		return &chunks.back()[usedInLastChunk++];
+	}
+
+	void destroyAll() {
+		for (std::unique_ptr<Slot[]>& chunk : chunks) {
+			size_t used = (chunk == chunks.back()) ? usedInLastChunk : chunkSize;
+
+			for (size_t i = 0; i < used; i++) {
+				if (chunk[i].live)
+					chunk[i].value()->~V();
+			}
+		}
+	}
+
+public:
+	ValueStore() : usedInLastChunk(0), freeList(nullptr), liveCount(0) {}
+
+	// The maps re-emplace the values of a copy themselves, so that their entries point to the new values.
+	ValueStore(const ValueStore&) = delete;
+	ValueStore& operator=(const ValueStore&) = delete;
+
+	ValueStore(ValueStore&& other) noexcept : chunks(std::move(other.chunks)), usedInLastChunk(other.usedInLastChunk), freeList(other.freeList), liveCount(other.liveCount) {
+		other.usedInLastChunk = 0;
+		other.freeList = nullptr;
+		other.liveCount = 0;
+	}
+
+	ValueStore& operator=(ValueStore&& other) noexcept {
+		if (this != &other) {
+			destroyAll();
+
+			chunks = std::move(other.chunks);
+			usedInLastChunk = other.usedInLastChunk;
+			freeList = other.freeList;
+			liveCount = other.liveCount;
+
+			other.chunks.clear();
+			other.usedInLastChunk = 0;
+			other.freeList = nullptr;
+			other.liveCount = 0;
+		}
+
+		return *this;
+	}
+
+	template<class... Args>
+	V* emplace(Args&&... args) {
+		Slot* slot = takeSlot();
+
+		try {
+			new (slot->storage) V(std::forward<Args>(args)...);
+		}
+		catch (...) {
+			slot->live = false;
+			slot->nextFree = freeList;
+			freeList = slot;
+			throw;
+		}
+
+		slot->live = true;
+		++liveCount;
+
+		return slot->value();
+	}
+
+	void erase(V* value) {
+		Slot* slot = slotOf(value);
+
+		value->~V();
+		slot->live = false;
+		slot->nextFree = freeList;
+		freeList = slot;
+		--liveCount;
+	}
+
+	size_t size() const { return liveCount; }
+
+	~ValueStore() {
+		destroyAll();
+	}
+};
+
+// Ordered and compared by key only. The value pointer is not part of the search.
+template<class K, class V>
+struct MapEntry {
+	K key;
+	V* value;
+
+	MapEntry(const K& key, V* value) : key(key), value(value) {}
+
+	bool operator==(const MapEntry& other) const { return key == other.key; }
+
+	bool operator<(const MapEntry& other) const { return key < other.key; }
+
+	bool operator>(const MapEntry& other) const { return other.key < key; }
+
+	// Heterogeneous comparisons, so the engines can find an entry by its key alone.
+	friend bool operator==(const MapEntry& entry, const K& key) { return entry.key == key; }
+
+	friend bool operator<(const MapEntry& entry, const K& key) { return entry.key < key; }
+
+	friend bool operator<(const K& key, const MapEntry& entry) { return key < entry.key; }
+};
+
+#endif // !VALUE_STORE_HEADER_
@@ -0,0 +1,185 @@
+#include "ShardedOrderedSet.hpp"
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include"../../doctest.h"
+#include<atomic>
+#include<set>
+#include<stdexcept>
+#include<vector>
+
+template<class Engine>
+bool sameElements(const ShardedOrderedSet<Engine>& sharded, const std::set<int>& expected) {
+	std::vector<int> sorted = sharded.toSorted();
+
+	return sharded.size() == expected.size() && sorted == std::vector<int>(expected.begin(), expected.end());
+}
+
+template<class Engine>
+bool sizesAddUp(const ShardedOrderedSet<Engine>& sharded) {
+	size_t total = 0;
+	for (size_t count : sharded.shardSizes())
+		total += count;
+
+	return total == sharded.size();
+}
+
+// Single keys and batches mixed, checked against std::set after every step.
+template<class Engine>
+void checkAgainstSet(ShardedOrderedSet<Engine>& sharded, std::set<int>& expected, int rounds, int range) {
+	for (int round = 0; round < rounds; round++) {
+		std::vector<int> batch;
+		for (int i = 0; i < 500; i++)
+			batch.push_back(rand() % range);
+
+		switch (round % 4) {
+		case 0: {
+			size_t fresh = 0;
+			for (int elem : batch)
+				fresh += expected.insert(elem).second;
+
+			CHECK(sharded.insertBatch(batch) == fresh);
+			break;
+		}
+		case 1: {
+			std::vector<char> found = sharded.containsBatch(batch);
+			REQUIRE(found.size() == batch.size());
+
+			for (size_t i = 0; i < batch.size(); i++)
+				CHECK((found[i] != 0) == (expected.count(batch[i]) == 1));
+			break;
+		}
+		case 2: {
+			size_t removed = 0;
+			for (int elem : batch)
+				removed += expected.erase(elem);
+
+			CHECK(sharded.removeBatch(batch) == removed);
+			break;
+		}
+		default:
+			for (int elem : batch) {
+				if (elem % 2)
+					CHECK(sharded.insert(elem) == expected.insert(elem).second);
+				else
+					CHECK(sharded.remove(elem) == (expected.erase(elem) == 1));
+
+				CHECK(sharded.contains(elem) == (expected.count(elem) == 1));
+			}
+		}
+
+		CHECK(sharded.size() == expected.size());
+	}
+
+	CHECK(sameElements(sharded, expected));
+	CHECK(sizesAddUp(sharded));
+}
+
+TEST_CASE("sharded AVL set matches std::set") {
+	std::vector<int> sample;
+	for (int i = 0; i < 1000; i++)
+		sample.push_back(rand() % 100000);
+
+	ShardedOrderedSet<AVLTree<int>> sharded(8, 4, sample);
+	std::set<int> expected;
+
+	CHECK(sharded.shardsCount() == 8);
+	checkAgainstSet(sharded, expected, 200, 100000);
+}
+
+TEST_CASE("sharded weak AVL set matches std::set") {
+	// Loads its shards with the one-by-one insertBatch of the relaxed balance.
+	ShardedOrderedSet<AVLTree<int, WAVLBalance>> sharded(4, 2);
+	std::set<int> expected;
+
+	checkAgainstSet(sharded, expected, 200, 50000);
+	CHECK(sharded.shardsCount() == 4);
+}
+
+TEST_CASE("sharded skip list set matches std::set") {
+	ShardedOrderedSet<SkipList<int, 12>> sharded(6, 3);
+	std::set<int> expected;
+
+	// Without a sample everything starts in one shard.
+	CHECK(sharded.shardsCount() == 1);
+	checkAgainstSet(sharded, expected, 200, 50000);
+
+	// Repeated keys of a multiset engine are still stored once.
+	CHECK(sharded.insertBatch(std::vector<int>{ 7, 7, 7 }) == (expected.insert(7).second ? 1u : 0u));
+	CHECK_FALSE(sharded.insert(7));
+	CHECK(sameElements(sharded, expected));
+	CHECK(sharded.shardsCount() == 6);
+}
+
+TEST_CASE("a skewed key stream forces a redistribution") {
+	// The bounds come from keys in [0, 1000000), then every key lands in [0, 20000): the first shard.
+	std::vector<int> sample;
+	for (int i = 0; i < 1000; i++)
+		sample.push_back(i * 1000);
+
+	ShardedOrderedSet<AVLTree<int>> sharded(4, 2, sample);
+	std::set<int> expected;
+
+	for (int i = 0; i < 4000; i++) {
+		CHECK(sharded.insert(i) == expected.insert(i).second);
+	}
+
+	// Not enough keys yet to be worth a redistribution.
+	std::vector<size_t> sizes = sharded.shardSizes();
+	REQUIRE(sizes.size() == 4);
+	CHECK(sizes[0] == 4000);
+
+	std::vector<int> batch;
+	for (int i = 0; i < 16000; i++)
+		batch.push_back(4000 + rand() % 16000);
+
+	size_t fresh = 0;
+	for (int elem : batch)
+		fresh += expected.insert(elem).second;
+
+	CHECK(sharded.insertBatch(batch) == fresh);
+
+	// The quantiles of the keys: every shard within one key of a quarter.
+	sizes = sharded.shardSizes();
+	REQUIRE(sizes.size() == 4);
+	for (size_t count : sizes) {
+		CHECK(4 * count + 4 >= expected.size());
+		CHECK(4 * count <= expected.size() + 4);
+	}
+
+	CHECK(sameElements(sharded, expected));
+	CHECK(sizesAddUp(sharded));
+
+	// The single-key path triggers it too.
+	for (int i = 100000; i < 110000; i++)
+		CHECK(sharded.insert(i) == expected.insert(i).second);
+
+	sizes = sharded.shardSizes();
+	for (size_t count : sizes)
+		CHECK(2 * count * sizes.size() <= 3 * expected.size());
+
+	CHECK(sameElements(sharded, expected));
+	checkAgainstSet(sharded, expected, 40, 200000);
+}
+
+TEST_CASE("parallelFor runs every index once, nested too, and rethrows") {
+	ThreadPool pool(2);
+
+	for (int round = 0; round < 200; round++) {
+		std::vector<std::atomic<int>> runs(64);
+
+		// Every outer task waits for an inner parallelFor, more tasks than threads.
+		pool.parallelFor(8, [&](size_t i) {
+			pool.parallelFor(8, [&](size_t j) { ++runs[i * 8 + j]; });
+		});
+
+		for (std::atomic<int>& count : runs)
+			CHECK(count == 1);
+	}
+
+	std::atomic<int> finished(0);
+	CHECK_THROWS(pool.parallelFor(16, [&](size_t i) {
+		if (i == 5)
+			throw std::runtime_error("task failed");
+		++finished;
+	}));
+	CHECK(finished == 15);
+}
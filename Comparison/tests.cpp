@@ -1,6 +1,20 @@
 #include"../SkipList/SkipList.hpp"
 #include"../AVL/AVLTree.hpp"
-#include "../Benchmark/Timer.h"
+#include"../AVL/PersistentAVLTree.hpp"
+#include"../SkipList/InternedSkipList.hpp"
+#include"../SkipList/DeterministicSkipList.hpp"
+#include"../SkipList/UnrolledSkipList.hpp"
+#include"../AVL/InternedAVLTree.hpp"
+#include"../AVL/CompactAVLTree.hpp"
+#include"../SplayTree/SplayTree.hpp"
+#include"../AVL/AVLMap.hpp"
+#include"../SkipList/SkipListMap.hpp"
+#include"../SkipList/CountedSkipList.hpp"
+#include"../AVL/CountedAVLTree.hpp"
+#include"../Common/OrderedSet.hpp"
+#include"../Common/ShardedOrderedSet.hpp"
+#include "../Benchmark/Profiler.h"
+#include "../Benchmark/LatencyHistogram.h"
 
 #include<benchmark/benchmark.h>
 
@@ -8,6 +22,9 @@
 #include<fstream>
 #include<vector>
 #include<string>
+#include<algorithm>
+#include<random>
+#include<stdexcept>
 
 const int ELEMS = 70000;
 
@@ -25,139 +42,929 @@ std::string gen_random(const int len) {
 	return tmp_s;
 }
 
-static void loadOxdfordOnSkipList(benchmark::State& state) {
-	for(auto x : state){
-		std::ifstream inFile("oxford-diff.txt");
-		SkipList<std::string, 12> toLoad;
+// Throws if the file cannot be opened: the workloads must not run on an empty word list.
+std::vector<std::string> readWords(const char* path, int limit = ELEMS) {
+	std::ifstream inFile(path);
+	if (!inFile)
+		throw std::runtime_error(std::string("Cannot open ") + path);
 
-		for(int i = 0; i < ELEMS; ++i){
-			std::string word;
-			inFile >> word;
-			toLoad.insert(word);
-		}
+	std::vector<std::string> words;
+	std::string word;
+
+	while (static_cast<int>(words.size()) < limit && inFile >> word)
+		words.push_back(word);
+
+	return words;
+}
+
+using Histogram = LatencyHistogram<>;
+
+// Times ops calls of op(i) in batches of batch calls. Every call of a batch is
+// recorded with the batch average, so batch == 1 gives true per-call latency
+// and bigger batches amortize the cost of reading the clock.
+template<class Op>
+void timeOperations(Histogram& histogram, size_t ops, size_t batch, Op op) {
+	for (size_t i = 0; i < ops; i += batch) {
+		size_t end = std::min(ops, i + batch);
+
+		std::uint64_t start = profiler::Clock::steadyNanoseconds();
+		for (size_t j = i; j < end; ++j)
+			op(j);
+		std::uint64_t elapsed = profiler::Clock::steadyNanoseconds() - start;
+
+		histogram.record(elapsed / (end - i), end - i);
 	}
 }
 
-static void loadOxdfordOnAVL(benchmark::State& state) {
-	for(auto x : state){
-		std::ifstream inFile("oxford-diff.txt");
-		AVLTree<std::string> toLoad;
+void reportLatencies(benchmark::State& state, const Histogram& histogram) {
+	state.counters["p50_ns"] = histogram.percentile(50);
+	state.counters["p90_ns"] = histogram.percentile(90);
+	state.counters["p99_ns"] = histogram.percentile(99);
+	state.counters["p99.9_ns"] = histogram.percentile(99.9);
+	state.counters["max_ns"] = histogram.max();
+}
 
-		for(int i = 0; i < ELEMS; ++i){
-			std::string word;
-			inFile >> word;
-			if (inFile.eof()) break;
+// 1M random ints, then 1M random lookups (about half of them hit).
+const int INT_ELEMS = 1 << 20;
 
-			toLoad.push(word);
+std::vector<int> randomInts(size_t count) {
+	std::vector<int> result;
+	for (size_t i = 0; i < count; i++)
+		result.push_back(rand() % (2 * INT_ELEMS));
+
+	return result;
+}
+
+std::vector<std::string> randomWords(size_t count) {
+	std::vector<std::string> result;
+	for (size_t i = 0; i < count; i++)
+		result.push_back(gen_random(12));
+
+	return result;
+}
+
+// Hardware cache and dTLB misses per lookup, reported only when built with PROFILER_PERF_COUNTERS.
+template<class Lookups>
+void countCacheMisses(benchmark::State& state, size_t lookups, Lookups run) {
+	profiler::PerfCounterGroup counters;
+	std::uint64_t before[profiler::PerfCounterGroup::Count];
+	std::uint64_t after[profiler::PerfCounterGroup::Count];
+
+	counters.read(before);
+
+	for(auto x : state)
+		run();
+
+	if (counters.read(after)) {
+		state.counters["cache_misses_per_op"] = static_cast<double>(after[profiler::PerfCounterGroup::CacheMisses] - before[profiler::PerfCounterGroup::CacheMisses]) / (state.iterations() * lookups);
+		state.counters["dtlb_misses_per_op"] = static_cast<double>(after[profiler::PerfCounterGroup::DTLBMisses] - before[profiler::PerfCounterGroup::DTLBMisses]) / (state.iterations() * lookups);
+	}
+}
+
+/*
+* The load / search / delete / scan matrix, written once against OrderedSetTraits
+* and registered for every engine with ORDERED_SET_BENCHMARKS at the bottom of the file.
+* An engine added later only needs its traits and one line there.
+*
+* Every timed iteration is a profiler zone (insert, search, remove, scan) under the zone of its benchmark,
+* so the zones cost two clock reads per pass over the words, not per operation. The zones of all
+* engines add up: run one engine with --benchmark_filter to profile it alone. main writes profile.json.
+*/
+
+template<class Engine>
+Engine loadAll(const std::vector<typename OrderedSetTraits<Engine>::ValueType>& elems) {
+	static_assert(isOrderedSet<Engine>, "Engine needs an OrderedSetTraits specialization");
+
+	PROFILE_ZONE("insert");
+
+	Engine loaded;
+	for (const auto& elem : elems)
+		OrderedSetTraits<Engine>::insert(loaded, elem);
+
+	return loaded;
+}
+
+// Engines that can tell their footprint report it next to the lookups.
+template<class Engine>
+void reportMemory(benchmark::State&, const Engine&) {}
+
+template<class T>
+void reportMemory(benchmark::State& state, const CompactAVLTree<T>& tree) {
+	state.counters["bytes_per_node"] = static_cast<double>(tree.memoryUsage()) / tree.getNodesCount();
+}
+
+// The shape behind the search times, from analyze(). --benchmark_format=json puts the counters in the report.
+template<class Engine>
+void reportShape(benchmark::State&, const Engine&) {}
+
+template<class T, class Balance>
+void reportShape(benchmark::State& state, const AVLTree<T, Balance>& tree) {
+	TreeShape shape = tree.analyze();
+	state.counters["avg_path"] = shape.averagePathLength;
+	state.counters["max_path"] = static_cast<double>(shape.maxPathLength);
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+void reportShape(benchmark::State& state, const SkipList<T, maxLevel, Promotion>& list) {
+	ListShape shape = list.analyze();
+	state.counters["search_cost"] = shape.actualSearchCost;
+	state.counters["expected_cost"] = shape.expectedSearchCost;
+}
+
+template<class Engine>
+static void loadOxford(benchmark::State& state) {
+	PROFILE_ZONE("loadOxford");
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+
+	for(auto x : state) {
+		Engine loaded = loadAll<Engine>(words);
+		benchmark::DoNotOptimize(OrderedSetTraits<Engine>::size(loaded));
+	}
+}
+
+// The Harry words repeat a lot, which the splay tree turns into short paths.
+template<class Engine>
+static void searchHarry(benchmark::State& state) {
+	PROFILE_ZONE("searchHarry");
+	std::vector<std::string> harry = readWords("harry.txt");
+	Engine loaded = loadAll<Engine>(readWords("oxford-diff.txt"));
+
+	for(auto x : state) {
+		PROFILE_ZONE("search");
+		for (const std::string& word : harry)
+			benchmark::DoNotOptimize(OrderedSetTraits<Engine>::contains(loaded, word));
+	}
+
+	reportShape(state, loaded);
+}
+
+// Random 12-char strings almost never hit, so every search goes to the bottom.
+template<class Engine>
+static void searchHard(benchmark::State& state) {
+	PROFILE_ZONE("searchHard");
+	std::vector<std::string> queries = randomWords(1000000);
+	Engine loaded = loadAll<Engine>(readWords("oxford-diff.txt"));
+
+	for(auto x : state) {
+		PROFILE_ZONE("search");
+		for (const std::string& query : queries)
+			benchmark::DoNotOptimize(OrderedSetTraits<Engine>::contains(loaded, query));
+	}
+}
+
+// Removes the whole dictionary in random order from a fresh copy.
+template<class Engine>
+static void deleteOxford(benchmark::State& state) {
+	PROFILE_ZONE("deleteOxford");
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+	Engine loaded = loadAll<Engine>(words);
+	std::shuffle(words.begin(), words.end(), std::mt19937(42));
+
+	for(auto x : state) {
+		state.PauseTiming();
+		Engine toDelete(loaded);
+		state.ResumeTiming();
+
+		PROFILE_ZONE("remove");
+		for (const std::string& word : words)
+			benchmark::DoNotOptimize(OrderedSetTraits<Engine>::remove(toDelete, word));
+	}
+
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(words.size()));
+}
+
+// In-order iteration over everything, the cost of following the engine's links.
+template<class Engine>
+static void scanOxford(benchmark::State& state) {
+	PROFILE_ZONE("scanOxford");
+	Engine loaded = loadAll<Engine>(readWords("oxford-diff.txt"));
+
+	for(auto x : state) {
+		PROFILE_ZONE("scan");
+		size_t length = 0;
+		for (const std::string& word : loaded)
+			length += word.size();
+
+		benchmark::DoNotOptimize(length);
+	}
+
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(OrderedSetTraits<Engine>::size(loaded)));
+}
+
+template<class Engine>
+static void searchInts(benchmark::State& state) {
+	std::vector<int> queries = randomInts(INT_ELEMS);
+	Engine loaded = loadAll<Engine>(randomInts(INT_ELEMS));
+
+	countCacheMisses(state, queries.size(), [&]() {
+		for (int query : queries)
+			benchmark::DoNotOptimize(OrderedSetTraits<Engine>::contains(loaded, query));
+	});
+
+	reportMemory(state, loaded);
+	reportShape(state, loaded);
+}
+
+// searchInts with the nodes loaded into a huge-page resource when state.range(0) == 1.
+template<class Engine>
+static void searchIntsWithHugePages(benchmark::State& state) {
+	std::vector<int> queries = randomInts(INT_ELEMS);
+	std::vector<int> keys = randomInts(INT_ELEMS);
+	HugePageResource resource;
+	Engine loaded;
+
+	if (state.range(0)) {
+		NodeMemory::Scope scope(resource);
+		loaded = loadAll<Engine>(keys);
+	}
+	else {
+		loaded = loadAll<Engine>(keys);
+	}
+
+	countCacheMisses(state, queries.size(), [&]() {
+		for (int query : queries)
+			benchmark::DoNotOptimize(OrderedSetTraits<Engine>::contains(loaded, query));
+	});
+
+	state.counters["huge_pages"] = state.range(0) && resource.hugePages();
+
+	// The nodes go back to the resource before it unmaps.
+	loaded = Engine();
+}
+
+// Latency mode: every call (or batch of state.range(0) calls) is timed separately
+// and the tail percentiles are reported as counters.
+
+template<class Engine>
+static void latencyInsert(benchmark::State& state) {
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+	Histogram histogram;
+
+	for(auto x : state) {
+		Engine toLoad;
+		timeOperations(histogram, words.size(), state.range(0), [&](size_t i) { OrderedSetTraits<Engine>::insert(toLoad, words[i]); });
+	}
+
+	reportLatencies(state, histogram);
+}
+
+template<class Engine>
+static void latencySearchHarry(benchmark::State& state) {
+	std::vector<std::string> queries = readWords("harry.txt");
+	Histogram histogram;
+	Engine loaded = loadAll<Engine>(readWords("oxford-diff.txt"));
+
+	for(auto x : state)
+		timeOperations(histogram, queries.size(), state.range(0), [&](size_t i) { benchmark::DoNotOptimize(OrderedSetTraits<Engine>::contains(loaded, queries[i])); });
+
+	reportLatencies(state, histogram);
+}
+
+template<class Engine>
+static void latencySearchHard(benchmark::State& state) {
+	std::vector<std::string> queries = randomWords(100000);
+	Histogram histogram;
+	Engine loaded = loadAll<Engine>(readWords("oxford-diff.txt"));
+
+	for(auto x : state)
+		timeOperations(histogram, queries.size(), state.range(0), [&](size_t i) { benchmark::DoNotOptimize(OrderedSetTraits<Engine>::contains(loaded, queries[i])); });
+
+	reportLatencies(state, histogram);
+}
+
+// Sweep over the promotion probability: tower length (pointers per node) against search time.
+template<class Promotion>
+static void searchHarryOnSkipListWithPromotion(benchmark::State& state) {
+	std::vector<std::string> harry = readWords("harry.txt");
+	SkipList<std::string, Promotion::recommendedMaxLevel(ELEMS), Promotion> toLoad;
+
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		toLoad.insert(word);
+
+	for(auto x : state) {
+		for (const std::string& word : harry)
+			benchmark::DoNotOptimize(toLoad.containsElement(word));
+	}
+
+	std::vector<size_t> histogram = toLoad.levelHistogram();
+	size_t pointers = 0;
+	for (size_t count : histogram)
+		pointers += count;
+
+	state.counters["levels"] = static_cast<double>(histogram.size());
+	state.counters["pointers_per_node"] = histogram.empty() ? 0.0 : static_cast<double>(pointers) / histogram[0];
+}
+
+static void copyIntsOnAVL(benchmark::State& state) {
+	AVLTree<int> toLoad;
+
+	for (int elem : randomInts(INT_ELEMS))
+		toLoad.push(elem);
+
+	for(auto x : state) {
+		AVLTree<int> copy(toLoad);
+		benchmark::DoNotOptimize(copy.getHeight());
+	}
+}
+
+static void copyIntsOnCompactAVL(benchmark::State& state) {
+	CompactAVLTree<int> toLoad;
+
+	for (int elem : randomInts(INT_ELEMS))
+		toLoad.push(elem);
+
+	for(auto x : state) {
+		CompactAVLTree<int> copy(toLoad);
+		benchmark::DoNotOptimize(copy.getHeight());
+	}
+}
+
+// The dictionary frozen after the load, searched like searchHarry<WordAVL>.
+static void searchHarryOnFrozenSet(benchmark::State& state) {
+	std::vector<std::string> harry = readWords("harry.txt");
+	AVLTree<std::string> toLoad;
+
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		toLoad.push(word);
+
+	FrozenSet<std::string> frozen = toLoad.freeze();
+
+	for(auto x : state) {
+		for (const std::string& word : harry)
+			benchmark::DoNotOptimize(frozen.contains(word));
+	}
+}
+
+static void searchIntsOnFrozenSet(benchmark::State& state) {
+	std::vector<int> queries = randomInts(INT_ELEMS);
+	AVLTree<int> toLoad;
+
+	for (int elem : randomInts(INT_ELEMS))
+		toLoad.push(elem);
+
+	FrozenSet<int> frozen = toLoad.freeze();
+
+	countCacheMisses(state, queries.size(), [&]() {
+		for (int query : queries)
+			benchmark::DoNotOptimize(frozen.contains(query));
+	});
+}
+
+// A map used the old way: the value is a field of the element, so it sits in every node a search visits.
+struct InlineRecord {
+	int key;
+	char payload[120];
+
+	bool operator==(const InlineRecord& other) const { return key == other.key; }
+	bool operator<(const InlineRecord& other) const { return key < other.key; }
+	bool operator>(const InlineRecord& other) const { return key > other.key; }
+};
+
+struct Payload {
+	char bytes[120];
+};
+
+static void searchIntsOnAVLOfRecords(benchmark::State& state) {
+	std::vector<int> queries = randomInts(INT_ELEMS);
+	AVLTree<InlineRecord> toLoad;
+
+	for (int elem : randomInts(INT_ELEMS))
+		toLoad.push(InlineRecord{ elem, {} });
+
+	countCacheMisses(state, queries.size(), [&]() {
+		for (int query : queries)
+			benchmark::DoNotOptimize(toLoad.exists(InlineRecord{ query, {} }));
+	});
+}
+
+static void searchIntsOnAVLMap(benchmark::State& state) {
+	std::vector<int> queries = randomInts(INT_ELEMS);
+	AVLMap<int, Payload> toLoad;
+
+	for (int elem : randomInts(INT_ELEMS))
+		toLoad.tryEmplace(elem);
+
+	countCacheMisses(state, queries.size(), [&]() {
+		for (int query : queries)
+			benchmark::DoNotOptimize(toLoad.find(query));
+	});
+}
+
+static void searchIntsOnSkipListOfRecords(benchmark::State& state) {
+	std::vector<int> queries = randomInts(INT_ELEMS);
+	SkipList<InlineRecord, 20> toLoad;
+
+	for (int elem : randomInts(INT_ELEMS))
+		toLoad.insert(InlineRecord{ elem, {} });
+
+	countCacheMisses(state, queries.size(), [&]() {
+		for (int query : queries)
+			benchmark::DoNotOptimize(toLoad.containsElement(InlineRecord{ query, {} }));
+	});
+}
+
+static void searchIntsOnSkipListMap(benchmark::State& state) {
+	std::vector<int> queries = randomInts(INT_ELEMS);
+	SkipListMap<int, Payload, 20> toLoad;
+
+	for (int elem : randomInts(INT_ELEMS))
+		toLoad.tryEmplace(elem);
+
+	countCacheMisses(state, queries.size(), [&]() {
+		for (int query : queries)
+			benchmark::DoNotOptimize(toLoad.find(query));
+	});
+}
+
+// Word frequencies of the Harry text. The plain skip list links a node for every occurrence,
+// the counted structures bump the count of the word's node.
+static void countWordsOnSkipList(benchmark::State& state) {
+	std::vector<std::string> harry = readWords("harry.txt");
+
+	for(auto x : state) {
+		SkipList<std::string, 12> counts;
+
+		for (const std::string& word : harry)
+			counts.insert(word);
+
+		benchmark::DoNotOptimize(counts.elementsCount());
+	}
+}
+
+static void countWordsOnCountedSkipList(benchmark::State& state) {
+	std::vector<std::string> harry = readWords("harry.txt");
+
+	for(auto x : state) {
+		CountedSkipList<std::string> counts;
+
+		for (const std::string& word : harry)
+			counts.insert(word);
+
+		benchmark::DoNotOptimize(counts.distinctCount());
+	}
+}
+
+static void countWordsOnCountedAVL(benchmark::State& state) {
+	std::vector<std::string> harry = readWords("harry.txt");
+
+	for(auto x : state) {
+		CountedAVLTree<std::string> counts;
+
+		for (const std::string& word : harry)
+			counts.push(word);
+
+		benchmark::DoNotOptimize(counts.distinctCount());
+	}
+}
+
+// Loads INT_ELEMS random keys arriving in batches of 64k, one insert at a time or with insertBatch.
+const size_t INSERT_BATCH = 1 << 16;
+
+template<class Structure, class Insert>
+void ingestInBatches(benchmark::State& state, Insert insert) {
+	std::vector<int> keys = randomInts(INT_ELEMS);
+
+	for(auto x : state) {
+		Structure loaded;
+
+		for (size_t from = 0; from < keys.size(); from += INSERT_BATCH) {
+			size_t to = std::min(keys.size(), from + INSERT_BATCH);
+			insert(loaded, std::vector<int>(keys.begin() + from, keys.begin() + to));
 		}
 	}
+
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(keys.size()));
 }
 
-static void searchHardOnSkipList(benchmark::State& state) {
-	for(auto x : state){
-		std::ifstream inFile("oxford-diff.txt");
+static void ingestOnSkipList(benchmark::State& state) {
+	ingestInBatches<SkipList<int, 20>>(state, [](SkipList<int, 20>& list, const std::vector<int>& batch) {
+		for (int elem : batch)
+			list.insert(elem);
+	});
+}
+
+static void ingestBatchesOnSkipList(benchmark::State& state) {
+	ingestInBatches<SkipList<int, 20>>(state, [](SkipList<int, 20>& list, const std::vector<int>& batch) {
+		list.insertBatch(batch);
+	});
+}
+
+static void ingestOnAVL(benchmark::State& state) {
+	ingestInBatches<AVLTree<int>>(state, [](AVLTree<int>& tree, const std::vector<int>& batch) {
+		for (int elem : batch)
+			tree.push(elem);
+	});
+}
+
+static void ingestBatchesOnAVL(benchmark::State& state) {
+	ingestInBatches<AVLTree<int>>(state, [](AVLTree<int>& tree, const std::vector<int>& batch) {
+		tree.insertBatch(batch);
+	});
+}
 
+// Thread scaling of the sharded set: state.range(0) pool workers and twice as many shards.
+// Every iteration answers INT_ELEMS lookups, inserts a batch of new keys and removes it again.
+template<class Engine>
+static void mixedBatchesOnShardedSet(benchmark::State& state) {
+	size_t threads = static_cast<size_t>(state.range(0));
+	std::vector<int> keys = randomInts(INT_ELEMS);
+	std::vector<int> queries = randomInts(INT_ELEMS);
+	std::vector<int> batch = randomInts(INSERT_BATCH);
+
+	ShardedOrderedSet<Engine> set(2 * threads, threads, std::vector<int>(keys.begin(), keys.begin() + 4096));
+	set.insertBatch(keys);
+
+	for(auto x : state) {
+		benchmark::DoNotOptimize(set.containsBatch(queries));
+		size_t added = set.insertBatch(batch);
+		benchmark::DoNotOptimize(added);
+		set.removeBatch(batch);
+	}
+
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(queries.size() + 2 * batch.size()));
+}
+
+// Single operations from state.threads() benchmark threads on one shared set.
+template<class Engine>
+static void concurrentSearchOnShardedSet(benchmark::State& state) {
+	static ShardedOrderedSet<Engine>* set = nullptr;
+	static std::vector<int> queries;
+
+	if (state.thread_index() == 0) {
+		std::vector<int> keys = randomInts(INT_ELEMS);
+
+		set = new ShardedOrderedSet<Engine>(16, 1, std::vector<int>(keys.begin(), keys.begin() + 4096));
+		set->insertBatch(keys);
+		queries = randomInts(INT_ELEMS / 4);
+	}
+
+	size_t next = static_cast<size_t>(state.thread_index()) * 7919;
+
+	for(auto x : state) {
+		int query = queries[next++ % queries.size()];
+
+		if (next % 16 == 0)
+			set->insert(query);
+		else
+			benchmark::DoNotOptimize(set->contains(query));
+	}
+
+	state.SetItemsProcessed(state.iterations());
+
+	if (state.thread_index() == 0) {
+		delete set;
+		set = nullptr;
+	}
+}
+
+// Deletes the whole dictionary in random order: unlinking every node at once
+// or marking tombstones that compactions free in bulk.
+static void latencyRemoveOnSkipList(benchmark::State& state) {
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+	std::shuffle(words.begin(), words.end(), std::mt19937(42));
+	Histogram histogram;
+
+	for(auto x : state) {
 		SkipList<std::string, 12> toLoad;
+		toLoad.insertBatch(words);
 
-		for(int i = 0; i < ELEMS; ++i){
-			std::string word;
-			inFile >> word;
-			if (inFile.eof()) break;
+		timeOperations(histogram, words.size(), state.range(0), [&](size_t i) { toLoad.removeElement(words[i]); });
+	}
 
-			toLoad.insert(word);
+	reportLatencies(state, histogram);
+}
+
+static void latencyMarkRemovedOnSkipList(benchmark::State& state) {
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+	std::shuffle(words.begin(), words.end(), std::mt19937(42));
+	Histogram histogram;
+
+	for(auto x : state) {
+		SkipList<std::string, 12> toLoad;
+		toLoad.insertBatch(words);
+
+		timeOperations(histogram, words.size(), state.range(0), [&](size_t i) { toLoad.markRemoved(words[i]); });
+	}
+
+	reportLatencies(state, histogram);
+}
+
+// Delete-heavy mix on a loaded tree: two removals of existing keys for every push of a new one,
+// until the tree is empty, with the AVL or the weak AVL balance policy.
+template<class Balance>
+static void deleteHeavyOnAVL(benchmark::State& state) {
+	std::vector<int> keys = randomInts(INT_ELEMS);
+	std::vector<int> fresh = randomInts(INT_ELEMS / 2);
+	std::vector<int> order(keys);
+	std::shuffle(order.begin(), order.end(), std::mt19937(7));
+
+	for(auto x : state) {
+		state.PauseTiming();
+		AVLTree<int, Balance> tree;
+		for (int elem : keys)
+			tree.push(elem);
+		state.ResumeTiming();
+
+		size_t next = 0;
+
+		for (int elem : fresh) {
+			tree.removeElement(order[next++]);
+			tree.removeElement(order[next++]);
+			tree.push(elem);
 		}
 
-		for (size_t i = 0; i < 1000000; i++)
-			benchmark::DoNotOptimize(toLoad.containsElement(gen_random(12)));
+		benchmark::DoNotOptimize(tree.getHeight());
+
+		state.PauseTiming();
+		tree = AVLTree<int, Balance>();
+		state.ResumeTiming();
 	}
+
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(fresh.size() * 3));
 }
 
-static void searchHardOnAVL(benchmark::State& state) {
-	for(auto x : state){
-		std::ifstream inFile("oxford-diff.txt");
+// Oxford vs Harry vocabulary: state.range(0) selects union / intersection / difference.
+static void setOperationsOnAVL(benchmark::State& state) {
+	AVLTree<std::string> oxford, harry;
 
-		AVLTree<std::string> toLoad;
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		oxford.push(word);
 
-		for(int i = 0; i < ELEMS; ++i){
-			std::string word;
-			inFile >> word;
-			if (inFile.eof()) break;
+	for (const std::string& word : readWords("harry.txt"))
+		harry.push(word);
 
-			toLoad.push(word);
-		}
+	for(auto x : state) {
+		state.PauseTiming();
+		AVLTree<std::string> result(oxford);
+		AVLTree<std::string> other(harry);
+		state.ResumeTiming();
+
+		if (state.range(0) == 0)
+			result.unionWith(std::move(other));
+		else if (state.range(0) == 1)
+			result.intersect(std::move(other));
+		else
+			result.difference(std::move(other));
+
+		benchmark::DoNotOptimize(result.getNodesCount());
+	}
+}
+
+// A read snapshot followed by a few updates, as taken for consistent reporting.
+static void snapshotOnAVL(benchmark::State& state) {
+	AVLTree<std::string> toLoad;
 
-		for (size_t i = 0; i < 1000000; i++)
-			benchmark::DoNotOptimize(toLoad.exists(gen_random(12)));
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		toLoad.push(word);
+
+	for(auto x : state) {
+		AVLTree<std::string> snapshot(toLoad);
+		toLoad.push(gen_random(12));
+		benchmark::DoNotOptimize(snapshot.getNodesCount());
 	}
 }
 
-static void searchHarryOnSkipList(benchmark::State& state) {
-	for(auto x : state){
-		std::ifstream inFile("oxford-diff.txt");
+static void snapshotOnPersistentAVL(benchmark::State& state) {
+	PersistentAVLTree<std::string> toLoad;
+
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		toLoad.push(word);
+
+	for(auto x : state) {
+		PersistentAVLTree<std::string> snapshot = toLoad.snapshot();
+		toLoad.push(gen_random(12));
+		benchmark::DoNotOptimize(snapshot.getNodesCount());
+	}
+}
+
+// oxford-diff.txt is sorted, so every insert lands right after the previous one.
+static void loadOxfordOnSkipListWithFinger(benchmark::State& state) {
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+
+	for(auto x : state) {
 		SkipList<std::string, 12> toLoad;
+		SkipList<std::string, 12>::Finger finger = toLoad.finger();
 
-		// Init with oxford
-		for(int i = 0; i < ELEMS; ++i){
-			std::string word;
-			inFile >> word;
-			if (inFile.eof()) break;
-			toLoad.insert(word);
-		}
+		for (const std::string& word : words)
+			toLoad.insert(word, finger);
+	}
+}
 
-		std::vector<std::string> c;
+static void searchSortedOnSkipList(benchmark::State& state) {
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+	SkipList<std::string, 12> toLoad;
 
-		std::ifstream harry("harry.txt");
-		// Init with harry
-		for(int i = 0; i < ELEMS; ++i){
-			std::string word;
-			harry >> word;
-			if (harry.eof())
-				break;
+	for (const std::string& word : words)
+		toLoad.insert(word);
 
-			c.push_back(word);
-		}
-		for (size_t i = 0; i < c.size(); i++)
-			benchmark::DoNotOptimize(toLoad.containsElement(c[i]));
+	for(auto x : state) {
+		for (const std::string& word : words)
+			benchmark::DoNotOptimize(toLoad.containsElement(word));
 	}
 }
 
-static void searchHarryOnAVL(benchmark::State& state) {
+static void searchSortedOnSkipListWithFinger(benchmark::State& state) {
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+	SkipList<std::string, 12> toLoad;
+
+	for (const std::string& word : words)
+		toLoad.insert(word);
+
 	for(auto x : state) {
-		std::ifstream inFile("oxford-diff.txt");
-		AVLTree<std::string> toLoad;
+		SkipList<std::string, 12>::Finger finger = toLoad.finger();
 
-		// Init with oxford
-		for(int i = 0; i < ELEMS; ++i){
-			std::string word;
-			inFile >> word;
-			if (inFile.eof()) break;
-			toLoad.push(word);
-		}
+		for (const std::string& word : words)
+			benchmark::DoNotOptimize(toLoad.containsElement(word, finger));
+	}
+}
 
-		std::vector<std::string> c;
+// Random 12-char strings almost never hit. state.range(0) == 1 attaches a 1% Bloom filter.
+static void searchMissesOnSkipList(benchmark::State& state) {
+	std::vector<std::string> queries;
+	for (size_t i = 0; i < 100000; i++)
+		queries.push_back(gen_random(12));
 
-		std::ifstream harry("harry.txt");
-		
-		// Init with harry
-		for(int i = 0; i < ELEMS; ++i){
-			std::string word;
-			harry >> word;
-			if (harry.eof())
-				break;
+	SkipList<std::string, 12> toLoad;
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		toLoad.insert(word);
 
-			c.push_back(word);
-		}
+	if (state.range(0))
+		toLoad.enableBloomFilter(ELEMS, 0.01);
 
-		for (size_t i = 0; i < c.size(); i++)
-			benchmark::DoNotOptimize(toLoad.exists(c[i]));
-		}
+	for(auto x : state) {
+		for (const std::string& query : queries)
+			benchmark::DoNotOptimize(toLoad.containsElement(query));
+	}
+
+	state.counters["misses"] = benchmark::Counter(static_cast<double>(state.iterations() * queries.size()), benchmark::Counter::kIsRate);
 }
 
-BENCHMARK(loadOxdfordOnSkipList);
-BENCHMARK(loadOxdfordOnAVL);
-BENCHMARK(searchHardOnSkipList);
-BENCHMARK(searchHardOnAVL);
-BENCHMARK(searchHarryOnSkipList);
-BENCHMARK(searchHarryOnAVL);
+static void searchMissesOnAVL(benchmark::State& state) {
+	std::vector<std::string> queries;
+	for (size_t i = 0; i < 100000; i++)
+		queries.push_back(gen_random(12));
+
+	AVLTree<std::string> toLoad;
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		toLoad.push(word);
+
+	if (state.range(0))
+		toLoad.enableBloomFilter(ELEMS, 0.01);
+
+	for(auto x : state) {
+		for (const std::string& query : queries)
+			benchmark::DoNotOptimize(toLoad.exists(query));
+	}
+
+	state.counters["misses"] = benchmark::Counter(static_cast<double>(state.iterations() * queries.size()), benchmark::Counter::kIsRate);
+}
+
+// Same as searchHarry<Engine>, but the keys live in the structure's string arena.
+static void searchHarryOnInternedSkipList(benchmark::State& state) {
+	std::vector<std::string> harry = readWords("harry.txt");
+	InternedSkipList<12> toLoad;
+
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		toLoad.insert(word);
+
+	for(auto x : state) {
+		for (const std::string& word : harry)
+			benchmark::DoNotOptimize(toLoad.containsElement(word));
+	}
+
+	state.counters["key_bytes"] = static_cast<double>(toLoad.keyArena().reservedBytes());
+}
+
+static void searchHarryOnInternedAVL(benchmark::State& state) {
+	std::vector<std::string> harry = readWords("harry.txt");
+	InternedAVLTree toLoad;
+
+	for (const std::string& word : readWords("oxford-diff.txt"))
+		toLoad.push(word);
+
+	for(auto x : state) {
+		for (const std::string& word : harry)
+			benchmark::DoNotOptimize(toLoad.exists(word));
+	}
+
+	state.counters["key_bytes"] = static_cast<double>(toLoad.keyArena().reservedBytes());
+}
+
+static void loadOxfordOnInternedSkipList(benchmark::State& state) {
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+
+	for(auto x : state) {
+		InternedSkipList<12> toLoad;
+
+		for (const std::string& word : words)
+			toLoad.insert(word);
+	}
+}
+
+static void loadOxfordOnInternedAVL(benchmark::State& state) {
+	std::vector<std::string> words = readWords("oxford-diff.txt");
+
+	for(auto x : state) {
+		InternedAVLTree toLoad;
+
+		for (const std::string& word : words)
+			toLoad.push(word);
+	}
+}
 
-BENCHMARK_MAIN();
\ No newline at end of file
+// Every engine, once with string keys and once with int keys.
+using WordSkipList = SkipList<std::string, 12>;
+using IntSkipList = SkipList<int, 20>;
+using WordAVL = AVLTree<std::string>;
+using IntAVL = AVLTree<int>;
+using WordWAVL = AVLTree<std::string, WAVLBalance>;
+using IntWAVL = AVLTree<int, WAVLBalance>;
+using WordCompactAVL = CompactAVLTree<std::string>;
+using IntCompactAVL = CompactAVLTree<int>;
+using WordSplayTree = SplayTree<std::string>;
+using IntSplayTree = SplayTree<int>;
+using WordDeterministicSkipList = DeterministicSkipList<std::string>;
+using IntDeterministicSkipList = DeterministicSkipList<int>;
+using WordUnrolledSkipList = UnrolledSkipList<std::string>;
+using IntUnrolledSkipList = UnrolledSkipList<int, 16, 20>;
+
+#define ORDERED_SET_BENCHMARKS(Words, Ints) \
+	BENCHMARK_TEMPLATE(loadOxford, Words); \
+	BENCHMARK_TEMPLATE(searchHarry, Words); \
+	BENCHMARK_TEMPLATE(searchHard, Words); \
+	BENCHMARK_TEMPLATE(deleteOxford, Words); \
+	BENCHMARK_TEMPLATE(scanOxford, Words); \
+	BENCHMARK_TEMPLATE(searchInts, Ints); \
+	BENCHMARK_TEMPLATE(latencyInsert, Words)->Arg(1)->Arg(16); \
+	BENCHMARK_TEMPLATE(latencySearchHarry, Words)->Arg(1)->Arg(16); \
+	BENCHMARK_TEMPLATE(latencySearchHard, Words)->Arg(1)->Arg(16)
+
+ORDERED_SET_BENCHMARKS(WordSkipList, IntSkipList);
+ORDERED_SET_BENCHMARKS(WordAVL, IntAVL);
+ORDERED_SET_BENCHMARKS(WordWAVL, IntWAVL);
+ORDERED_SET_BENCHMARKS(WordCompactAVL, IntCompactAVL);
+ORDERED_SET_BENCHMARKS(WordSplayTree, IntSplayTree);
+ORDERED_SET_BENCHMARKS(WordDeterministicSkipList, IntDeterministicSkipList);
+ORDERED_SET_BENCHMARKS(WordUnrolledSkipList, IntUnrolledSkipList);
+BENCHMARK_TEMPLATE(searchIntsWithHugePages, IntAVL)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(searchIntsWithHugePages, IntSkipList)->Arg(0)->Arg(1);
+
+BENCHMARK(loadOxfordOnSkipListWithFinger);
+BENCHMARK(searchSortedOnSkipList);
+BENCHMARK(searchSortedOnSkipListWithFinger);
+
+BENCHMARK(searchMissesOnSkipList)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(searchHarryOnSkipListWithPromotion, HalfPromotion);
+BENCHMARK_TEMPLATE(searchHarryOnSkipListWithPromotion, InverseEPromotion);
+BENCHMARK_TEMPLATE(searchHarryOnSkipListWithPromotion, QuarterPromotion);
+BENCHMARK_TEMPLATE(searchHarryOnSkipListWithPromotion, RationalPromotion<1, 8>);
+BENCHMARK(searchMissesOnAVL)->Arg(0)->Arg(1);
+
+BENCHMARK(loadOxfordOnInternedSkipList);
+BENCHMARK(loadOxfordOnInternedAVL);
+BENCHMARK(searchHarryOnInternedSkipList);
+BENCHMARK(searchHarryOnInternedAVL);
+
+BENCHMARK(copyIntsOnAVL);
+BENCHMARK(copyIntsOnCompactAVL);
+BENCHMARK(searchHarryOnFrozenSet);
+BENCHMARK(searchIntsOnFrozenSet);
+BENCHMARK(searchIntsOnAVLOfRecords);
+BENCHMARK(searchIntsOnAVLMap);
+BENCHMARK(searchIntsOnSkipListOfRecords);
+BENCHMARK(searchIntsOnSkipListMap);
+BENCHMARK(countWordsOnSkipList);
+BENCHMARK(countWordsOnCountedSkipList);
+BENCHMARK(countWordsOnCountedAVL);
+BENCHMARK(ingestOnSkipList);
+BENCHMARK(ingestBatchesOnSkipList);
+BENCHMARK(ingestOnAVL);
+BENCHMARK(ingestBatchesOnAVL);
+BENCHMARK_TEMPLATE(deleteHeavyOnAVL, AVLBalance);
+BENCHMARK_TEMPLATE(deleteHeavyOnAVL, WAVLBalance);
+BENCHMARK_TEMPLATE(mixedBatchesOnShardedSet, AVLTree<int>)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+BENCHMARK_TEMPLATE(mixedBatchesOnShardedSet, SkipList<int, 20>)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+BENCHMARK_TEMPLATE(concurrentSearchOnShardedSet, AVLTree<int>)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(concurrentSearchOnShardedSet, SkipList<int, 20>)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK(setOperationsOnAVL)->Arg(0)->Arg(1)->Arg(2);
+BENCHMARK(snapshotOnAVL);
+BENCHMARK(snapshotOnPersistentAVL);
+
+BENCHMARK(latencyRemoveOnSkipList)->Arg(1)->Arg(16);
+BENCHMARK(latencyMarkRemovedOnSkipList)->Arg(1)->Arg(16);
+
+// BENCHMARK_MAIN, then the zones of the matrix go to profile.json.
+int main(int argc, char** argv) {
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+
+	std::ofstream profile("profile.json");
+	profiler::Profiler::instance().dumpJson(profile);
+
+	return 0;
+}
\ No newline at end of file
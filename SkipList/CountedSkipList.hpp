@@ -0,0 +1,96 @@
+#ifndef COUNTED_SKIP_LIST_HEADER_
+#define COUNTED_SKIP_LIST_HEADER_
+#include<cstddef>
+#include"SkipList.hpp"
+#include"../Common/CountedEntry.hpp"
+
+/*
+* Multiset on top of SkipList that keeps one node per distinct key with an occurrence count.
+*
+* SkipList::insert links a new tower for every duplicate. Here a repeated insert
+* finds the node and bumps its count, so skewed inputs (word counts, where a few
+* words are most of the text) allocate once per distinct word.
+* insert, count and decrement are O(log n) expected.
+*/
+
+template<class T, unsigned maxLevel = 12>
+class CountedSkipList {
+private:
+	using Entry = CountedEntry<T>;
+
+	SkipList<Entry, maxLevel> entries;
+	size_t total = 0;
+
+public:
+	using ConstIterator = typename SkipList<Entry, maxLevel>::ConstIterator;
+
+	// Returns the number of occurrences of elem after the insert.
+	size_t insert(const T& elem) {
+		++total;
+
+		size_t occurrences = 0;
+		if (entries.update(elem, [&occurrences](Entry& entry) { occurrences = ++entry.count; }))
+			return occurrences;
+
+		entries.insert(Entry(elem, 1));
+		return 1;
+	}
+
+	size_t count(const T& elem) const {
+		const Entry* entry = entries.find(elem);
+		return entry ? entry->count : 0;
+	}
+
+	// Removes one occurrence of elem, and its node with the last one. False if elem is not there.
+	bool decrement(const T& elem) {
+		size_t occurrences = 0;
+
+		if (!entries.update(elem, [&occurrences](Entry& entry) { occurrences = --entry.count; }))
+			return false;
+
+		--total;
+
+		if (occurrences == 0)
+			entries.removeElement(Entry(elem, 0));
+
+		return true;
+	}
+
+	// Removes every occurrence of elem. Returns how many there were.
+	size_t removeAll(const T& elem) {
+		const Entry* entry = entries.find(elem);
+
+		if (!entry)
+			return 0;
+
+		size_t removed = entry->count;
+		total -= removed;
+		entries.removeElement(Entry(elem, 0));
+
+		return removed;
+	}
+
+	// Occurrences of all keys.
+	size_t size() const {
+		return total;
+	}
+
+	size_t distinctCount() const {
+		return entries.elementsCount();
+	}
+
+	bool empty() const {
+		return total == 0;
+	}
+
+	// Iterates the distinct keys in order: entry.key and entry.count.
+	ConstIterator begin() const {
+		return entries.begin();
+	}
+
+	ConstIterator end() const {
+		return entries.end();
+	}
+};
+
+#endif // !COUNTED_SKIP_LIST_HEADER_
@@ -0,0 +1,540 @@
+/*
+* Deterministic 1-2-3 skip list (Munro, Papadakis, Sedgewick).
+*
+* Instead of flipping coins, the list keeps every gap between two neighbouring nodes of level h+1
+* at 1, 2 or 3 nodes of level h. A search makes at most 3 steps to the right on every level
+* and there are at most log2(n) + 1 levels, so the worst case of a search is O(log n)
+* and does not depend on luck.
+*
+* Conventions:
+*
+* Every level is a singly linked list of its own nodes.
+* A node of level h+1 points down to the first node of its gap in level h and holds the greatest key of the gap,
+* so its gap ends with the node of level h that has the same key. The last node of every level is "infinite",
+* which plays the role of nullptr in SkipList: it is greater than any other value.
+*
+* Insertion and removal are top-down and make one pass:
+* on the way down insertion splits every full gap (promotion of its middle node) so the gap below always has room,
+* and removal fills every gap of 1 by borrowing a node from a neighbouring gap or merging with it (demotion),
+* so a node can always be removed at the bottom without breaking the gaps above it.
+*
+* Unlike SkipList this is a set: inserting a value that is already there does nothing.
+*/
+
+#ifndef DETERMINISTIC_SKIP_LIST_HEADER_
+#define DETERMINISTIC_SKIP_LIST_HEADER_
+#include<cstddef>
+#include<stdexcept>
+#include<utility>
+#include<vector>
+#include"../Common/OrderedSet.hpp"
+
+template<class T>
+class DeterministicSkipList {
+private:
+	struct Node {
+		T key;
+		bool infinite;
+		Node* right;
+		Node* down;
+
+		Node(const T& key, bool infinite, Node* right, Node* down) : key(key), infinite(infinite), right(right), down(down) {}
+	};
+
+	// nullptr when the list is empty. Otherwise the only node of the top level, never a bottom node.
+	Node* head;
+	size_t size;
+	unsigned height;
+
+	static bool less(const Node* node, const T& elem) {
+		return !node->infinite && node->key < elem;
+	}
+
+	static bool holds(const Node* node, const T& elem) {
+		return !node->infinite && node->key == elem;
+	}
+
+	static bool isLastOfGap(const Node* child, const Node* parent) {
+		if (child->infinite || parent->infinite)
+			return child->infinite && parent->infinite;
+
+		return child->key == parent->key;
+	}
+
+	// Every gap has at least 2 nodes, except the one under a head with 2 children.
+	static bool hasTwoChildren(const Node* parent) {
+		return isLastOfGap(parent->down->right, parent);
+	}
+
+	static bool hasFourChildren(const Node* parent) {
+		const Node* second = parent->down->right;
+		return !isLastOfGap(second, parent) && !isLastOfGap(second->right, parent);
+	}
+
+	static void copyContent(Node* to, const Node* from) {
+		to->key = from->key;
+		to->infinite = from->infinite;
+		to->right = from->right;
+		to->down = from->down;
+	}
+
+	void splitGap(Node* parent);
+	void fillGap(Node* parent, Node*& child, Node* previous);
+	void collapseHead();
+
+	void free();
+	void copyFrom(const DeterministicSkipList&);
+
+public:
+	class ConstIterator {
+	private:
+		const Node* current;
+
+		ConstIterator(const Node* start) : current(start) {}
+	public:
+		bool operator==(const ConstIterator& other) const { return current == other.current; }
+
+		bool operator!=(const ConstIterator& other) const { return !(this->operator==(other)); }
+
+		ConstIterator& operator++() {
+			current = current->right;
+			if (current && current->infinite)
+				current = nullptr;
+
+			return *this;
+		}
+
+		ConstIterator operator++(int) {
+			ConstIterator temp = *this;
+			++*this;
+			return temp;
+		}
+
+		const T& operator*() const {
+			if (!current)
+				throw std::runtime_error("Reached end of collection!");
+
+			return current->key;
+		}
+
+		friend class DeterministicSkipList;
+	};
+
+	DeterministicSkipList();
+
+	DeterministicSkipList(const DeterministicSkipList&);
+	DeterministicSkipList(DeterministicSkipList&&) noexcept;
+
+	DeterministicSkipList& operator=(const DeterministicSkipList& other);
+	DeterministicSkipList& operator=(DeterministicSkipList&&) noexcept;
+
+	// Returns false if elem is already in the list.
+	bool insert(const T& elem);
+
+	bool containsElement(const T& elem) const;
+
+	bool removeElement(const T& elem);
+
+	size_t elementsCount() const;
+
+	bool empty() const;
+
+	// Number of levels, the bottom one included. At most log2(n) + 1.
+	unsigned getHeight() const;
+
+	// Element k is the number of gaps, over all the levels, with k nodes of the level below
+	// between a node and the one before it. Only elements 1, 2 and 3 are ever non-zero.
+	std::vector<size_t> gapHistogram() const;
+
+	ConstIterator begin() const;
+
+	ConstIterator end() const;
+
+	~DeterministicSkipList();
+};
+
+template<class T>
+DeterministicSkipList<T>::DeterministicSkipList() : head(nullptr), size(0), height(0) {}
+
+template<class T>
+DeterministicSkipList<T>::DeterministicSkipList(const DeterministicSkipList& other) : head(nullptr), size(0), height(0) {
+	copyFrom(other);
+}
+
+template<class T>
+DeterministicSkipList<T>::DeterministicSkipList(DeterministicSkipList&& other) noexcept : head(other.head), size(other.size), height(other.height) {
+	other.head = nullptr;
+	other.size = 0;
+	other.height = 0;
+}
+
+template<class T>
+DeterministicSkipList<T>& DeterministicSkipList<T>::operator=(const DeterministicSkipList& other) {
+	if (this != &other) {
+		free();
+		copyFrom(other);
+	}
+
+	return *this;
+}
+
+template<class T>
+DeterministicSkipList<T>& DeterministicSkipList<T>::operator=(DeterministicSkipList&& other) noexcept {
+	if (this != &other) {
+		free();
+
+		head = other.head;
+		size = other.size;
+		height = other.height;
+
+		other.head = nullptr;
+		other.size = 0;
+		other.height = 0;
+	}
+
+	return *this;
+}
+
+template<class T>
+DeterministicSkipList<T>::~DeterministicSkipList() {
+	free();
+}
+
+template<class T>
+void DeterministicSkipList<T>::free() {
+	Node* levelStart = head;
+
+	while (levelStart) {
+		Node* next = levelStart->down;
+		Node* it = levelStart;
+
+		while (it) {
+			Node* toDelete = it;
+			it = it->right;
+			delete toDelete;
+		}
+
+		levelStart = next;
+	}
+
+	head = nullptr;
+	size = 0;
+	height = 0;
+}
+
+// Copies the levels bottom-up. The down pointers of a level are increasing,
+// so they are mapped by walking the old and the new level below side by side.
+template<class T>
+void DeterministicSkipList<T>::copyFrom(const DeterministicSkipList& other) {
+	if (!other.head)
+		return;
+
+	std::vector<const Node*> levelStarts;
+	for (const Node* it = other.head; it; it = it->down)
+		levelStarts.push_back(it);
+
+	Node* below = nullptr;
+
+	for (size_t i = levelStarts.size(); i-- > 0;) {
+		const Node* oldBelow = (i + 1 < levelStarts.size()) ? levelStarts[i + 1] : nullptr;
+		Node* newBelow = below;
+
+		Node* first = nullptr;
+		Node* last = nullptr;
+
+		for (const Node* it = levelStarts[i]; it; it = it->right) {
+			Node* down = nullptr;
+
+			if (it->down) {
+				while (oldBelow != it->down) {
+					oldBelow = oldBelow->right;
+					newBelow = newBelow->right;
+				}
+
+				down = newBelow;
+			}
+
+			Node* copy = new Node(it->key, it->infinite, nullptr, down);
+
+			if (last)
+				last->right = copy;
+			else
+				first = copy;
+
+			last = copy;
+		}
+
+		below = first;
+	}
+
+	head = below;
+	size = other.size;
+	height = other.height;
+}
+
+// parent has 4 children: promote the second one. parent keeps the first two children
+// and a new node after it takes the other two, so pointers to parent stay valid.
+template<class T>
+void DeterministicSkipList<T>::splitGap(Node* parent) {
+	Node* second = parent->down->right;
+
+	Node* newNode = new Node(parent->key, parent->infinite, parent->right, second->right);
+
+	parent->key = second->key;
+	parent->infinite = false;
+	parent->right = newNode;
+
+	if (parent == head) {
+		head = new Node(newNode->key, true, nullptr, parent);
+		++height;
+	}
+}
+
+// child is a node of parent's gap with only 2 children, previous is the node before it in the gap (or nullptr).
+// Borrows a child from a neighbour with 3 or 4 children, or merges with a neighbour with 2 (demoting their separator).
+// child is set to the node that now holds its children.
+template<class T>
+void DeterministicSkipList<T>::fillGap(Node* parent, Node*& child, Node* previous) {
+	if (!isLastOfGap(child, parent)) {
+		Node* next = child->right;
+
+		if (!hasTwoChildren(next)) {
+			// The separator moves one node to the right.
+			child->key = next->down->key;
+			next->down = next->down->right;
+			return;
+		}
+
+		// next is never the first node of a gap, so nothing else points to it.
+		child->key = next->key;
+		child->infinite = next->infinite;
+		child->right = next->right;
+		delete next;
+		return;
+	}
+
+	// child is the last node of the gap, so previous exists.
+	if (!hasTwoChildren(previous)) {
+		// The separator moves one node to the left.
+		Node* beforeLast = previous->down;
+		while (!isLastOfGap(beforeLast->right, previous))
+			beforeLast = beforeLast->right;
+
+		child->down = beforeLast->right;
+		previous->key = beforeLast->key;
+		return;
+	}
+
+	previous->key = child->key;
+	previous->infinite = child->infinite;
+	previous->right = child->right;
+	delete child;
+	child = previous;
+}
+
+// The head has a single child: that child becomes the head.
+template<class T>
+void DeterministicSkipList<T>::collapseHead() {
+	Node* oldHead = head;
+	head = head->down;
+	delete oldHead;
+	--height;
+
+	// Only the infinite bottom node is left.
+	if (!head->down) {
+		delete head;
+		head = nullptr;
+		height = 0;
+	}
+}
+
+template<class T>
+bool DeterministicSkipList<T>::insert(const T& elem) {
+	if (!head) {
+		Node* last = new Node(elem, true, nullptr, nullptr);
+		Node* first = new Node(elem, false, last, nullptr);
+
+		head = new Node(elem, true, nullptr, first);
+		height = 2;
+		size = 1;
+
+		return true;
+	}
+
+	Node* it = head;
+
+	while (true) {
+		if (hasFourChildren(it)) {
+			splitGap(it);
+
+			if (less(it, elem))
+				it = it->right;
+		}
+
+		Node* child = it->down;
+		while (less(child, elem))
+			child = child->right;
+
+		if (child->down) {
+			it = child;
+			continue;
+		}
+
+		if (holds(child, elem))
+			return false;
+
+		// Insert before child by moving it one node to the right, so the pointers to child stay valid.
+		child->right = new Node(child->key, child->infinite, child->right, nullptr);
+		child->key = elem;
+		child->infinite = false;
+
+		++size;
+		return true;
+	}
+}
+
+template<class T>
+bool DeterministicSkipList<T>::containsElement(const T& elem) const {
+	if (!head)
+		return false;
+
+	const Node* it = head;
+
+	while (it->down) {
+		it = it->down;
+
+		while (less(it, elem))
+			it = it->right;
+	}
+
+	return holds(it, elem);
+}
+
+template<class T>
+bool DeterministicSkipList<T>::removeElement(const T& elem) {
+	if (!containsElement(elem))
+		return false;
+
+	// Nodes above the bottom whose key is elem. They take the key of its predecessor at the end.
+	std::vector<Node*> separators;
+
+	Node* it = head;
+
+	while (true) {
+		Node* previous = nullptr;
+		Node* child = it->down;
+
+		while (less(child, elem)) {
+			previous = child;
+			child = child->right;
+		}
+
+		if (!child->down) {
+			if (!isLastOfGap(child, it)) {
+				// Remove child by moving the next node of the gap into it.
+				Node* next = child->right;
+				copyContent(child, next);
+				delete next;
+			}
+			else {
+				previous->right = child->right;
+				delete child;
+
+				for (Node* separator : separators)
+					separator->key = previous->key;
+			}
+
+			if (it == head && isLastOfGap(head->down, head))
+				collapseHead();
+
+			--size;
+			return true;
+		}
+
+		if (hasTwoChildren(child)) {
+			fillGap(it, child, previous);
+
+			if (it == head && isLastOfGap(head->down, head)) {
+				collapseHead();
+				it = head;
+				continue;
+			}
+		}
+
+		if (holds(child, elem))
+			separators.push_back(child);
+
+		it = child;
+	}
+}
+
+template<class T>
+size_t DeterministicSkipList<T>::elementsCount() const {
+	return size;
+}
+
+template<class T>
+bool DeterministicSkipList<T>::empty() const {
+	return head == nullptr;
+}
+
+template<class T>
+unsigned DeterministicSkipList<T>::getHeight() const {
+	return height;
+}
+
+template<class T>
+std::vector<size_t> DeterministicSkipList<T>::gapHistogram() const {
+	std::vector<size_t> histogram;
+
+	for (const Node* levelStart = head; levelStart && levelStart->down; levelStart = levelStart->down) {
+		for (const Node* it = levelStart; it; it = it->right) {
+			// The gap ends with the child that has the same key as it.
+			size_t nodes = 0;
+			for (const Node* child = it->down; !isLastOfGap(child, it); child = child->right)
+				++nodes;
+
+			if (histogram.size() <= nodes)
+				histogram.resize(nodes + 1, 0);
+
+			++histogram[nodes];
+		}
+	}
+
+	return histogram;
+}
+
+template<class T>
+typename DeterministicSkipList<T>::ConstIterator DeterministicSkipList<T>::begin() const {
+	if (!head)
+		return ConstIterator(nullptr);
+
+	const Node* it = head;
+	while (it->down)
+		it = it->down;
+
+	return ConstIterator(it->infinite ? nullptr : it);
+}
+
+template<class T>
+typename DeterministicSkipList<T>::ConstIterator DeterministicSkipList<T>::end() const {
+	return ConstIterator(nullptr);
+}
+
+template<class T>
+struct OrderedSetTraits<DeterministicSkipList<T>> {
+	using ValueType = T;
+	using Engine = DeterministicSkipList<T>;
+
+	static constexpr bool uniqueKeys = true;
+
+	static bool insert(Engine& engine, const T& elem) { return engine.insert(elem); }
+
+	static bool contains(const Engine& engine, const T& elem) { return engine.containsElement(elem); }
+
+	static bool remove(Engine& engine, const T& elem) { return engine.removeElement(elem); }
+
+	static size_t size(const Engine& engine) { return engine.elementsCount(); }
+};
+
+#endif // !DETERMINISTIC_SKIP_LIST_HEADER_
@@ -0,0 +1,103 @@
+#ifndef INTERNED_SKIP_LIST_HEADER_
+#define INTERNED_SKIP_LIST_HEADER_
+#include"SkipList.hpp"
+#include"../Common/StringArena.hpp"
+
+/*
+* Skip list of strings whose bytes live in a per-list StringArena.
+* The nodes hold 16-byte ArenaString handles instead of std::string.
+* Lookups wrap the caller's string_view in a handle, so they never copy or allocate.
+*
+* Like SkipList this is a multiset: every inserted copy stores its own bytes.
+* The arena is compacted when removals leave more dead than live bytes.
+*/
+
+template<unsigned maxLevel = 12>
+class InternedSkipList {
+private:
+	StringArena arena;
+	SkipList<ArenaString, maxLevel> list;
+
+	void compactIfNeeded() {
+		if (arena.needsCompaction())
+			arena.compact(list);
+	}
+
+public:
+	using ConstIterator = typename SkipList<ArenaString, maxLevel>::ConstIterator;
+
+	InternedSkipList() = default;
+
+	InternedSkipList(const InternedSkipList& other) : list(other.list) {
+		arena.compact(list);
+	}
+
+	InternedSkipList(InternedSkipList&&) noexcept = default;
+
+	InternedSkipList& operator=(const InternedSkipList& other) {
+		if (this != &other) {
+			InternedSkipList temp(other);
+			*this = std::move(temp);
+		}
+
+		return *this;
+	}
+
+	InternedSkipList& operator=(InternedSkipList&&) noexcept = default;
+
+	void insert(std::string_view elem) {
+		list.insert(arena.store(elem));
+	}
+
+	bool containsElement(std::string_view elem) const {
+		return list.containsElement(ArenaString(elem));
+	}
+
+	bool removeElement(std::string_view elem) {
+		if (!list.removeElement(ArenaString(elem)))
+			return false;
+
+		arena.release(ArenaString(elem));
+		compactIfNeeded();
+		return true;
+	}
+
+	size_t eraseAll(std::string_view elem) {
+		size_t removed = list.eraseAll(ArenaString(elem));
+
+		for (size_t i = 0; i < removed; i++)
+			arena.release(ArenaString(elem));
+
+		if (removed)
+			compactIfNeeded();
+
+		return removed;
+	}
+
+	// Copies the live keys next to each other in list order.
+	void compact() {
+		arena.compact(list);
+	}
+
+	size_t elementsCount() const {
+		return list.elementsCount();
+	}
+
+	bool empty() const {
+		return list.empty();
+	}
+
+	const StringArena& keyArena() const {
+		return arena;
+	}
+
+	ConstIterator begin() const {
+		return list.begin();
+	}
+
+	ConstIterator end() const {
+		return list.end();
+	}
+};
+
+#endif // !INTERNED_SKIP_LIST_HEADER_
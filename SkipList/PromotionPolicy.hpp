@@ -0,0 +1,59 @@
+/*
+* Promotion policies for SkipList.
+*
+* A node reaches level i+1 from level i with probability p = numerator / denominator.
+* Smaller p means shorter towers (1 / (1 - p) pointers per node on average)
+* but more steps per level: a search makes about log_{1/p}(n) / p comparisons.
+* p = 1/e minimizes that product, p = 1/4 is the usual memory saver.
+*
+* recommendedMaxLevel(n) = ceil(log_{1/p}(n)) levels: the level where we expect a single node,
+* so n elements are searched in O(log n) without wasting header pointers.
+* Use it as the maxLevel of the list:
+*
+*	SkipList<T, QuarterPromotion::recommendedMaxLevel(100000), QuarterPromotion>
+*/
+
+#ifndef PROMOTION_POLICY_HEADER_
+#define PROMOTION_POLICY_HEADER_
+#include<cstddef>
+#include<random>
+
+template<unsigned numerator, unsigned denominator>
+struct RationalPromotion {
+	static_assert(0 < numerator && numerator < denominator, "The probability must be in (0, 1)");
+
+	static constexpr double probability() {
+		return static_cast<double>(numerator) / denominator;
+	}
+
+	// Not rand(): with RAND_MAX = 32767 (MSVC) rand() % denominator is always below a numerator
+	// such as 367879 out of 1000000, and every tower would grow to maxLevel.
+	// One generator per thread, so lists used from several threads do not share its state.
+	static bool promote() {
+		static thread_local std::mt19937 generator;
+		std::uniform_int_distribution<unsigned> draw(0, denominator - 1);
+
+		return draw(generator) < numerator;
+	}
+
+	static constexpr unsigned recommendedMaxLevel(size_t expectedSize) {
+		unsigned levels = 1;
+		double reach = static_cast<double>(denominator) / numerator;
+
+		while (reach < static_cast<double>(expectedSize)) {
+			reach *= static_cast<double>(denominator) / numerator;
+			++levels;
+		}
+
+		return levels;
+	}
+};
+
+using HalfPromotion = RationalPromotion<1, 2>;
+
+using QuarterPromotion = RationalPromotion<1, 4>;
+
+// 1/e to six digits.
+using InverseEPromotion = RationalPromotion<367879, 1000000>;
+
+#endif // !PROMOTION_POLICY_HEADER_
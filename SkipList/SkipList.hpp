@@ -8,14 +8,32 @@
 * nullptr is our NIL element, which has value greater than any other.
 *
 * We make NodeBase class so we dont force having T in our header node as T might be "expencive".
+*
+* Promotion decides how likely a node is to reach the next level (see PromotionPolicy.hpp).
+*
+* markRemoved deletes lazily: the node is only flagged dead (a tombstone) and stays linked,
+* so the delete costs one search and no pointer writes or free. Every lookup and iterator
+* skips tombstones. compact() unlinks and frees all of them in one pass over level 0; it runs
+* by itself once the tombstones reach half of the live elements (and at least minTombstones).
+* Every insert, with a finger and in a batch too, brings back an equal tombstone before
+* it links a new node.
 */
 
 #ifndef SKIP_LIST_HEADER_
 #define SKIP_LIST_HEADER_
-#include<iostream>
+#include<cmath>
 #include<stack>
-
-template<class T, unsigned maxLevel = 6>
+#include<stdexcept>
+#include<vector>
+#include"../Common/BatchSort.hpp"
+#include"../Common/BloomFilter.hpp"
+#include"../Common/FrozenSet.hpp"
+#include"../Common/NodeMemory.hpp"
+#include"../Common/OrderedSet.hpp"
+#include"../Common/ShapeReport.hpp"
+#include"PromotionPolicy.hpp"
+
+template<class T, unsigned maxLevel = 6, class Promotion = HalfPromotion>
 class SkipList {
 private:
 	class Node;
@@ -31,7 +49,7 @@ private:
 
 			levels = createWithLevels;
 
-			forward = new Node * [levels];
+			forward = static_cast<Node**>(NodeMemory::allocate(levels * sizeof(Node*)));
 
 			for (size_t i = 0; i < levels; i++)
 				forward[i] = nullptr;
@@ -42,23 +60,50 @@ private:
 
 		~NodeBase() { free(); }
 
+		// Nodes and their forward arrays come from NodeMemory, a huge-page range if one is installed.
+		static void* operator new(size_t bytes) { return NodeMemory::allocate(bytes); }
+
+		static void operator delete(void* block, size_t bytes) { NodeMemory::deallocate(block, bytes); }
+
 	private:
 		void free() {
-			delete[] forward;
+			NodeMemory::deallocate(forward, levels * sizeof(Node*));
 		}
 	};
 
 	class Node : public NodeBase {
 	public:
 		T value;
+		bool dead;
 
-		Node(const T& data, unsigned levels) : NodeBase(levels), value(data) {}
+		Node(const T& data, unsigned levels) : NodeBase(levels), value(data), dead(false) {}
 	};
 
+	// The first live node in the run of nodes equal to key that starts at candidate, nullptr if there is none.
+	template<class Key>
+	static Node* liveMatch(Node* candidate, const Key& key) {
+		while (candidate && candidate->value == key) {
+			if (!candidate->dead)
+				return candidate;
+
+			candidate = candidate->forward[0];
+		}
+
+		return nullptr;
+	}
+
+	template<class NodePointer>
+	static NodePointer skipDead(NodePointer it) {
+		while (it && it->dead)
+			it = it->forward[0];
+
+		return it;
+	}
+
 	static unsigned generateRandomLevel() {
 		int toReturn = 1;
 
-		while (rand() % 2 && toReturn != maxLevel) {
+		while (Promotion::promote() && toReturn != maxLevel) {
 			++toReturn;
 		}
 
@@ -82,6 +127,7 @@ private:
 
 		while (!s.empty()) {
 			Node* toAdd = new Node(s.top()->value, s.top()->levels);
+			toAdd->dead = s.top()->dead;
 
 			toAdd->forward[0] = toReturn;
 			toReturn = toAdd;
@@ -92,107 +138,332 @@ private:
 		return toReturn;
 	}
 public:
+	// Walks level 0 in order, skipping tombstones. compact() invalidates the iterators.
+	class Iterator {
+	private:
+		Node* current;
+
+		Iterator(Node* start) : current(skipDead(start)) {}
+	public:
+		bool operator==(const Iterator& other) const { return current == other.current; }
+
+		bool operator!=(const Iterator& other) const { return !(this->operator==(other)); }
+
+		Iterator& operator++() {
+			current = skipDead(current->forward[0]);
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			Iterator temp = *this;
+			++*this;
+			return temp;
+		}
+
+		// Changing the value must keep the order of the list.
+		T& operator*() {
+			if (!current)
+				throw std::runtime_error("Reached end of collection!");
+
+			return current->value;
+		}
+
+		friend class SkipList;
+	};
+
+	class ConstIterator {
+	private:
+		const Node* current;
+
+		ConstIterator(const Node* start) : current(skipDead(start)) {}
+	public:
+		bool operator==(const ConstIterator& other) const { return current == other.current; }
+
+		bool operator!=(const ConstIterator& other) const { return !(this->operator==(other)); }
+
+		ConstIterator& operator++() {
+			current = skipDead(current->forward[0]);
+			return *this;
+		}
+
+		ConstIterator operator++(int) {
+			ConstIterator temp = *this;
+			++*this;
+			return temp;
+		}
+
+		const T& operator*() const {
+			if (!current)
+				throw std::runtime_error("Reached end of collection!");
+
+			return current->value;
+		}
+
+		friend class SkipList;
+	};
+
+	Iterator begin() { return Iterator(header->forward[0]); }
+
+	ConstIterator begin() const { return ConstIterator(header->forward[0]); }
+
+	ConstIterator cbegin() const { return ConstIterator(header->forward[0]); }
+
+	Iterator end() { return Iterator(nullptr); }
+
+	ConstIterator end() const { return ConstIterator(nullptr); }
+
+	ConstIterator cend() const { return ConstIterator(nullptr); }
+
 	SkipList();
 
-	SkipList(const SkipList<T, maxLevel>&);
-	SkipList(SkipList<T, maxLevel>&&) noexcept;
+	SkipList(const SkipList<T, maxLevel, Promotion>&);
+	SkipList(SkipList<T, maxLevel, Promotion>&&) noexcept;
+
+	SkipList<T, maxLevel, Promotion>& operator=(const SkipList<T, maxLevel, Promotion>& other);
+	SkipList<T, maxLevel, Promotion>& operator=(SkipList<T, maxLevel, Promotion>&&) noexcept;
 
-	SkipList<T, maxLevel>& operator=(const SkipList<T, maxLevel>& other);
-	SkipList<T, maxLevel>& operator=(SkipList<T, maxLevel>&&) noexcept;
+	class Finger;
 
 	void insert(const T& elem);
 
+	// Finger operations start from the search path of the previous finger operation
+	// instead of the header, so sequential or local access costs O(log d), where d is the distance
+	// from the previous key. Any other change of the list invalidates the finger;
+	// a stale finger silently falls back to a search from the header.
+	Finger finger() const;
+
+	void insert(const T& elem, Finger& finger);
+
+	bool containsElement(const T& elem, Finger& finger) const;
+
+	// Inserts every element of batch (any range of T), repeated ones included, like a loop of insert.
+	// The batch is sorted (in parallel when large) and linked in one forward pass that keeps
+	// the predecessors of the previous element, so consecutive keys cost O(log d) for a gap of d
+	// nodes instead of a full search from the header.
+	template<class Range>
+	void insertBatch(const Range& batch);
+
 	const T& search(const T& elem) const;
 
 	bool removeElement(const T& elem);
 
+	// Deletes one copy of elem lazily: the node becomes a tombstone and is freed by the next compaction.
+	// Costs one search, never relinks or frees. False if there is no live copy of elem.
+	bool markRemoved(const T& elem);
+
+	// Unlinks and frees every tombstone in one pass over level 0, O(n).
+	// Callers can run it when the list is idle, before it runs by itself.
+	void compact();
+
+	// Tombstones waiting for compaction.
+	size_t tombstonesCount() const;
+
+	// Removes every copy of elem. Returns how many nodes were removed.
+	size_t eraseAll(const T& elem);
+
+	// Removes every element x with from <= x <= to. Returns how many nodes were removed.
+	size_t eraseRange(const T& from, const T& to);
+
+	// Moves every element >= key into the returned list by cutting the forward pointers on each level.
+	// O(log n) for the cut, then O(min(k, n - k)) for k moved nodes to count whichever half is shorter,
+	// so both lists keep exact sizes.
+	SkipList<T, maxLevel, Promotion> splitAt(const T& key);
+
+	// Splices the nodes of other into this list in one pass over both level-0 lists, O(n + m).
+	// No node is reallocated. If every element of other is >= the last element of this list
+	// the lists are just concatenated in O(log n). other is left empty.
+	void merge(SkipList<T, maxLevel, Promotion>& other);
+
 	bool containsElement(const T& elem) const;
 
+	// The first stored element equal to key, nullptr if there is none.
+	// key can be of any type that compares with T both ways, so a map can look up an entry by key alone.
+	template<class Key>
+	const T* find(const Key& key) const;
+
+	// Calls change on the stored element equal to key and returns true, false if there is none.
+	// change must leave the element comparing the same way, so the order is not broken.
+	template<class Key, class Change>
+	bool update(const Key& key, Change change);
+
 	bool exceptionSafeSearch(const T& elem, T& result) const;
 
+	// Attaches a Bloom filter sized for expectedElements keys (or the current size if larger)
+	// at the given false positive rate. containsElement consults it first, so most misses
+	// never walk the list. Removals make it rebuild once they reach half of its capacity.
+	void enableBloomFilter(size_t expectedElements, double falsePositiveRate = 0.01);
+
+	void disableBloomFilter();
+
+	// Read-only copy in Eytzinger order for read-heavy phases, O(n). Repeated values are kept once.
+	FrozenSet<T> freeze() const;
+
+	// Builds a list from the keys of frozen by appending them in order, O(n).
+	static SkipList<T, maxLevel, Promotion> thaw(const FrozenSet<T>& frozen);
+
+	// Live elements, tombstones not included.
 	size_t elementsCount() const;
 
 	bool empty() const;
 
-	void print() const;
+	// Element i is the number of nodes on level i + 1, so element 0 is the number of elements.
+	// Tombstones are counted, they are still linked. Levels above the highest used one are not included.
+	std::vector<size_t> levelHistogram() const;
+
+	// Tower heights, hops per level and the search cost against its expectation,
+	// in one pass over level 0, O(n * maxLevel).
+	ListShape analyze() const;
 
 	~SkipList();
 private:
 	size_t size;
+	size_t tombstones;
 	unsigned level;
 
+	// Fewer tombstones than this are never worth a compaction.
+	static const size_t minTombstones = 256;
+
 	NodeBase* header;
 
+	// Changed by every modification, so fingers can tell that their path is stale.
+	size_t version;
+
+	// Optional, nullptr unless enableBloomFilter was called.
+	OptionalBloomFilter<T>* filter;
+	size_t filterRemovals;
+
 	void free();
-	void copyFrom(const SkipList<T, maxLevel>&);
+	void copyFrom(const SkipList<T, maxLevel, Promotion>&);
+
+	void findPredecessors(const T& elem, NodeBase** update) const;
+	size_t unlinkRunUpTo(NodeBase** update, const T& to);
+	void shrinkLevel();
+	bool unlinkDeadMatches(const T& elem, NodeBase** update);
+	bool reviveDeadMatch(const T& elem, NodeBase* predecessor);
+	void findTails(NodeBase** tails) const;
+	void linkNewNode(const T& elem, NodeBase** update);
+	void resetFinger(Finger& finger) const;
+	void moveFinger(const T& elem, Finger& finger) const;
+	void rebuildFilter();
+	void noteFilterRemovals(size_t removed);
+
+public:
+	class Finger {
+	private:
+		const SkipList<T, maxLevel, Promotion>* owner;
+		NodeBase* path[maxLevel];
+		size_t version;
+
+		friend class SkipList<T, maxLevel, Promotion>;
+	public:
+		Finger() : owner(nullptr), version(0) {}
+	};
 };
-#endif
 
-template<class T, unsigned maxLevel>
-SkipList<T, maxLevel>::SkipList() {
+template<class T, unsigned maxLevel, class Promotion>
+SkipList<T, maxLevel, Promotion>::SkipList() {
 	size = 0;
+	tombstones = 0;
 	level = 1;
+	version = 0;
+
+	filter = nullptr;
+	filterRemovals = 0;
 
 	header = new NodeBase(maxLevel);
 }
 
-template<class T, unsigned maxLevel>
-SkipList<T, maxLevel>::SkipList(const SkipList<T, maxLevel>& other) {
+template<class T, unsigned maxLevel, class Promotion>
+SkipList<T, maxLevel, Promotion>::SkipList(const SkipList<T, maxLevel, Promotion>& other) {
+	version = 0;
 	copyFrom(other);
 }
 
-template<class T, unsigned maxLevel>
-SkipList<T, maxLevel>::SkipList(SkipList<T, maxLevel>&& other) noexcept {
+template<class T, unsigned maxLevel, class Promotion>
+SkipList<T, maxLevel, Promotion>::SkipList(SkipList<T, maxLevel, Promotion>&& other) noexcept {
 	this->header = other.header;
 	other.header = nullptr;
 
 	this->size = other.size;
+	this->tombstones = other.tombstones;
 	this->level = other.level;
+	this->version = 0;
+	++other.version;
+
+	this->filter = other.filter;
+	this->filterRemovals = other.filterRemovals;
+	other.filter = nullptr;
 }
 
-template<class T, unsigned maxLevel>
-SkipList<T, maxLevel>& SkipList<T, maxLevel>::operator=(const SkipList<T, maxLevel>& other)
+template<class T, unsigned maxLevel, class Promotion>
+SkipList<T, maxLevel, Promotion>& SkipList<T, maxLevel, Promotion>::operator=(const SkipList<T, maxLevel, Promotion>& other)
 {
 	if (this != &other) {
 		free();
 		copyFrom(other);
+		++version;
 	}
 	return *this;
 }
 
-template<class T, unsigned maxLevel>
-SkipList<T, maxLevel>& SkipList<T, maxLevel>::operator=(SkipList<T, maxLevel>&& other) noexcept {
+template<class T, unsigned maxLevel, class Promotion>
+SkipList<T, maxLevel, Promotion>& SkipList<T, maxLevel, Promotion>::operator=(SkipList<T, maxLevel, Promotion>&& other) noexcept {
 	if (this != &other) {
+		free();
+
 		this->header = other.header;
 		other.header = nullptr;
 
 		this->size = other.size;
+		this->tombstones = other.tombstones;
 		this->level = other.level;
+		++this->version;
+		++other.version;
+
+		this->filter = other.filter;
+		this->filterRemovals = other.filterRemovals;
+		other.filter = nullptr;
 	}
 	return *this;
 }
 
-template<class T, unsigned maxLevel>
-void SkipList<T, maxLevel>::insert(const T& elem) {
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::insert(const T& elem) {
 	NodeBase* update[maxLevel];
 
-	NodeBase* iterate = header;
+	findPredecessors(elem, update);
 
-	for (int i = maxLevel - 1; i >= 0; i--) {
-		while (iterate->forward[i] && iterate->forward[i]->value < elem) {
-			iterate = iterate->forward[i];
-		}
+	if (reviveDeadMatch(elem, update[0]))
+		return;
 
-		update[i] = iterate;
-	}
+	linkNewNode(elem, update);
 
-	iterate = iterate->forward[0];
+	++version;
+}
 
-	Node* iterateNodeCast = nullptr;
+// A tombstone of an equal value is brought back instead of allocating a new node.
+// The links do not change, so neither does version.
+template<class T, unsigned maxLevel, class Promotion>
+bool SkipList<T, maxLevel, Promotion>::reviveDeadMatch(const T& elem, NodeBase* predecessor) {
+	for (Node* it = predecessor->forward[0]; it && it->value == elem; it = it->forward[0]) {
+		if (it->dead) {
+			it->value = elem;
+			it->dead = false;
+
+			--tombstones;
+			++size;
+			if (filter)
+				filter->add(elem);
+
+			return true;
+		}
+	}
 
-	if (iterate)
-		iterateNodeCast = static_cast<Node*>(iterate);
+	return false;
+}
 
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::linkNewNode(const T& elem, NodeBase** update) {
 	unsigned newLevel = generateRandomLevel();
 
 	if (newLevel > level) {
@@ -202,18 +473,125 @@ void SkipList<T, maxLevel>::insert(const T& elem) {
 		level = newLevel;
 	}
 
-	iterateNodeCast = new Node(elem, newLevel);
+	Node* toAdd = new Node(elem, newLevel);
 
 	for (size_t i = 0; i < newLevel; i++) {
-		iterateNodeCast->forward[i] = update[i]->forward[i];
-		update[i]->forward[i] = iterateNodeCast;
+		toAdd->forward[i] = update[i]->forward[i];
+		update[i]->forward[i] = toAdd;
 	}
 
 	++size;
+
+	if (filter) {
+		filter->add(elem);
+
+		if (filter->addedCount() > filter->capacity())
+			rebuildFilter();
+	}
 }
 
-template<class T, unsigned maxLevel>
-const T& SkipList<T, maxLevel>::search(const T& elem) const {
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::insert(const T& elem, Finger& finger) {
+	moveFinger(elem, finger);
+
+	if (reviveDeadMatch(elem, finger.path[0]))
+		return;
+
+	linkNewNode(elem, finger.path);
+
+	finger.version = ++version;
+}
+
+// The frontier is a finger that is not invalidated between the links, since version changes only at the end.
+template<class T, unsigned maxLevel, class Promotion>
+template<class Range>
+void SkipList<T, maxLevel, Promotion>::insertBatch(const Range& batch) {
+	std::vector<T> sorted = BatchSort::sorted<T>(batch);
+
+	Finger frontier = finger();
+
+	for (const T& elem : sorted) {
+		moveFinger(elem, frontier);
+
+		if (!reviveDeadMatch(elem, frontier.path[0]))
+			linkNewNode(elem, frontier.path);
+	}
+
+	++version;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+bool SkipList<T, maxLevel, Promotion>::containsElement(const T& elem, Finger& finger) const {
+	if (filter && !filter->mayContain(elem))
+		return false;
+
+	moveFinger(elem, finger);
+
+	return liveMatch(finger.path[0]->forward[0], elem) != nullptr;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+typename SkipList<T, maxLevel, Promotion>::Finger SkipList<T, maxLevel, Promotion>::finger() const {
+	Finger result;
+	resetFinger(result);
+
+	return result;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::resetFinger(Finger& finger) const {
+	finger.owner = this;
+	finger.version = version;
+
+	for (size_t i = 0; i < maxLevel; i++)
+		finger.path[i] = header;
+}
+
+/*
+* finger.path[i] is the last node on level i before the previous key.
+*
+* We climb from level 0 while the finger node on the current level is not before elem
+* (we are moving backwards) or the next node one level up is still before elem (elem is too far
+* for the current level). Above the level we stop at the path is still correct for elem,
+* so we only search down from there. For a key d positions away from the previous one
+* we climb O(log d) levels on average, and the search below costs the same.
+*/
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::moveFinger(const T& elem, Finger& finger) const {
+	if (finger.owner != this || finger.version != version)
+		resetFinger(finger);
+
+	NodeBase** path = finger.path;
+
+	auto beforeElem = [&](unsigned i) {
+		return path[i] == header || static_cast<Node*>(path[i])->value < elem;
+	};
+
+	auto nextBeforeElem = [&](unsigned i) {
+		return path[i]->forward[i] && path[i]->forward[i]->value < elem;
+	};
+
+	unsigned top = 0;
+
+	while (top + 1 < maxLevel && (!beforeElem(top) || nextBeforeElem(top + 1)))
+		++top;
+
+	NodeBase* it = path[top];
+
+	if (!beforeElem(top))
+		it = header;
+
+	for (int i = top; i >= 0; --i) {
+		while (it->forward[i] && it->forward[i]->value < elem) {
+			it = it->forward[i];
+		}
+
+		path[i] = it;
+	}
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+const T& SkipList<T, maxLevel, Promotion>::search(const T& elem) const {
 	NodeBase* it = header;
 
 	for (int i = maxLevel - 1; i >= 0; --i) {
@@ -221,34 +599,32 @@ const T& SkipList<T, maxLevel>::search(const T& elem) const {
 			it = it->forward[i];
 		}
 	}
-	it = it->forward[0];
+	Node* match = liveMatch(it->forward[0], elem);
 
-	if (it) {
-		Node* its = static_cast<Node*>(it);
-		if (its->value == elem)
-			return its->value;
-	}
+	if (match)
+		return match->value;
 
 	throw std::exception("No such element!");
 }
 
-template<class T, unsigned maxLevel>
-bool SkipList<T, maxLevel>::removeElement(const T& elem) {
+template<class T, unsigned maxLevel, class Promotion>
+bool SkipList<T, maxLevel, Promotion>::removeElement(const T& elem) {
 	NodeBase* update[maxLevel];
 
-	NodeBase* it = header;
+	findPredecessors(elem, update);
 
-	for (int i = maxLevel - 1; i >= 0; --i) {
-		while (it->forward[i] && it->forward[i]->value < elem) {
-			it = it->forward[i];
-		}
+	bool unlinkedDead = unlinkDeadMatches(elem, update);
 
-		update[i] = it;
-	}
-	it = it->forward[0];
+	Node* it = update[0]->forward[0];
+
+	if (!it || !(it->value == elem)) {
+		if (unlinkedDead) {
+			shrinkLevel();
+			++version;
+		}
 
-	if (!it)
 		return false;
+	}
 
 	for (size_t i = 0; i < maxLevel; i++) {
 		if (update[i]->forward[i] != it)
@@ -259,28 +635,270 @@ bool SkipList<T, maxLevel>::removeElement(const T& elem) {
 
 	delete it;
 
-	while (level > 0 && header->forward[level] == nullptr) { --level; }
+	shrinkLevel();
+	++version;
 
 	--size;
 
+	noteFilterRemovals(1);
+
 	return true;
 }
 
-template<class T, unsigned maxLevel>
-bool SkipList<T, maxLevel>::containsElement(const T& elem) const {
+// The tombstones equal to elem in front of the first live copy are freed on the way,
+// so the node after update[0] is live (or not equal to elem).
+template<class T, unsigned maxLevel, class Promotion>
+bool SkipList<T, maxLevel, Promotion>::unlinkDeadMatches(const T& elem, NodeBase** update) {
+	bool unlinked = false;
+	Node* it = update[0]->forward[0];
+
+	while (it && it->dead && it->value == elem) {
+		for (size_t i = 0; i < it->levels; i++)
+			update[i]->forward[i] = it->forward[i];
+
+		delete it;
+		unlinked = true;
+
+		--tombstones;
+
+		it = update[0]->forward[0];
+	}
+
+	return unlinked;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+bool SkipList<T, maxLevel, Promotion>::markRemoved(const T& elem) {
 	NodeBase* it = header;
 
-	for (int i = maxLevel - 1; i >= 0; --i) {
+	for (int i = level - 1; i >= 0; --i) {
 		while (it->forward[i] && it->forward[i]->value < elem) {
 			it = it->forward[i];
 		}
 	}
-	it = it->forward[0];
-	return (it && static_cast<Node*>(it)->value == elem);
+
+	Node* match = liveMatch(it->forward[0], elem);
+
+	if (!match)
+		return false;
+
+	match->dead = true;
+
+	--size;
+	++tombstones;
+
+	noteFilterRemovals(1);
+
+	size_t dead = tombstonesCount();
+	if (dead >= minTombstones && 2 * dead >= elementsCount())
+		compact();
+
+	return true;
+}
+
+/*
+* tails[i] is the last live node on level i we passed (header at the start),
+* so tails[i]->forward[i] is always the next node on level i.
+* A tombstone is spliced out of its levels by pointing those tails over it.
+*/
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::compact() {
+	NodeBase* tails[maxLevel];
+
+	for (size_t i = 0; i < maxLevel; i++)
+		tails[i] = header;
+
+	Node* it = header->forward[0];
+
+	while (it) {
+		Node* next = it->forward[0];
+
+		if (it->dead) {
+			for (size_t i = 0; i < it->levels; i++)
+				tails[i]->forward[i] = it->forward[i];
+
+			delete it;
+		}
+		else {
+			for (size_t i = 0; i < it->levels; i++)
+				tails[i] = it;
+		}
+
+		it = next;
+	}
+
+	tombstones = 0;
+
+	shrinkLevel();
+	++version;
 }
 
-template<class T, unsigned maxLevel>
-bool SkipList<T, maxLevel>::exceptionSafeSearch(const T& elem, T& result) const {
+template<class T, unsigned maxLevel, class Promotion>
+size_t SkipList<T, maxLevel, Promotion>::tombstonesCount() const {
+	return tombstones;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+size_t SkipList<T, maxLevel, Promotion>::eraseAll(const T& elem) {
+	return eraseRange(elem, elem);
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+size_t SkipList<T, maxLevel, Promotion>::eraseRange(const T& from, const T& to) {
+	if (to < from)
+		return 0;
+
+	NodeBase* update[maxLevel];
+
+	findPredecessors(from, update);
+
+	size_t removed = unlinkRunUpTo(update, to);
+
+	size -= removed;
+
+	noteFilterRemovals(removed);
+
+	return removed;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+SkipList<T, maxLevel, Promotion> SkipList<T, maxLevel, Promotion>::splitAt(const T& key) {
+	SkipList<T, maxLevel, Promotion> result;
+
+	NodeBase* update[maxLevel];
+
+	findPredecessors(key, update);
+
+	for (size_t i = 0; i < maxLevel; i++) {
+		result.header->forward[i] = update[i]->forward[i];
+		update[i]->forward[i] = nullptr;
+	}
+
+	result.level = level;
+	result.shrinkLevel();
+	shrinkLevel();
+
+	// Walks both halves in step: the one that ends first is counted, the other one is the rest.
+	const Node* kept = header->forward[0];
+	const Node* moved = result.header->forward[0];
+	size_t counted[2][2] = {};
+
+	while (kept && moved) {
+		++counted[0][kept->dead];
+		++counted[1][moved->dead];
+
+		kept = kept->forward[0];
+		moved = moved->forward[0];
+	}
+
+	if (!kept) {
+		result.size = size - counted[0][0];
+		result.tombstones = tombstones - counted[0][1];
+		size = counted[0][0];
+		tombstones = counted[0][1];
+	}
+	else {
+		size -= counted[1][0];
+		tombstones -= counted[1][1];
+		result.size = counted[1][0];
+		result.tombstones = counted[1][1];
+	}
+
+	++version;
+
+	return result;
+}
+
+/*
+* tails[i] is the node we last appended on level i.
+* We always take the smaller head of the two level-0 lists (ours on ties, so equal
+* elements keep their relative order) and append it on every level of its tower.
+* The next pointers are read before appending, because appending rewrites them.
+*/
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::merge(SkipList<T, maxLevel, Promotion>& other) {
+	// Not other.empty(): a list of tombstones only still has nodes to move.
+	if (this == &other || !other.header->forward[0])
+		return;
+
+	NodeBase* tails[maxLevel];
+
+	size_t mergedSize = size + other.size;
+	size_t mergedTombstones = tombstones + other.tombstones;
+
+	findTails(tails);
+
+	Node* otherFirst = other.header->forward[0];
+
+	if (filter) {
+		for (const Node* it = otherFirst; it; it = it->forward[0])
+			filter->add(it->value);
+	}
+
+	if (tails[0] == header || !(otherFirst->value < static_cast<Node*>(tails[0])->value)) {
+		for (size_t i = 0; i < maxLevel; i++) {
+			tails[i]->forward[i] = other.header->forward[i];
+			other.header->forward[i] = nullptr;
+		}
+	}
+	else {
+		Node* ours = header->forward[0];
+		Node* theirs = otherFirst;
+
+		for (size_t i = 0; i < maxLevel; i++) {
+			tails[i] = header;
+			other.header->forward[i] = nullptr;
+		}
+
+		mergedSize = mergedTombstones = 0;
+
+		while (ours || theirs) {
+			Node* next;
+
+			if (!theirs || (ours && !(theirs->value < ours->value))) {
+				next = ours;
+				ours = ours->forward[0];
+			}
+			else {
+				next = theirs;
+				theirs = theirs->forward[0];
+			}
+
+			for (size_t i = 0; i < next->levels; i++) {
+				tails[i]->forward[i] = next;
+				tails[i] = next;
+			}
+
+			if (next->dead)
+				++mergedTombstones;
+			else
+				++mergedSize;
+		}
+
+		for (size_t i = 0; i < maxLevel; i++)
+			tails[i]->forward[i] = nullptr;
+	}
+
+	if (other.level > level)
+		level = other.level;
+
+	size = mergedSize;
+	tombstones = mergedTombstones;
+	++version;
+
+	if (filter && filter->addedCount() > filter->capacity())
+		rebuildFilter();
+
+	other.size = other.tombstones = 0;
+	other.level = 1;
+	++other.version;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+bool SkipList<T, maxLevel, Promotion>::containsElement(const T& elem) const {
+	if (filter && !filter->mayContain(elem))
+		return false;
+
 	NodeBase* it = header;
 
 	for (int i = maxLevel - 1; i >= 0; --i) {
@@ -288,54 +906,310 @@ bool SkipList<T, maxLevel>::exceptionSafeSearch(const T& elem, T& result) const
 			it = it->forward[i];
 		}
 	}
-	it = it->forward[0];
+	return liveMatch(it->forward[0], elem) != nullptr;
+}
 
-	if (it) {
-		it = static_cast<Node*>(it);
-		if (it->value == elem)
-			result = it->value;
+template<class T, unsigned maxLevel, class Promotion>
+template<class Key>
+const T* SkipList<T, maxLevel, Promotion>::find(const Key& key) const {
+	NodeBase* it = header;
 
+	for (int i = level - 1; i >= 0; --i) {
+		while (it->forward[i] && it->forward[i]->value < key) {
+			it = it->forward[i];
+		}
+	}
+
+	Node* match = liveMatch(it->forward[0], key);
+	return match ? &match->value : nullptr;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+template<class Key, class Change>
+bool SkipList<T, maxLevel, Promotion>::update(const Key& key, Change change) {
+	// The node's value is not const, only the pointer find hands out.
+	T* found = const_cast<T*>(find(key));
+
+	if (!found)
+		return false;
+
+	change(*found);
+	return true;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+bool SkipList<T, maxLevel, Promotion>::exceptionSafeSearch(const T& elem, T& result) const {
+	NodeBase* it = header;
+
+	for (int i = maxLevel - 1; i >= 0; --i) {
+		while (it->forward[i] && it->forward[i]->value < elem) {
+			it = it->forward[i];
+		}
+	}
+	Node* match = liveMatch(it->forward[0], elem);
+
+	if (match) {
+		result = match->value;
 		return true;
 	}
 
 	return false;
 }
 
-template<class T, unsigned maxLevel>
-inline size_t SkipList<T, maxLevel>::elementsCount() const {
+template<class T, unsigned maxLevel, class Promotion>
+inline size_t SkipList<T, maxLevel, Promotion>::elementsCount() const {
 	return size;
 }
 
-template<class T, unsigned maxLevel>
-inline bool SkipList<T, maxLevel>::empty() const {
-	return (size == 0);
+template<class T, unsigned maxLevel, class Promotion>
+inline bool SkipList<T, maxLevel, Promotion>::empty() const {
+	return begin() == end();
 }
 
-template<class T, unsigned maxLevel>
-void SkipList<T, maxLevel>::print() const {
-	for (int i = maxLevel - 1; i >= 0; i--) {
-		Node* it = header->forward[i];
+template<class T, unsigned maxLevel, class Promotion>
+FrozenSet<T> SkipList<T, maxLevel, Promotion>::freeze() const {
+	std::vector<T> sorted;
 
-		int cnt = 0;
+	for (const T& elem : *this)
+		sorted.push_back(elem);
 
-		while (it) {
-			// std::cout << it->value << " ";
-			++cnt;
+	return FrozenSet<T>::fromSorted(std::move(sorted));
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+SkipList<T, maxLevel, Promotion> SkipList<T, maxLevel, Promotion>::thaw(const FrozenSet<T>& frozen) {
+	SkipList<T, maxLevel, Promotion> result;
+
+	NodeBase* tails[maxLevel];
+	for (size_t i = 0; i < maxLevel; i++)
+		tails[i] = result.header;
+
+	for (const T& elem : frozen.toSorted()) {
+		result.linkNewNode(elem, tails);
+
+		Node* added = tails[0]->forward[0];
+		for (size_t i = 0; i < added->levels; i++)
+			tails[i] = added;
+	}
+
+	return result;
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+std::vector<size_t> SkipList<T, maxLevel, Promotion>::levelHistogram() const {
+	std::vector<size_t> histogram;
+
+	for (unsigned i = 0; i < level; i++) {
+		size_t count = 0;
+
+		for (const Node* it = header->forward[i]; it; it = it->forward[i])
+			++count;
+
+		if (count == 0)
+			break;
+
+		histogram.push_back(count);
+	}
+
+	return histogram;
+}
+
+/*
+* A search moves forward on level i over the nodes with exactly i + 1 levels
+* that come after the last taller node before the key. sinceTaller[i] counts those
+* while we walk level 0, so the hops of every search are known when we reach its key.
+* A search stops before the first of equal values, hence the copy taken there.
+*/
+template<class T, unsigned maxLevel, class Promotion>
+ListShape SkipList<T, maxLevel, Promotion>::analyze() const {
+	ListShape shape;
+
+	size_t sinceTaller[maxLevel] = {};
+	size_t atFirstEqual[maxLevel] = {};
+	size_t hops[maxLevel] = {};
+	const Node* previous = nullptr;
+
+	for (const Node* it = header->forward[0]; it; it = it->forward[0]) {
+		if (!previous || !(previous->value == it->value)) {
+			for (unsigned i = 0; i < maxLevel; i++)
+				atFirstEqual[i] = sinceTaller[i];
+		}
+
+		if (it->levels > shape.towerHistogram.size())
+			shape.towerHistogram.resize(it->levels, 0);
+
+		++shape.towerHistogram[it->levels - 1];
+
+		if (it->dead) {
+			++shape.tombstones;
+		}
+		else {
+			++shape.elements;
+			for (unsigned i = 0; i < maxLevel; i++)
+				hops[i] += atFirstEqual[i];
+		}
+
+		for (unsigned i = 0; i + 1 < it->levels; i++)
+			sinceTaller[i] = 0;
+		++sinceTaller[it->levels - 1];
+
+		previous = it;
+	}
+
+	size_t height = shape.towerHistogram.size();
+	if (shape.elements == 0)
+		return shape;
+
+	double totalHops = 0;
+	for (size_t i = 0; i < height; i++) {
+		shape.averageHopsPerLevel.push_back(static_cast<double>(hops[i]) / shape.elements);
+		totalHops += shape.averageHopsPerLevel.back();
+	}
+
+	// One move down per level.
+	shape.actualSearchCost = totalHops + height;
+
+	double p = Promotion::probability();
+	double linked = static_cast<double>(shape.elements + shape.tombstones);
+	shape.expectedSearchCost = std::log(linked) / std::log(1 / p) / p + 1 / (1 - p);
+
+	return shape;
+}
+
+// update[i] becomes the last node on level i with value < elem.
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::findPredecessors(const T& elem, NodeBase** update) const {
+	NodeBase* it = header;
+
+	for (int i = maxLevel - 1; i >= 0; --i) {
+		while (it->forward[i] && it->forward[i]->value < elem) {
 			it = it->forward[i];
 		}
 
-		std::cout << "#" << cnt << "#" << std::endl;
+		update[i] = it;
 	}
-	std::cout << std::endl;
 }
 
-template<class T, unsigned maxLevel>
-SkipList<T, maxLevel>::~SkipList() {
+/*
+* Splices out the run of nodes that starts right after update[0] and ends with the last value <= to.
+* Returns how many of them were live; the tombstones in the run are freed too.
+*
+* On every level the run is a contiguous piece of the list, so we only walk the nodes being removed:
+* each level costs the number of its nodes inside the run, O(k) in total with k = run length.
+* The run is unlinked from all levels first and then freed in one pass over level 0.
+*/
+template<class T, unsigned maxLevel, class Promotion>
+size_t SkipList<T, maxLevel, Promotion>::unlinkRunUpTo(NodeBase** update, const T& to) {
+	Node* first = update[0]->forward[0];
+
+	for (size_t i = 0; i < maxLevel; i++) {
+		Node* after = update[i]->forward[i];
+
+		while (after && !(to < after->value))
+			after = after->forward[i];
+
+		update[i]->forward[i] = after;
+	}
+
+	Node* stop = update[0]->forward[0];
+	size_t removed = 0;
+
+	bool unlinked = first != stop;
+
+	while (first != stop) {
+		Node* capture = first;
+		first = first->forward[0];
+
+		if (!capture->dead)
+			++removed;
+		else
+			--tombstones;
+
+		delete capture;
+	}
+
+	if (unlinked) {
+		shrinkLevel();
+		++version;
+	}
+
+	return removed;
+}
+
+// tails[i] becomes the last node on level i (header if the level is empty).
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::findTails(NodeBase** tails) const {
+	NodeBase* it = header;
+
+	for (int i = maxLevel - 1; i >= 0; --i) {
+		while (it->forward[i]) {
+			it = it->forward[i];
+		}
+
+		tails[i] = it;
+	}
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::shrinkLevel() {
+	while (level > 1 && header->forward[level - 1] == nullptr) { --level; }
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::enableBloomFilter(size_t expectedElements, double falsePositiveRate) {
+	static_assert(IsHashable<T>::value, "enableBloomFilter needs a std::hash specialization for the key type");
+
+	size_t count = elementsCount();
+
+	delete filter;
+	filter = new OptionalBloomFilter<T>(expectedElements > count ? expectedElements : count, falsePositiveRate);
+	filterRemovals = 0;
+
+	for (const T& elem : *this)
+		filter->add(elem);
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::disableBloomFilter() {
+	delete filter;
+	filter = nullptr;
+}
+
+// Doubles the capacity if the filter is full, so the false positive rate stays on target.
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::rebuildFilter() {
+	if constexpr (IsHashable<T>::value) {
+		size_t count = elementsCount();
+		size_t capacity = filter->capacity();
+
+		if (count >= capacity)
+			capacity = 2 * count;
+
+		enableBloomFilter(capacity, filter->falsePositiveRate());
+	}
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::noteFilterRemovals(size_t removed) {
+	if (!filter)
+		return;
+
+	filterRemovals += removed;
+
+	if (filterRemovals > filter->capacity() / 2)
+		rebuildFilter();
+}
+
+template<class T, unsigned maxLevel, class Promotion>
+SkipList<T, maxLevel, Promotion>::~SkipList() {
 	free();
 }
 
-template<class T, unsigned maxLevel>
-void SkipList<T, maxLevel>::free() {
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::free() {
+	if (!header)
+		return;
+
 	Node* it = header->forward[0];
 
 	while (it) {
@@ -345,6 +1219,7 @@ void SkipList<T, maxLevel>::free() {
 	}
 
 	delete header;
+	delete filter;
 }
 
 /*
@@ -353,9 +1228,10 @@ void SkipList<T, maxLevel>::free() {
 * Node *currentIterator -> Keeps track of where we are in the current list.
 * Node *otherIterator   -> Used to iterate argument list.
 * 
-* Node** otherPaths		-> We use double pointer so we can compare adresses. 
+* Node* otherPaths		-> The next node of the argument list on every upper level.
 *						   The way we understand that pointer from level k points to element from level 0
 *						   is if they have the same memory adresses.
+*						   These are local copies, the argument list is not modified.
 * 
 * We iterate the whole list and for each level, if the adress of otherIterator 
 * is the same as the adress of the path we push the node in stack.
@@ -375,11 +1251,15 @@ void SkipList<T, maxLevel>::free() {
 * 
 * Note: what if k = log(n)?
 */
-template<class T, unsigned maxLevel>
-void SkipList<T, maxLevel>::copyFrom(const SkipList<T, maxLevel>& other) {
+template<class T, unsigned maxLevel, class Promotion>
+void SkipList<T, maxLevel, Promotion>::copyFrom(const SkipList<T, maxLevel, Promotion>& other) {
 	size = other.size;
+	tombstones = other.tombstones;
 	level = other.level;
 
+	filter = other.filter ? new OptionalBloomFilter<T>(*other.filter) : nullptr;
+	filterRemovals = other.filterRemovals;
+
 	header = new NodeBase(maxLevel);
 
 	header->forward[0] = copyZeroLevelStack(other.header->forward[0]);
@@ -387,20 +1267,20 @@ void SkipList<T, maxLevel>::copyFrom(const SkipList<T, maxLevel>& other) {
 	Node* currentIterator = header->forward[0];
 	Node* otherIterator = other.header->forward[0];
 	
-	Node** otherPaths[maxLevel - 1];
+	Node* otherPaths[maxLevel - 1];
 
 	std::stack<Node*> currentPaths[maxLevel - 1];
 
 	for (size_t i = 0; i < maxLevel - 1; i++)
-		otherPaths[i] = &other.header->forward[i + 1];
+		otherPaths[i] = other.header->forward[i + 1];
 
 	while (otherIterator) {
 		unsigned j = 1;
 
-		while (j < maxLevel && (otherIterator == (*otherPaths[j - 1]))) {
+		while (j < maxLevel && (otherIterator == otherPaths[j - 1])) {
 			currentPaths[j - 1].push(currentIterator);
 
-			(*otherPaths[j - 1]) = (*otherPaths[j - 1])->forward[j];
+			otherPaths[j - 1] = otherPaths[j - 1]->forward[j];
 			
 			j++;
 		}
@@ -418,4 +1298,26 @@ void SkipList<T, maxLevel>::copyFrom(const SkipList<T, maxLevel>& other) {
 			currentPaths[i].pop();
 		}
 	}
-}
\ No newline at end of file
+}
+
+// The randomized skip list is a multiset: insert always stores the element.
+template<class T, unsigned maxLevel, class Promotion>
+struct OrderedSetTraits<SkipList<T, maxLevel, Promotion>> {
+	using ValueType = T;
+	using Engine = SkipList<T, maxLevel, Promotion>;
+
+	static constexpr bool uniqueKeys = false;
+
+	static bool insert(Engine& engine, const T& elem) {
+		engine.insert(elem);
+		return true;
+	}
+
+	static bool contains(const Engine& engine, const T& elem) { return engine.containsElement(elem); }
+
+	static bool remove(Engine& engine, const T& elem) { return engine.removeElement(elem); }
+
+	static size_t size(const Engine& engine) { return engine.elementsCount(); }
+};
+
+#endif
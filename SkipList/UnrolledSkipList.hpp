@@ -0,0 +1,533 @@
+/*
+* Unrolled skip list.
+*
+* The bottom level is a list of blocks, each holding up to blockCapacity sorted keys in an array.
+* The express lanes link blocks instead of single keys and a block is indexed by its first key,
+* so a search walks the lanes to the last block whose first key is <= elem and then
+* searches inside that block: one cache-friendly array scan instead of a chain of node misses.
+*
+* A full block is split in two halves (the new one gets a random level),
+* a block under a quarter full borrows from or merges with the next block.
+* Changing the first key of a block never breaks the order of the blocks:
+* only the first block gets smaller keys in front, and a removal makes keys[0] greater but still
+* smaller than the first key of the next block.
+*
+* For int keys the position inside a block is found with SSE2 compares, four keys at a time.
+*
+* Unlike SkipList this is a set: inserting a value that is already there does nothing.
+* T must be default constructible, the keys of a block are a plain array.
+*/
+
+#ifndef UNROLLED_SKIP_LIST_HEADER_
+#define UNROLLED_SKIP_LIST_HEADER_
+#include<algorithm>
+#include<cstddef>
+#include<stdexcept>
+#include<utility>
+#include"PromotionPolicy.hpp"
+#include"../Common/OrderedSet.hpp"
+
+#if defined(__SSE2__)
+#include<emmintrin.h>
+#endif
+
+// Position of the first key >= elem in a sorted array of count keys.
+template<class T>
+struct BlockSearch {
+	static unsigned lowerBound(const T* keys, unsigned count, const T& elem) {
+		return static_cast<unsigned>(std::lower_bound(keys, keys + count, elem) - keys);
+	}
+};
+
+#if defined(__SSE2__)
+// Counts the keys < elem, which for sorted keys is the lower bound. Branch free except for the loop.
+// Reads whole groups of 4, so the block capacity must be a multiple of 4.
+template<>
+struct BlockSearch<int> {
+	static unsigned lowerBound(const int* keys, unsigned count, const int& elem) {
+		const __m128i needle = _mm_set1_epi32(elem);
+		unsigned result = 0;
+
+		for (unsigned i = 0; i < count; i += 4) {
+			__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+			unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(group, needle))));
+
+			if (count - i < 4)
+				mask &= (1u << (count - i)) - 1;
+
+			result += __builtin_popcount(mask);
+		}
+
+		return result;
+	}
+};
+#endif
+
+template<class T, unsigned blockCapacity = 16, unsigned maxLevel = 12, class Promotion = HalfPromotion>
+class UnrolledSkipList {
+	static_assert(blockCapacity >= 4 && blockCapacity % 4 == 0, "Block capacity must be a multiple of 4");
+
+private:
+	class Block;
+
+	class NodeBase {
+	public:
+		Block** forward;
+		unsigned levels;
+
+		NodeBase(unsigned createWithLevels) {
+			if (createWithLevels > maxLevel)
+				createWithLevels = maxLevel;
+
+			levels = createWithLevels;
+
+			forward = new Block * [levels];
+
+			for (size_t i = 0; i < levels; i++)
+				forward[i] = nullptr;
+		}
+
+		NodeBase(const NodeBase&) = delete;
+		NodeBase& operator=(const NodeBase&) = delete;
+
+		~NodeBase() { delete[] forward; }
+	};
+
+	class Block : public NodeBase {
+	public:
+		T keys[blockCapacity];
+		unsigned count;
+
+		Block(unsigned levels) : NodeBase(levels), keys(), count(0) {}
+
+		unsigned lowerBound(const T& elem) const {
+			return BlockSearch<T>::lowerBound(keys, count, elem);
+		}
+
+		void insertAt(unsigned position, const T& elem) {
+			for (unsigned i = count; i > position; i--)
+				keys[i] = std::move(keys[i - 1]);
+
+			keys[position] = elem;
+			++count;
+		}
+
+		void eraseAt(unsigned position) {
+			for (unsigned i = position; i + 1 < count; i++)
+				keys[i] = std::move(keys[i + 1]);
+
+			--count;
+		}
+
+		// Moves the first moved keys of next to the end of this block.
+		void takeFront(Block* next, unsigned moved) {
+			for (unsigned i = 0; i < moved; i++)
+				keys[count + i] = std::move(next->keys[i]);
+
+			for (unsigned i = moved; i < next->count; i++)
+				next->keys[i - moved] = std::move(next->keys[i]);
+
+			count += moved;
+			next->count -= moved;
+		}
+	};
+
+	static unsigned generateRandomLevel() {
+		unsigned toReturn = 1;
+
+		while (Promotion::promote() && toReturn != maxLevel) {
+			++toReturn;
+		}
+
+		return toReturn;
+	}
+
+	size_t size;
+	size_t blocks;
+	unsigned level;
+
+	NodeBase* header;
+
+	// update[i] becomes the last block on level i with first key <= elem (or < elem if strict).
+	void findPredecessors(const T& elem, NodeBase** update, bool strict) const;
+	Block* findBlock(const T& elem) const;
+	void linkBlock(Block* block, NodeBase** update);
+	void unlinkBlock(Block* block);
+	void shrinkLevel();
+
+	void free();
+	void copyFrom(const UnrolledSkipList&);
+
+public:
+	class ConstIterator {
+	private:
+		const Block* current;
+		unsigned index;
+
+		ConstIterator(const Block* start) : current(start), index(0) {}
+	public:
+		bool operator==(const ConstIterator& other) const { return current == other.current && index == other.index; }
+
+		bool operator!=(const ConstIterator& other) const { return !(this->operator==(other)); }
+
+		ConstIterator& operator++() {
+			if (++index == current->count) {
+				current = current->forward[0];
+				index = 0;
+			}
+
+			return *this;
+		}
+
+		ConstIterator operator++(int) {
+			ConstIterator temp = *this;
+			++*this;
+			return temp;
+		}
+
+		const T& operator*() const {
+			if (!current)
+				throw std::runtime_error("Reached end of collection!");
+
+			return current->keys[index];
+		}
+
+		friend class UnrolledSkipList;
+	};
+
+	UnrolledSkipList();
+
+	UnrolledSkipList(const UnrolledSkipList&);
+	UnrolledSkipList(UnrolledSkipList&&) noexcept;
+
+	UnrolledSkipList& operator=(const UnrolledSkipList& other);
+	UnrolledSkipList& operator=(UnrolledSkipList&&) noexcept;
+
+	// Returns false if elem is already in the list.
+	bool insert(const T& elem);
+
+	bool containsElement(const T& elem) const;
+
+	bool removeElement(const T& elem);
+
+	size_t elementsCount() const;
+
+	size_t blocksCount() const;
+
+	bool empty() const;
+
+	ConstIterator begin() const;
+
+	ConstIterator end() const;
+
+	~UnrolledSkipList();
+};
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::UnrolledSkipList() : size(0), blocks(0), level(1) {
+	header = new NodeBase(maxLevel);
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::UnrolledSkipList(const UnrolledSkipList& other) {
+	copyFrom(other);
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::UnrolledSkipList(UnrolledSkipList&& other) noexcept : size(other.size), blocks(other.blocks), level(other.level), header(other.header) {
+	other.header = nullptr;
+	other.size = 0;
+	other.blocks = 0;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>& UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::operator=(const UnrolledSkipList& other) {
+	if (this != &other) {
+		free();
+		copyFrom(other);
+	}
+
+	return *this;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>& UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::operator=(UnrolledSkipList&& other) noexcept {
+	if (this != &other) {
+		free();
+
+		header = other.header;
+		size = other.size;
+		blocks = other.blocks;
+		level = other.level;
+
+		other.header = nullptr;
+		other.size = 0;
+		other.blocks = 0;
+	}
+
+	return *this;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::~UnrolledSkipList() {
+	free();
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+void UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::free() {
+	if (!header)
+		return;
+
+	Block* it = header->forward[0];
+
+	while (it) {
+		Block* capture = it;
+		it = it->forward[0];
+		delete capture;
+	}
+
+	delete header;
+	header = nullptr;
+}
+
+// Copies the blocks in order and links every level through its last block so far.
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+void UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::copyFrom(const UnrolledSkipList& other) {
+	size = other.size;
+	blocks = other.blocks;
+	level = other.level;
+
+	header = new NodeBase(maxLevel);
+
+	NodeBase* tails[maxLevel];
+	for (size_t i = 0; i < maxLevel; i++)
+		tails[i] = header;
+
+	for (const Block* it = other.header->forward[0]; it; it = it->forward[0]) {
+		Block* copy = new Block(it->levels);
+
+		for (unsigned i = 0; i < it->count; i++)
+			copy->keys[i] = it->keys[i];
+		copy->count = it->count;
+
+		for (unsigned i = 0; i < copy->levels; i++) {
+			tails[i]->forward[i] = copy;
+			tails[i] = copy;
+		}
+	}
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+void UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::findPredecessors(const T& elem, NodeBase** update, bool strict) const {
+	NodeBase* it = header;
+
+	for (int i = maxLevel - 1; i >= 0; --i) {
+		while (it->forward[i] && (strict ? it->forward[i]->keys[0] < elem : !(elem < it->forward[i]->keys[0])))
+			it = it->forward[i];
+
+		update[i] = it;
+	}
+}
+
+// The last block whose first key is <= elem, nullptr if elem is smaller than every key.
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+typename UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::Block* UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::findBlock(const T& elem) const {
+	NodeBase* it = header;
+
+	for (int i = level - 1; i >= 0; --i) {
+		while (it->forward[i] && !(elem < it->forward[i]->keys[0]))
+			it = it->forward[i];
+	}
+
+	return (it == header) ? nullptr : static_cast<Block*>(it);
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+void UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::linkBlock(Block* block, NodeBase** update) {
+	if (block->levels > level) {
+		for (size_t i = level; i < block->levels; i++)
+			update[i] = header;
+
+		level = block->levels;
+	}
+
+	for (size_t i = 0; i < block->levels; i++) {
+		block->forward[i] = update[i]->forward[i];
+		update[i]->forward[i] = block;
+	}
+
+	++blocks;
+}
+
+// block must not be empty, its first key is used to find its predecessors.
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+void UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::unlinkBlock(Block* block) {
+	NodeBase* update[maxLevel];
+	findPredecessors(block->keys[0], update, true);
+
+	for (size_t i = 0; i < block->levels; i++)
+		update[i]->forward[i] = block->forward[i];
+
+	delete block;
+	--blocks;
+
+	shrinkLevel();
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+void UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::shrinkLevel() {
+	while (level > 1 && header->forward[level - 1] == nullptr) { --level; }
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+bool UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::insert(const T& elem) {
+	NodeBase* update[maxLevel];
+	findPredecessors(elem, update, false);
+
+	// elem goes in front of the first block.
+	Block* block = (update[0] == header) ? header->forward[0] : static_cast<Block*>(update[0]);
+
+	if (!block) {
+		block = new Block(generateRandomLevel());
+		block->insertAt(0, elem);
+		linkBlock(block, update);
+
+		++size;
+		return true;
+	}
+
+	unsigned position = block->lowerBound(elem);
+
+	if (position < block->count && block->keys[position] == elem)
+		return false;
+
+	if (block->count == blockCapacity) {
+		Block* newBlock = new Block(generateRandomLevel());
+		unsigned half = blockCapacity / 2;
+		for (unsigned i = half; i < blockCapacity; i++)
+			newBlock->keys[i - half] = std::move(block->keys[i]);
+
+		newBlock->count = blockCapacity - half;
+		block->count = half;
+
+		// Below the height of block the new block goes right after it.
+		for (size_t i = 0; i < block->levels; i++)
+			update[i] = block;
+
+		linkBlock(newBlock, update);
+
+		if (position > half) {
+			block = newBlock;
+			position -= half;
+		}
+	}
+
+	block->insertAt(position, elem);
+
+	++size;
+	return true;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+bool UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::containsElement(const T& elem) const {
+	const Block* block = findBlock(elem);
+
+	if (!block)
+		return false;
+
+	unsigned position = block->lowerBound(elem);
+
+	return position < block->count && block->keys[position] == elem;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+bool UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::removeElement(const T& elem) {
+	Block* block = findBlock(elem);
+
+	if (!block)
+		return false;
+
+	unsigned position = block->lowerBound(elem);
+
+	if (position == block->count || !(block->keys[position] == elem))
+		return false;
+
+	--size;
+
+	if (block->count == 1) {
+		unlinkBlock(block);
+		return true;
+	}
+
+	block->eraseAt(position);
+
+	Block* next = block->forward[0];
+
+	if (block->count >= blockCapacity / 4 || !next)
+		return true;
+
+	if (block->count + next->count <= blockCapacity * 3 / 4) {
+		unsigned moved = next->count;
+
+		// Unlink while next still has its first key, then move the keys.
+		NodeBase* update[maxLevel];
+		findPredecessors(next->keys[0], update, true);
+
+		for (size_t i = 0; i < next->levels; i++)
+			update[i]->forward[i] = next->forward[i];
+
+		block->takeFront(next, moved);
+
+		delete next;
+		--blocks;
+		shrinkLevel();
+	}
+	else {
+		block->takeFront(next, (next->count - block->count) / 2);
+	}
+
+	return true;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+size_t UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::elementsCount() const {
+	return size;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+size_t UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::blocksCount() const {
+	return blocks;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+bool UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::empty() const {
+	return header->forward[0] == nullptr;
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+typename UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::ConstIterator UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::begin() const {
+	return ConstIterator(header->forward[0]);
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+typename UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::ConstIterator UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>::end() const {
+	return ConstIterator(nullptr);
+}
+
+template<class T, unsigned blockCapacity, unsigned maxLevel, class Promotion>
+struct OrderedSetTraits<UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>> {
+	using ValueType = T;
+	using Engine = UnrolledSkipList<T, blockCapacity, maxLevel, Promotion>;
+
+	static constexpr bool uniqueKeys = true;
+
+	static bool insert(Engine& engine, const T& elem) { return engine.insert(elem); }
+
+	static bool contains(const Engine& engine, const T& elem) { return engine.containsElement(elem); }
+
+	static bool remove(Engine& engine, const T& elem) { return engine.removeElement(elem); }
+
+	static size_t size(const Engine& engine) { return engine.elementsCount(); }
+};
+
+#endif // !UNROLLED_SKIP_LIST_HEADER_
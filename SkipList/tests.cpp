@@ -0,0 +1,1244 @@
+#include "SkipList.hpp"
+#include "DeterministicSkipList.hpp"
+#include "UnrolledSkipList.hpp"
+#include "InternedSkipList.hpp"
+#include "SkipListMap.hpp"
+#include "CountedSkipList.hpp"
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include"../../doctest.h"
+#include<algorithm>
+#include<climits>
+#include<cmath>
+#include<iterator>
+#include<map>
+#include<new>
+#include<random>
+#include<set>
+#include<string>
+#include<vector>
+
+template<class T, unsigned maxLevel, class Promotion>
+bool sameElements(const SkipList<T, maxLevel, Promotion>& list, const std::multiset<T>& expected) {
+	if (list.elementsCount() != expected.size())
+		return false;
+
+	auto it = expected.begin();
+	for (const T& elem : list) {
+		if (it == expected.end() || !(elem == *it))
+			return false;
+		++it;
+	}
+
+	return it == expected.end();
+}
+
+// Every level is a sublist of the one below it.
+template<class T, unsigned maxLevel, class Promotion>
+bool levelsShrink(const SkipList<T, maxLevel, Promotion>& list) {
+	std::vector<size_t> histogram = list.levelHistogram();
+
+	for (size_t i = 1; i < histogram.size(); i++) {
+		if (histogram[i] > histogram[i - 1])
+			return false;
+	}
+
+	return true;
+}
+
+template<unsigned maxLevel>
+void fillRandom(SkipList<int, maxLevel>& list, std::multiset<int>& expected, int count, int range) {
+	for (int i = 0; i < count; i++) {
+		int elem = rand() % range;
+		list.insert(elem);
+		expected.insert(elem);
+	}
+}
+
+TEST_CASE("eraseAll removes every copy") {
+	SkipList<int, 8> list;
+	std::multiset<int> expected;
+	fillRandom(list, expected, 5000, 300);
+
+	for (int i = 0; i < 400; i++) {
+		int elem = rand() % 320;
+		size_t copies = expected.erase(elem);
+
+		CHECK(list.eraseAll(elem) == copies);
+		CHECK(!list.containsElement(elem));
+	}
+
+	CHECK(sameElements(list, expected));
+	CHECK(levelsShrink(list));
+
+	SkipList<int, 8> same;
+	for (int i = 0; i < 100; i++)
+		same.insert(4);
+
+	CHECK(same.eraseAll(4) == 100);
+	CHECK(same.empty());
+	CHECK(same.eraseAll(4) == 0);
+}
+
+TEST_CASE("eraseRange removes a closed range") {
+	for (int round = 0; round < 50; round++) {
+		SkipList<int, 8> list;
+		std::multiset<int> expected;
+		fillRandom(list, expected, rand() % 2000, 1000);
+
+		int from = rand() % 1100 - 50;
+		int to = rand() % 1100 - 50;
+
+		size_t removed = 0;
+		if (from <= to) {
+			auto first = expected.lower_bound(from);
+			auto last = expected.upper_bound(to);
+			removed = std::distance(first, last);
+			expected.erase(first, last);
+		}
+
+		CHECK(list.eraseRange(from, to) == removed);
+		CHECK(sameElements(list, expected));
+		CHECK(levelsShrink(list));
+	}
+}
+
+TEST_CASE("eraseRange on empty, inverted and whole-list ranges") {
+	SkipList<int, 8> list;
+	std::multiset<int> expected;
+
+	CHECK(list.eraseRange(0, 100) == 0);
+	CHECK(list.empty());
+
+	fillRandom(list, expected, 1000, 100);
+
+	// Inverted: nothing is in [50, 10].
+	CHECK(list.eraseRange(50, 10) == 0);
+	CHECK(sameElements(list, expected));
+
+	// Above and below every value.
+	CHECK(list.eraseRange(150, 160) == 0);
+	CHECK(list.eraseRange(-20, -1) == 0);
+	CHECK(sameElements(list, expected));
+
+	CHECK(list.eraseRange(-1000, 1000) == 1000);
+	CHECK(list.empty());
+	CHECK(list.elementsCount() == 0);
+	CHECK(list.begin() == list.end());
+
+	list.insert(3);
+	CHECK(list.containsElement(3));
+	CHECK(list.elementsCount() == 1);
+}
+
+TEST_CASE("splitAt moves the elements >= key") {
+	std::vector<int> keys;
+	for (int i = 0; i < 1000; i++)
+		keys.push_back(2 * (i / 2));
+
+	// First, middle, last, absent between two keys, below and above every key.
+	for (int key : { 0, 500, 998, 501, -5, 2000 }) {
+		SkipList<int, 8> list;
+		std::multiset<int> low, high;
+
+		for (int elem : keys) {
+			list.insert(elem);
+			(elem < key ? low : high).insert(elem);
+		}
+
+		SkipList<int, 8> upper = list.splitAt(key);
+
+		CHECK(sameElements(list, low));
+		CHECK(sameElements(upper, high));
+		CHECK(levelsShrink(list));
+		CHECK(levelsShrink(upper));
+
+		// Both halves keep working.
+		list.insert(key - 1);
+		upper.insert(key + 1);
+		low.insert(key - 1);
+		high.insert(key + 1);
+		CHECK(sameElements(list, low));
+		CHECK(sameElements(upper, high));
+	}
+
+	SkipList<int, 8> empty;
+	SkipList<int, 8> none = empty.splitAt(3);
+	CHECK(empty.elementsCount() == 0);
+	CHECK(none.elementsCount() == 0);
+}
+
+TEST_CASE("splitAt keeps exact sizes and tombstone counts on both sides") {
+	for (int key : { 0, 100, 1500, 2900, 5000 }) {
+		SkipList<int, 10> list;
+		std::multiset<int> low, high;
+		size_t deadLow = 0, deadHigh = 0;
+
+		for (int i = 0; i < 3000; i++) {
+			list.insert(i);
+			(i < key ? low : high).insert(i);
+		}
+
+		// Few enough tombstones not to trigger a compaction.
+		for (int i = 0; i < 3000; i += 25) {
+			CHECK(list.markRemoved(i));
+			(i < key ? low : high).erase(i);
+			++(i < key ? deadLow : deadHigh);
+		}
+
+		SkipList<int, 10> upper = list.splitAt(key);
+
+		CHECK(list.elementsCount() == low.size());
+		CHECK(upper.elementsCount() == high.size());
+		CHECK(list.tombstonesCount() == deadLow);
+		CHECK(upper.tombstonesCount() == deadHigh);
+		CHECK(sameElements(list, low));
+		CHECK(sameElements(upper, high));
+	}
+}
+
+TEST_CASE("merge splices two lists") {
+	SkipList<int, 8> evens, odds;
+	std::multiset<int> expected;
+
+	for (int i = 0; i < 2000; i++) {
+		(i % 2 ? odds : evens).insert(i);
+		expected.insert(i);
+	}
+
+	// Interleaved, with repeats on both sides.
+	evens.insert(7);
+	odds.insert(7);
+	expected.insert(7);
+	expected.insert(7);
+
+	evens.merge(odds);
+	CHECK(sameElements(evens, expected));
+	CHECK(odds.elementsCount() == 0);
+	CHECK(odds.empty());
+	CHECK(levelsShrink(evens));
+
+	// Disjoint, other after this and other before this.
+	SkipList<int, 8> after, before;
+	for (int i = 5000; i < 5100; i++) {
+		after.insert(i);
+		expected.insert(i);
+	}
+	for (int i = -100; i < 0; i++) {
+		before.insert(i);
+		expected.insert(i);
+	}
+
+	evens.merge(after);
+	before.merge(evens);
+	CHECK(sameElements(before, expected));
+	CHECK(evens.elementsCount() == 0);
+
+	// Empty on either side.
+	SkipList<int, 8> empty;
+	before.merge(empty);
+	CHECK(sameElements(before, expected));
+
+	empty.merge(before);
+	CHECK(sameElements(empty, expected));
+	CHECK(before.empty());
+
+	// What splitAt cuts, merge puts back.
+	SkipList<int, 8> upper = empty.splitAt(1000);
+	empty.merge(upper);
+	CHECK(sameElements(empty, expected));
+	CHECK(levelsShrink(empty));
+}
+
+TEST_CASE("finger operations agree with plain ones on ascending keys") {
+	SkipList<int, 10> withFinger, plain;
+	std::multiset<int> expected;
+	auto finger = withFinger.finger();
+
+	for (int i = 0; i < 20000; i++) {
+		int elem = i / 3;
+		withFinger.insert(elem, finger);
+		plain.insert(elem);
+		expected.insert(elem);
+	}
+
+	CHECK(sameElements(withFinger, expected));
+	CHECK(sameElements(plain, expected));
+	CHECK(levelsShrink(withFinger));
+
+	auto lookup = withFinger.finger();
+	for (int i = -10; i < 7000; i++) {
+		bool found = withFinger.containsElement(i, lookup);
+		CHECK(found == plain.containsElement(i));
+		CHECK(found == (expected.count(i) != 0));
+	}
+}
+
+TEST_CASE("finger operations agree with plain ones on random keys") {
+	SkipList<int, 10> list;
+	std::multiset<int> expected;
+	auto finger = list.finger();
+
+	for (int i = 0; i < 20000; i++) {
+		int elem = rand() % 5000;
+
+		switch (rand() % 4) {
+		case 0:
+			list.insert(elem, finger);
+			expected.insert(elem);
+			break;
+		case 1:
+			CHECK(list.containsElement(elem, finger) == (expected.count(elem) != 0));
+			CHECK(list.containsElement(elem, finger) == list.containsElement(elem));
+			break;
+		case 2:
+			// Changes the list behind the finger's back, so the finger goes stale.
+			list.insert(elem);
+			expected.insert(elem);
+			break;
+		default: {
+			auto found = expected.find(elem);
+			CHECK(list.removeElement(elem) == (found != expected.end()));
+			if (found != expected.end())
+				expected.erase(found);
+		}
+		}
+	}
+
+	CHECK(sameElements(list, expected));
+	CHECK(levelsShrink(list));
+
+	// A finger taken from another list is ignored.
+	SkipList<int, 10> other;
+	auto foreign = other.finger();
+	for (int i = 0; i < 5000; i += 7)
+		CHECK(list.containsElement(i, foreign) == (expected.count(i) != 0));
+}
+
+TEST_CASE("insertBatch agrees with std::multiset") {
+	SkipList<int, 10> list;
+	std::multiset<int> expected;
+	fillRandom(list, expected, 2000, 5000);
+
+	for (int round = 0; round < 60; round++) {
+		std::vector<int> batch;
+		size_t batchSize = rand() % 1500;
+
+		// Narrow ranges give batches full of duplicates and of keys the list already has.
+		int range = (round % 3 == 0) ? 50 : 5000;
+		for (size_t i = 0; i < batchSize; i++)
+			batch.push_back(rand() % range);
+
+		if (round % 5 == 1)
+			std::sort(batch.begin(), batch.end());
+		else if (round % 5 == 2)
+			std::sort(batch.rbegin(), batch.rend());
+
+		list.insertBatch(batch);
+		expected.insert(batch.begin(), batch.end());
+
+		// Removals between the batches, so the next one also falls into gaps.
+		for (int i = 0; i < 200; i++) {
+			int elem = rand() % 5000;
+			auto found = expected.find(elem);
+			CHECK(list.removeElement(elem) == (found != expected.end()));
+			if (found != expected.end())
+				expected.erase(found);
+		}
+
+		CHECK(sameElements(list, expected));
+		CHECK(levelsShrink(list));
+	}
+
+	// Large enough to be sorted in parallel, from a range that is not a vector.
+	std::multiset<int> large;
+	for (int i = 0; i < 70000; i++)
+		large.insert(rand() % 100000);
+
+	list.insertBatch(large);
+	expected.insert(large.begin(), large.end());
+	CHECK(sameElements(list, expected));
+
+	for (int i = 0; i < 5000; i++)
+		CHECK(list.containsElement(i) == (expected.count(i) != 0));
+
+	SkipList<int, 10> empty;
+	empty.insertBatch(std::vector<int>());
+	CHECK(empty.empty());
+	empty.insertBatch(std::vector<int>(100, 7));
+	CHECK(empty.elementsCount() == 100);
+	CHECK(empty.eraseAll(7) == 100);
+}
+
+TEST_CASE("bloom filter never hides existing elements") {
+	SkipList<int, 10> list;
+	std::multiset<int> expected;
+
+	// Sized far too small, so the filter is rebuilt while it grows.
+	list.enableBloomFilter(100, 0.01);
+
+	for (int i = 0; i < 20000; i++) {
+		int elem = rand() % 5000;
+
+		switch (rand() % 4) {
+		case 0:
+		case 1:
+			list.insert(elem);
+			expected.insert(elem);
+			break;
+		case 2: {
+			auto found = expected.find(elem);
+			CHECK(list.removeElement(elem) == (found != expected.end()));
+			if (found != expected.end())
+				expected.erase(found);
+			break;
+		}
+		default: {
+			auto found = expected.find(elem);
+			CHECK(list.markRemoved(elem) == (found != expected.end()));
+			if (found != expected.end())
+				expected.erase(found);
+		}
+		}
+	}
+
+	for (int i = 0; i < 5000; i++)
+		CHECK(list.containsElement(i) == (expected.count(i) != 0));
+
+	// Copies, eraseAll, eraseRange and merge keep the filter in step with the elements.
+	SkipList<int, 10> copy(list), other;
+	for (int i = 6000; i < 6500; i++) {
+		other.insert(i);
+		expected.insert(i);
+	}
+
+	copy.merge(other);
+	CHECK(copy.eraseAll(17) == expected.erase(17));
+	CHECK(copy.eraseRange(100, 200) == static_cast<size_t>(std::distance(expected.lower_bound(100), expected.upper_bound(200))));
+	expected.erase(expected.lower_bound(100), expected.upper_bound(200));
+
+	for (int i = 0; i < 7000; i++)
+		CHECK(copy.containsElement(i) == (expected.count(i) != 0));
+
+	CHECK(sameElements(copy, expected));
+}
+
+TEST_CASE("freeze and thaw keep the live elements") {
+	SkipList<int, 10> list;
+	std::multiset<int> expected;
+	fillRandom(list, expected, 30000, 20000);
+
+	// Tombstones must not reach the frozen copy.
+	for (int i = 0; i < 20000; i += 3) {
+		auto found = expected.find(i);
+		CHECK(list.markRemoved(i) == (found != expected.end()));
+		if (found != expected.end())
+			expected.erase(found);
+	}
+
+	std::set<int> unique(expected.begin(), expected.end());
+	FrozenSet<int> frozen = list.freeze();
+	CHECK(frozen.size() == unique.size());
+
+	for (int i = -1; i <= 20001; i++) {
+		std::set<int>::const_iterator bound = unique.lower_bound(i);
+		const int* frozenBound = frozen.lowerBound(i);
+
+		CHECK(frozen.contains(i) == (unique.count(i) == 1));
+		CHECK((frozenBound == nullptr) == (bound == unique.end()));
+		if (frozenBound && bound != unique.end())
+			CHECK(*frozenBound == *bound);
+	}
+
+	// Repeated values come back once.
+	SkipList<int, 10> thawed = SkipList<int, 10>::thaw(frozen);
+	std::multiset<int> thawedExpected(unique.begin(), unique.end());
+	CHECK(sameElements(thawed, thawedExpected));
+	CHECK(thawed.tombstonesCount() == 0);
+	CHECK(levelsShrink(thawed));
+
+	// The thawed list is an ordinary list.
+	for (int i = 0; i < 1000; i++) {
+		int elem = rand() % 20000;
+		thawed.insert(elem);
+		thawedExpected.insert(elem);
+
+		elem = rand() % 20000;
+		auto found = thawedExpected.find(elem);
+		CHECK(thawed.removeElement(elem) == (found != thawedExpected.end()));
+		if (found != thawedExpected.end())
+			thawedExpected.erase(found);
+	}
+
+	CHECK(sameElements(thawed, thawedExpected));
+
+	FrozenSet<int> empty = SkipList<int, 10>().freeze();
+	CHECK(!empty.contains(0));
+	CHECK(empty.lowerBound(0) == nullptr);
+	CHECK(SkipList<int, 10>::thaw(empty).empty());
+}
+
+// Only the comparisons, no std::hash: the list must not need one unless its filter is enabled.
+struct OrderedOnly {
+	int value;
+
+	bool operator==(const OrderedOnly& other) const { return value == other.value; }
+	bool operator<(const OrderedOnly& other) const { return value < other.value; }
+	bool operator>(const OrderedOnly& other) const { return value > other.value; }
+};
+
+TEST_CASE("keys without std::hash work without a bloom filter") {
+	CHECK_FALSE(IsHashable<OrderedOnly>::value);
+
+	SkipList<OrderedOnly, 8> list;
+	std::multiset<int> expected;
+
+	for (int i = 0; i < 5000; i++) {
+		int elem = rand() % 1000;
+
+		if (rand() % 3) {
+			list.insert({ elem });
+			expected.insert(elem);
+		}
+		else {
+			auto found = expected.find(elem);
+			CHECK(list.removeElement({ elem }) == (found != expected.end()));
+			if (found != expected.end())
+				expected.erase(found);
+		}
+	}
+
+	CHECK(list.eraseAll({ 7 }) == expected.erase(7));
+	CHECK(list.eraseRange({ 100 }, { 200 }) == static_cast<size_t>(std::distance(expected.lower_bound(100), expected.upper_bound(200))));
+	expected.erase(expected.lower_bound(100), expected.upper_bound(200));
+
+	SkipList<OrderedOnly, 8> copy(list);
+	CHECK(copy.elementsCount() == expected.size());
+
+	auto it = expected.begin();
+	for (const OrderedOnly& elem : copy) {
+		CHECK(elem.value == *it);
+		++it;
+	}
+}
+
+// Every gap holds 1, 2 or 3 nodes of the level below.
+template<class T>
+bool validGaps(const DeterministicSkipList<T>& list) {
+	std::vector<size_t> histogram = list.gapHistogram();
+
+	if (list.empty())
+		return histogram.empty();
+
+	return histogram.size() <= 4 && histogram[0] == 0;
+}
+
+template<class T>
+bool correctHeight(const DeterministicSkipList<T>& list) {
+	if (list.empty())
+		return list.getHeight() == 0;
+
+	return list.getHeight() <= log2(list.elementsCount() + 1) + 1;
+}
+
+template<class T>
+bool sameElements(const DeterministicSkipList<T>& list, const std::set<T>& expected) {
+	if (list.elementsCount() != expected.size())
+		return false;
+
+	auto it = expected.begin();
+	for (const T& elem : list) {
+		if (it == expected.end() || !(elem == *it))
+			return false;
+		++it;
+	}
+
+	return it == expected.end();
+}
+
+TEST_CASE("deterministic skip list matches std::set under random operations") {
+	DeterministicSkipList<int> list;
+	std::set<int> expected;
+
+	for (int i = 0; i < 200000; i++) {
+		int elem = rand() % 5000;
+
+		switch (rand() % 3) {
+		case 0:
+			CHECK(list.insert(elem) == expected.insert(elem).second);
+			break;
+		case 1:
+			CHECK(list.removeElement(elem) == (expected.erase(elem) == 1));
+			break;
+		default:
+			CHECK(list.containsElement(elem) == (expected.count(elem) == 1));
+		}
+
+		if (i % 5000 == 0) {
+			CHECK(validGaps(list));
+			CHECK(correctHeight(list));
+		}
+	}
+
+	CHECK(sameElements(list, expected));
+	CHECK(validGaps(list));
+
+	DeterministicSkipList<int> copy(list);
+	std::set<int> copied = expected;
+	CHECK(sameElements(copy, expected));
+	CHECK(validGaps(copy));
+
+	for (int elem : std::vector<int>(expected.begin(), expected.end())) {
+		CHECK(list.removeElement(elem));
+		expected.erase(elem);
+
+		if (expected.size() % 500 == 0 || expected.size() < 20) {
+			CHECK(validGaps(list));
+			CHECK(correctHeight(list));
+		}
+	}
+
+	CHECK(list.empty());
+	CHECK(list.getHeight() == 0);
+	CHECK(sameElements(copy, copied));
+}
+
+TEST_CASE("deterministic skip list keeps its gaps on sorted input") {
+	// Ascending and descending inserts always hit the same gap, the worst case for the splits.
+	DeterministicSkipList<int> ascending, descending;
+
+	for (int i = 0; i < 100000; i++) {
+		CHECK(ascending.insert(i));
+		CHECK(descending.insert(-i));
+	}
+
+	CHECK_FALSE(ascending.insert(500));
+	CHECK(validGaps(ascending));
+	CHECK(validGaps(descending));
+	CHECK(correctHeight(ascending));
+	CHECK(correctHeight(descending));
+
+	// Removing from one end drains the same gaps again and again.
+	for (int i = 0; i < 99000; i++)
+		CHECK(ascending.removeElement(i));
+
+	CHECK(ascending.elementsCount() == 1000);
+	CHECK(validGaps(ascending));
+	CHECK(correctHeight(ascending));
+	CHECK(ascending.containsElement(99999));
+	CHECK_FALSE(ascending.containsElement(0));
+}
+
+// Never promotes: every node stays on level 1, so the list degenerates to a sorted linked list.
+struct NoPromotion {
+	static constexpr double probability() { return 0; }
+
+	static bool promote() { return false; }
+
+	static constexpr unsigned recommendedMaxLevel(size_t) { return 1; }
+};
+
+TEST_CASE("level histogram counts every element on level 1") {
+	SkipList<int, 12, QuarterPromotion> list;
+	std::multiset<int> expected;
+
+	for (int i = 0; i < 50000; i++) {
+		int elem = rand() % 20000;
+		list.insert(elem);
+		expected.insert(elem);
+	}
+
+	std::vector<size_t> histogram = list.levelHistogram();
+	REQUIRE(!histogram.empty());
+	CHECK(histogram[0] == list.elementsCount());
+	CHECK(levelsShrink(list));
+
+	// Nodes with exactly i + 1 levels, summed over i, are all the nodes.
+	ListShape shape = list.analyze();
+	size_t towers = 0;
+	for (size_t count : shape.towerHistogram)
+		towers += count;
+	CHECK(towers == list.elementsCount());
+
+	// With p = 1/4 every level keeps about a quarter of the one below.
+	for (size_t i = 1; i < histogram.size() && histogram[i - 1] >= 1000; i++) {
+		double ratio = static_cast<double>(histogram[i]) / histogram[i - 1];
+		CHECK(0.2 < ratio);
+		CHECK(ratio < 0.3);
+	}
+
+	CHECK(QuarterPromotion::recommendedMaxLevel(100000) == 9);
+	CHECK(HalfPromotion::recommendedMaxLevel(1024) == 10);
+
+	// Removals unlink whole towers.
+	for (int i = 0; i < 20000; i += 2) {
+		size_t copies = expected.erase(i);
+		CHECK(list.eraseAll(i) == copies);
+	}
+
+	histogram = list.levelHistogram();
+	CHECK(histogram[0] == list.elementsCount());
+	CHECK(list.elementsCount() == expected.size());
+	CHECK(levelsShrink(list));
+}
+
+// Fraction of promote() calls that say yes.
+template<class Promotion>
+double promotedFraction(int draws) {
+	int promoted = 0;
+	for (int i = 0; i < draws; i++)
+		promoted += Promotion::promote();
+
+	return static_cast<double>(promoted) / draws;
+}
+
+TEST_CASE("denominators above RAND_MAX keep their probability") {
+	// With rand() % denominator and RAND_MAX = 32767 both of these were promoted every time.
+	CHECK(std::abs(promotedFraction<InverseEPromotion>(1000000) - InverseEPromotion::probability()) < 0.005);
+	CHECK(promotedFraction<RationalPromotion<1, 1000000>>(1000000) < 0.0001);
+	CHECK(std::abs(promotedFraction<RationalPromotion<99999, 100000>>(1000000) - 0.99999) < 0.0001);
+
+	SkipList<int, 16, InverseEPromotion> list;
+	for (int i = 0; i < 100000; i++)
+		list.insert(i);
+
+	// Level i + 1 keeps about 1/e of level i; towers of maxLevel are the exception, not the rule.
+	std::vector<size_t> histogram = list.levelHistogram();
+	REQUIRE(histogram.size() > 3);
+	CHECK(histogram.size() < 16);
+
+	for (size_t i = 1; i < histogram.size() && histogram[i - 1] >= 1000; i++) {
+		double ratio = static_cast<double>(histogram[i]) / histogram[i - 1];
+		CHECK(0.33 < ratio);
+		CHECK(ratio < 0.41);
+	}
+}
+
+TEST_CASE("a policy that never promotes keeps one level") {
+	SkipList<int, 8, NoPromotion> list;
+	std::multiset<int> expected;
+
+	for (int i = 0; i < 3000; i++) {
+		int elem = rand() % 1000;
+		list.insert(elem);
+		expected.insert(elem);
+	}
+
+	std::vector<size_t> histogram = list.levelHistogram();
+	REQUIRE(histogram.size() == 1);
+	CHECK(histogram[0] == 3000);
+	CHECK(sameElements(list, expected));
+
+	for (int i = 0; i < 1000; i += 3) {
+		auto found = expected.find(i);
+		CHECK(list.removeElement(i) == (found != expected.end()));
+		if (found != expected.end())
+			expected.erase(found);
+	}
+
+	CHECK(list.levelHistogram().size() == 1);
+	CHECK(sameElements(list, expected));
+}
+
+template<class T, unsigned blockCapacity>
+bool sameElements(const UnrolledSkipList<T, blockCapacity>& list, const std::set<T>& expected) {
+	if (list.elementsCount() != expected.size())
+		return false;
+
+	auto it = expected.begin();
+	for (const T& elem : list) {
+		if (it == expected.end() || !(elem == *it))
+			return false;
+		++it;
+	}
+
+	return it == expected.end();
+}
+
+// Full blocks are split and blocks under a quarter full are merged, only the last one can stay smaller.
+template<class T, unsigned blockCapacity>
+bool blocksFilled(const UnrolledSkipList<T, blockCapacity>& list) {
+	size_t elements = list.elementsCount();
+	size_t blocks = list.blocksCount();
+
+	if (elements == 0)
+		return blocks == 0;
+
+	return (elements + blockCapacity - 1) / blockCapacity <= blocks && blocks <= elements / (blockCapacity / 4) + 1;
+}
+
+template<class T, unsigned blockCapacity, class Make>
+void checkAgainstSet(UnrolledSkipList<T, blockCapacity>& list, int operations, int range, Make make) {
+	std::set<T> expected;
+
+	for (int i = 0; i < operations; i++) {
+		T elem = make(rand() % range);
+
+		switch (rand() % 3) {
+		case 0:
+			CHECK(list.insert(elem) == expected.insert(elem).second);
+			break;
+		case 1:
+			CHECK(list.removeElement(elem) == (expected.erase(elem) == 1));
+			break;
+		default:
+			CHECK(list.containsElement(elem) == (expected.count(elem) == 1));
+		}
+
+		if (i % 5000 == 0)
+			CHECK(blocksFilled(list));
+	}
+
+	CHECK(sameElements(list, expected));
+	CHECK(blocksFilled(list));
+
+	UnrolledSkipList<T, blockCapacity> copy(list);
+	CHECK(sameElements(copy, expected));
+
+	// Down to empty, in random order, so blocks in the middle borrow and merge.
+	std::vector<T> remaining(expected.begin(), expected.end());
+	std::shuffle(remaining.begin(), remaining.end(), std::mt19937(static_cast<unsigned>(operations)));
+
+	for (const T& elem : remaining) {
+		CHECK(list.removeElement(elem));
+		CHECK_FALSE(list.containsElement(elem));
+		expected.erase(elem);
+
+		if (expected.size() % 1000 == 0)
+			CHECK(blocksFilled(list));
+	}
+
+	CHECK(list.empty());
+	CHECK(list.blocksCount() == 0);
+	CHECK(list.begin() == list.end());
+
+	// An emptied list is still usable.
+	CHECK(list.insert(make(1)));
+	CHECK(list.containsElement(make(1)));
+	CHECK(copy.elementsCount() == remaining.size());
+}
+
+TEST_CASE("unrolled skip list of ints matches std::set") {
+	UnrolledSkipList<int, 16> list;
+	checkAgainstSet(list, 200000, 20000, [](int x) { return x - 10000; });
+
+	// Ascending inserts split only the last block.
+	UnrolledSkipList<int, 8> ascending;
+	std::set<int> expected;
+	for (int i = 0; i < 10000; i++) {
+		CHECK(ascending.insert(i));
+		expected.insert(i);
+	}
+
+	CHECK(sameElements(ascending, expected));
+	CHECK(blocksFilled(ascending));
+	CHECK_FALSE(ascending.insert(5000));
+}
+
+TEST_CASE("unrolled skip list of strings matches std::set") {
+	UnrolledSkipList<std::string, 16> list;
+	checkAgainstSet(list, 100000, 10000, [](int x) { return "key" + std::to_string(x); });
+}
+
+TEST_CASE("block search finds the lower bound for every count") {
+	int keys[16];
+	for (int i = 0; i < 16; i++)
+		keys[i] = 3 * i - 20;
+	keys[0] = INT_MIN;
+	keys[15] = INT_MAX;
+
+	for (unsigned count = 0; count <= 16; count++) {
+		for (int elem : { INT_MIN, INT_MAX, -21, -20, -19, 0, 1, 22, 23, 24 }) {
+			unsigned expected = static_cast<unsigned>(std::lower_bound(keys, keys + count, elem) - keys);
+			CHECK(BlockSearch<int>::lowerBound(keys, count, elem) == expected);
+		}
+	}
+}
+
+TEST_CASE("insert revives a tombstone instead of linking a new node") {
+	SkipList<int, 8> list;
+
+	for (int i = 0; i < 100; i++)
+		list.insert(i);
+
+	CHECK(list.markRemoved(50));
+	CHECK_FALSE(list.containsElement(50));
+	CHECK(list.tombstonesCount() == 1);
+	CHECK(list.elementsCount() == 99);
+	CHECK(list.levelHistogram()[0] == 100);
+
+	list.insert(50);
+	CHECK(list.containsElement(50));
+	CHECK(list.tombstonesCount() == 0);
+	CHECK(list.elementsCount() == 100);
+	CHECK(list.levelHistogram()[0] == 100);
+
+	// One of two copies: the other stays, the dead one comes back.
+	list.insert(7);
+	CHECK(list.markRemoved(7));
+	CHECK(list.containsElement(7));
+	CHECK(list.markRemoved(7));
+	CHECK_FALSE(list.containsElement(7));
+	CHECK_FALSE(list.markRemoved(7));
+	CHECK(list.tombstonesCount() == 2);
+
+	list.insert(7);
+	CHECK(list.tombstonesCount() == 1);
+	CHECK(list.elementsCount() == 100);
+	CHECK(list.levelHistogram()[0] == 101);
+}
+
+TEST_CASE("finger and batch inserts revive tombstones like insert") {
+	SkipList<int, 8> list;
+
+	for (int i = 0; i < 100; i++)
+		list.insert(i);
+
+	for (int i = 10; i < 20; i++)
+		CHECK(list.markRemoved(i));
+	CHECK(list.tombstonesCount() == 10);
+
+	auto finger = list.finger();
+	for (int i = 10; i < 15; i++)
+		list.insert(i, finger);
+
+	CHECK(list.tombstonesCount() == 5);
+	CHECK(list.elementsCount() == 95);
+	CHECK(list.levelHistogram()[0] == 100);
+
+	// Two copies of 15, but only one tombstone of it: the second copy gets a new node.
+	list.insertBatch(std::vector<int>{ 19, 15, 17, 16, 18, 15 });
+	CHECK(list.tombstonesCount() == 0);
+	CHECK(list.elementsCount() == 101);
+	CHECK(list.levelHistogram()[0] == 101);
+
+	for (int i = 10; i < 20; i++)
+		CHECK(list.containsElement(i, finger));
+	CHECK(list.eraseAll(15) == 2);
+}
+
+TEST_CASE("exceptionSafeSearch finds live equal elements only") {
+	SkipList<int, 8> list;
+	int result = -1;
+
+	CHECK_FALSE(list.exceptionSafeSearch(5, result));
+
+	for (int i = 0; i < 100; i += 2)
+		list.insert(i);
+
+	CHECK(list.exceptionSafeSearch(40, result));
+	CHECK(result == 40);
+
+	// A key between two elements, and one after the last.
+	result = -1;
+	CHECK_FALSE(list.exceptionSafeSearch(41, result));
+	CHECK_FALSE(list.exceptionSafeSearch(1000, result));
+	CHECK(result == -1);
+
+	CHECK(list.markRemoved(40));
+	CHECK_FALSE(list.exceptionSafeSearch(40, result));
+	CHECK(result == -1);
+
+	// A live copy behind a tombstone is still found.
+	list.insert(60);
+	CHECK(list.markRemoved(60));
+	CHECK(list.exceptionSafeSearch(60, result));
+	CHECK(result == 60);
+}
+
+TEST_CASE("tombstones are compacted once they reach half of the live elements") {
+	// 1000 elements: k tombstones are compacted when k >= 256 and 2k >= 1000 - k, so at k = 334.
+	SkipList<int, 10> list;
+	for (int i = 0; i < 1000; i++)
+		list.insert(i);
+
+	for (int i = 0; i < 333; i++)
+		CHECK(list.markRemoved(3 * i));
+
+	CHECK(list.tombstonesCount() == 333);
+	CHECK(list.levelHistogram()[0] == 1000);
+
+	CHECK(list.markRemoved(999));
+	CHECK(list.tombstonesCount() == 0);
+	CHECK(list.elementsCount() == 666);
+	CHECK(list.levelHistogram()[0] == 666);
+	CHECK(levelsShrink(list));
+
+	// Fewer than minTombstones are kept, however few live elements are left.
+	SkipList<int, 10> small;
+	for (int i = 0; i < 300; i++)
+		small.insert(i);
+
+	for (int i = 0; i < 255; i++)
+		CHECK(small.markRemoved(i));
+
+	CHECK(small.tombstonesCount() == 255);
+	CHECK(small.elementsCount() == 45);
+
+	CHECK(small.markRemoved(255));
+	CHECK(small.tombstonesCount() == 0);
+	CHECK(small.levelHistogram()[0] == 44);
+
+	// compact() by hand.
+	CHECK(small.markRemoved(299));
+	small.compact();
+	CHECK(small.tombstonesCount() == 0);
+	CHECK(small.levelHistogram()[0] == 43);
+}
+
+TEST_CASE("tombstones are invisible to iteration, find, copies, splitAt and merge") {
+	SkipList<int, 10> list;
+	std::multiset<int> expected;
+	fillRandom(list, expected, 3000, 1000);
+
+	// Few enough not to trigger a compaction.
+	for (int i = 0; i < 200; i++) {
+		int elem = rand() % 1000;
+		auto found = expected.find(elem);
+
+		CHECK(list.markRemoved(elem) == (found != expected.end()));
+		if (found != expected.end())
+			expected.erase(found);
+	}
+
+	REQUIRE(list.tombstonesCount() > 0);
+	CHECK(sameElements(list, expected));
+
+	for (int i = 0; i < 1000; i++) {
+		const int* found = list.find(i);
+		CHECK((found != nullptr) == (expected.count(i) != 0));
+		if (found)
+			CHECK(*found == i);
+	}
+
+	SkipList<int, 10> copy(list);
+	CHECK(sameElements(copy, expected));
+	CHECK(copy.tombstonesCount() == list.tombstonesCount());
+
+	SkipList<int, 10> assigned;
+	assigned = list;
+	CHECK(sameElements(assigned, expected));
+
+	std::multiset<int> low(expected.begin(), expected.lower_bound(500));
+	std::multiset<int> high(expected.lower_bound(500), expected.end());
+
+	SkipList<int, 10> upper = copy.splitAt(500);
+	CHECK(sameElements(copy, low));
+	CHECK(sameElements(upper, high));
+	CHECK(copy.tombstonesCount() + upper.tombstonesCount() == list.tombstonesCount());
+
+	// Merging back the halves, and a list of tombstones only.
+	copy.merge(upper);
+	CHECK(sameElements(copy, expected));
+
+	SkipList<int, 10> dead;
+	for (int i = 0; i < 50; i++)
+		dead.insert(i * 20);
+	for (int i = 0; i < 50; i++)
+		CHECK(dead.markRemoved(i * 20));
+
+	CHECK(dead.elementsCount() == 0);
+	CHECK(dead.begin() == dead.end());
+
+	copy.merge(dead);
+	CHECK(sameElements(copy, expected));
+	CHECK(dead.tombstonesCount() == 0);
+	CHECK(dead.levelHistogram().empty());
+	CHECK(copy.tombstonesCount() == list.tombstonesCount() + 50);
+
+	// After a compaction nothing changes but the node count.
+	copy.compact();
+	CHECK(sameElements(copy, expected));
+	CHECK(copy.levelHistogram()[0] == expected.size());
+}
+
+TEST_CASE("interned list keeps keys after compaction") {
+	InternedSkipList<12> list;
+	std::multiset<std::string> expected;
+
+	for (int i = 0; i < 30000; i++) {
+		std::string key = "key-" + std::to_string(rand() % 8000) + std::string(rand() % 40, 'x');
+
+		switch (rand() % 5) {
+		case 0:
+		case 1:
+			list.insert(key);
+			expected.insert(key);
+			break;
+		case 2:
+			CHECK(list.eraseAll(key) == expected.erase(key));
+			break;
+		default: {
+			auto found = expected.find(key);
+			CHECK(list.removeElement(key) == (found != expected.end()));
+			if (found != expected.end())
+				expected.erase(found);
+		}
+		}
+	}
+
+	CHECK(list.elementsCount() == expected.size());
+	CHECK(list.keyArena().deadBytes() <= list.keyArena().liveBytes() + 64 * 1024);
+
+	InternedSkipList<12> copy(list);
+	list.compact();
+
+	CHECK(list.keyArena().deadBytes() == 0);
+	CHECK(copy.keyArena().deadBytes() == 0);
+	CHECK(copy.elementsCount() == expected.size());
+
+	for (const InternedSkipList<12>* interned : { &list, &copy }) {
+		auto it = expected.begin();
+		for (const ArenaString& key : *interned) {
+			REQUIRE(it != expected.end());
+			CHECK(key.view() == *it);
+			++it;
+		}
+		CHECK(it == expected.end());
+	}
+
+	for (const std::string& key : expected)
+		CHECK(list.containsElement(key));
+	CHECK(!list.containsElement("missing"));
+
+	// The copy owns its bytes: emptying the original leaves it intact.
+	for (const std::string& key : std::set<std::string>(expected.begin(), expected.end()))
+		list.eraseAll(key);
+
+	CHECK(list.empty());
+	CHECK(copy.elementsCount() == expected.size());
+	for (const std::string& key : expected)
+		CHECK(copy.containsElement(key));
+}
+
+TEST_CASE("map keeps values out of the nodes") {
+	SkipListMap<std::string, std::vector<int>> map;
+	std::map<std::string, std::vector<int>> expected;
+
+	for (int i = 0; i < 20000; i++) {
+		std::string key = std::to_string(rand() % 3000);
+		int op = rand() % 4;
+
+		if (op == 0) {
+			std::vector<int>& value = map.insertOrAssign(key, std::vector<int>(3, i));
+			expected[key] = std::vector<int>(3, i);
+			CHECK(value == expected[key]);
+		}
+		else if (op == 1) {
+			std::pair<std::vector<int>&, bool> result = map.tryEmplace(key, 2, i);
+			bool inserted = expected.emplace(key, std::vector<int>(2, i)).second;
+			CHECK(result.second == inserted);
+			CHECK(result.first == expected[key]);
+		}
+		else if (op == 2) {
+			CHECK(map.erase(key) == (expected.erase(key) == 1));
+		}
+		else {
+			std::vector<int>* value = map.find(key);
+			CHECK((value != nullptr) == (expected.count(key) == 1));
+			if (value)
+				value->push_back(i), expected[key].push_back(i);
+		}
+	}
+
+	CHECK(map.size() == expected.size());
+
+	SkipListMap<std::string, std::vector<int>> copy(map);
+	map.insertOrAssign("changed", std::vector<int>());
+
+	CHECK(!copy.contains("changed"));
+	CHECK(copy.size() == expected.size());
+
+	auto entry = copy.begin();
+	for (const std::pair<const std::string, std::vector<int>>& pair : expected) {
+		REQUIRE(entry != copy.end());
+		CHECK((*entry).key == pair.first);
+		CHECK(*(*entry).value == pair.second);
+		++entry;
+	}
+	CHECK(entry == copy.end());
+}
+
+// A key whose copies can be made to throw, as if the allocation of the node failed.
+struct FragileKey {
+	static bool failCopies;
+	int value;
+
+	explicit FragileKey(int value) : value(value) {}
+
+	FragileKey(const FragileKey& other) : value(other.value) {
+		if (failCopies)
+			throw std::bad_alloc();
+	}
+
+	bool operator==(const FragileKey& other) const { return value == other.value; }
+
+	bool operator<(const FragileKey& other) const { return value < other.value; }
+};
+
+bool FragileKey::failCopies = false;
+
+TEST_CASE("map releases the value slot when the key cannot be stored") {
+	SkipListMap<FragileKey, std::string> map;
+
+	for (int i = 0; i < 100; i++)
+		map.tryEmplace(FragileKey(i), std::to_string(i));
+
+	FragileKey::failCopies = true;
+	CHECK_THROWS(map.tryEmplace(FragileKey(1000), "lost"));
+	CHECK_THROWS(map.insertOrAssign(FragileKey(1001), std::string("lost")));
+	FragileKey::failCopies = false;
+
+	CHECK(map.size() == 100);
+	CHECK(!map.contains(FragileKey(1000)));
+
+	// The released slot is reused.
+	map.tryEmplace(FragileKey(1000), "kept");
+	CHECK(map.size() == 101);
+	CHECK(*map.find(FragileKey(1000)) == "kept");
+}
+
+TEST_CASE("counted list keeps one node per key") {
+	CountedSkipList<int> list;
+	std::map<int, size_t> expected;
+	size_t total = 0;
+
+	for (int i = 0; i < 20000; i++) {
+		int elem = rand() % 500;
+		int op = rand() % 7;
+
+		if (op < 4) {
+			CHECK(list.insert(elem) == ++expected[elem]);
+			++total;
+		}
+		else if (op < 6) {
+			bool present = expected.count(elem) == 1;
+			CHECK(list.decrement(elem) == present);
+
+			if (present) {
+				--total;
+				if (--expected[elem] == 0)
+					expected.erase(elem);
+			}
+		}
+		else {
+			size_t removed = expected.count(elem) ? expected[elem] : 0;
+			CHECK(list.removeAll(elem) == removed);
+			expected.erase(elem);
+			total -= removed;
+		}
+
+		CHECK(list.count(elem) == (expected.count(elem) ? expected[elem] : 0));
+	}
+
+	CHECK(list.size() == total);
+	CHECK(list.distinctCount() == expected.size());
+
+	auto entry = list.begin();
+	for (const std::pair<const int, size_t>& pair : expected) {
+		REQUIRE(entry != list.end());
+		CHECK((*entry).key == pair.first);
+		CHECK((*entry).count == pair.second);
+		++entry;
+	}
+	CHECK(entry == list.end());
+}
@@ -0,0 +1,402 @@
+#ifndef SPLAY_TREE_HEADER
+#define SPLAY_TREE_HEADER
+#include<stack>
+#include<stdexcept>
+#include<utility>
+#include"../Common/OrderedSet.hpp"
+
+/*
+* Top-down splay tree (Sleator and Tarjan) with the API of AVLTree.
+*
+* Every access moves the accessed key to the root. While we walk down, the nodes smaller
+* than the key are hung on a left tree and the bigger ones on a right tree; at the end the
+* last node becomes the root with the two trees as its subtrees. Zig-zig steps rotate first,
+* which roughly halves the depth of every node on the path.
+*
+* No balance information is kept. Any single operation can cost O(n), but m operations cost
+* O((m + n) log n), and a key accessed again after k other distinct keys costs O(log k)
+* (the working-set property), so on skewed queries the hot keys stay near the root.
+*
+* exists splays too, so it changes the tree although it is const (root is mutable).
+* The tree is not safe to read from several threads at once.
+*
+* The tree can degenerate into a path of n nodes (for example after sorted pushes),
+* so nothing here recurses on the depth.
+*/
+
+template<class T>
+class SplayTree {
+private:
+	struct Node {
+		T data;
+		Node* left;
+		Node* right;
+
+		Node(const T& data, Node* l = nullptr, Node* r = nullptr) : data(data), left(l), right(r) {}
+	};
+
+	mutable Node* root;
+	int nodesCount;
+
+	// Brings the node with key (or the last node on its search path) to the top of t and returns it.
+	static Node* splay(Node* t, const T& key);
+
+	static Node* copyNodes(const Node* from);
+
+	void free();
+
+public:
+	class ConstIterator {
+	private:
+		std::stack<const Node*> currentNodes;
+
+		ConstIterator(const Node* startNode) {
+			init(startNode);
+		}
+
+		void init(const Node* initializeFrom) {
+			while (initializeFrom) {
+				currentNodes.push(initializeFrom);
+				initializeFrom = initializeFrom->left;
+			}
+		}
+
+		bool emptyStack() const { return currentNodes.empty(); }
+	public:
+		bool operator==(const ConstIterator& other) const {
+			if (emptyStack() && other.emptyStack())
+				return true;
+
+			else if (emptyStack() || other.emptyStack()) {
+				return false;
+			}
+
+			return (currentNodes.top() == other.currentNodes.top());
+		}
+
+		bool operator!=(const ConstIterator& other) const {
+			return !(this->operator==(other));
+		}
+
+		ConstIterator& operator++() {
+			const Node* current = currentNodes.top();
+			currentNodes.pop();
+			init(current->right);
+
+			return *this;
+		}
+
+		ConstIterator operator++(int) {
+			ConstIterator temp = *this;
+			++*this;
+			return temp;
+		}
+
+		const T& operator*() const {
+			if (emptyStack())
+				throw std::runtime_error("Reached end of collection!");
+
+			return currentNodes.top()->data;
+		}
+
+		friend class SplayTree;
+	};
+
+	SplayTree() : root(nullptr), nodesCount(0) {}
+
+	SplayTree(const SplayTree& other) : root(copyNodes(other.root)), nodesCount(other.nodesCount) {}
+
+	SplayTree(SplayTree&& other) noexcept : root(other.root), nodesCount(other.nodesCount) {
+		other.root = nullptr;
+		other.nodesCount = 0;
+	}
+
+	SplayTree& operator=(const SplayTree& other);
+
+	SplayTree& operator=(SplayTree&& other) noexcept;
+
+	// 1 if elem was inserted, -1 if it was already there.
+	int push(const T& elem);
+
+	bool exists(const T& elem) const;
+
+	// 1 if elem was removed, -1 if it was not found.
+	int removeElement(const T& elem);
+
+	int getNodesCount() const {
+		return nodesCount;
+	}
+
+	// O(n), the tree keeps no heights.
+	int getHeight() const;
+
+	bool isEmpty() const {
+		return root == nullptr;
+	}
+
+	ConstIterator begin() const {
+		return ConstIterator(root);
+	}
+
+	ConstIterator cbegin() const {
+		return ConstIterator(root);
+	}
+
+	ConstIterator end() const {
+		return ConstIterator(nullptr);
+	}
+
+	ConstIterator cend() const {
+		return ConstIterator(nullptr);
+	}
+
+	~SplayTree() {
+		free();
+	}
+};
+
+/*
+* leftHook is where the next node smaller than key goes: the right pointer of the maximum
+* of the left tree (the left tree itself while it is empty). rightHook is the same for the right tree.
+*/
+template<class T>
+typename SplayTree<T>::Node* SplayTree<T>::splay(Node* t, const T& key) {
+	if (!t)
+		return nullptr;
+
+	Node* leftTree = nullptr;
+	Node* rightTree = nullptr;
+	Node** leftHook = &leftTree;
+	Node** rightHook = &rightTree;
+
+	while (true) {
+		if (key < t->data) {
+			if (!t->left)
+				break;
+
+			// Zig-zig: rotate right before linking.
+			if (key < t->left->data) {
+				Node* child = t->left;
+				t->left = child->right;
+				child->right = t;
+				t = child;
+
+				if (!t->left)
+					break;
+			}
+
+			*rightHook = t;
+			rightHook = &t->left;
+			t = t->left;
+		}
+		else if (t->data < key) {
+			if (!t->right)
+				break;
+
+			if (t->right->data < key) {
+				Node* child = t->right;
+				t->right = child->left;
+				child->left = t;
+				t = child;
+
+				if (!t->right)
+					break;
+			}
+
+			*leftHook = t;
+			leftHook = &t->right;
+			t = t->right;
+		}
+		else {
+			break;
+		}
+	}
+
+	*leftHook = t->left;
+	*rightHook = t->right;
+	t->left = leftTree;
+	t->right = rightTree;
+
+	return t;
+}
+
+template<class T>
+typename SplayTree<T>::Node* SplayTree<T>::copyNodes(const Node* from) {
+	if (!from)
+		return nullptr;
+
+	Node* result = new Node(from->data);
+	std::stack<std::pair<const Node*, Node*>> toCopy;
+	toCopy.push({ from, result });
+
+	while (!toCopy.empty()) {
+		const Node* source = toCopy.top().first;
+		Node* target = toCopy.top().second;
+		toCopy.pop();
+
+		if (source->left) {
+			target->left = new Node(source->left->data);
+			toCopy.push({ source->left, target->left });
+		}
+
+		if (source->right) {
+			target->right = new Node(source->right->data);
+			toCopy.push({ source->right, target->right });
+		}
+	}
+
+	return result;
+}
+
+// Rotates left children up until the root has none, then frees it. O(n) without a stack.
+template<class T>
+void SplayTree<T>::free() {
+	while (root) {
+		if (root->left) {
+			Node* child = root->left;
+			root->left = child->right;
+			child->right = root;
+			root = child;
+		}
+		else {
+			Node* next = root->right;
+			delete root;
+			root = next;
+		}
+	}
+
+	nodesCount = 0;
+}
+
+template<class T>
+SplayTree<T>& SplayTree<T>::operator=(const SplayTree<T>& other) {
+	if (this != &other) {
+		SplayTree<T> temp(other);
+		*this = std::move(temp);
+	}
+
+	return *this;
+}
+
+template<class T>
+SplayTree<T>& SplayTree<T>::operator=(SplayTree<T>&& other) noexcept {
+	if (this != &other) {
+		free();
+
+		root = other.root;
+		nodesCount = other.nodesCount;
+
+		other.root = nullptr;
+		other.nodesCount = 0;
+	}
+
+	return *this;
+}
+
+template<class T>
+int SplayTree<T>::push(const T& elem) {
+	if (!root) {
+		root = new Node(elem);
+		nodesCount = 1;
+		return 1;
+	}
+
+	root = splay(root, elem);
+
+	if (root->data == elem)
+		return -1;
+
+	Node* added = new Node(elem);
+
+	if (elem < root->data) {
+		added->left = root->left;
+		added->right = root;
+		root->left = nullptr;
+	}
+	else {
+		added->right = root->right;
+		added->left = root;
+		root->right = nullptr;
+	}
+
+	root = added;
+	++nodesCount;
+
+	return 1;
+}
+
+template<class T>
+bool SplayTree<T>::exists(const T& elem) const {
+	root = splay(root, elem);
+
+	return root && root->data == elem;
+}
+
+// After the splay everything on the left of the root is smaller than elem,
+// so splaying the left subtree for elem brings its maximum up, which has no right child.
+template<class T>
+int SplayTree<T>::removeElement(const T& elem) {
+	root = splay(root, elem);
+
+	if (!root || !(root->data == elem))
+		return -1;
+
+	Node* toDelete = root;
+
+	if (!root->left) {
+		root = root->right;
+	}
+	else {
+		root = splay(root->left, elem);
+		root->right = toDelete->right;
+	}
+
+	delete toDelete;
+	--nodesCount;
+
+	return 1;
+}
+
+template<class T>
+int SplayTree<T>::getHeight() const {
+	if (!root)
+		return 0;
+
+	int height = 0;
+	std::stack<std::pair<const Node*, int>> toVisit;
+	toVisit.push({ root, 1 });
+
+	while (!toVisit.empty()) {
+		const Node* current = toVisit.top().first;
+		int depth = toVisit.top().second;
+		toVisit.pop();
+
+		if (depth > height)
+			height = depth;
+
+		if (current->left)
+			toVisit.push({ current->left, depth + 1 });
+		if (current->right)
+			toVisit.push({ current->right, depth + 1 });
+	}
+
+	return height;
+}
+
+template<class T>
+struct OrderedSetTraits<SplayTree<T>> {
+	using ValueType = T;
+	using Engine = SplayTree<T>;
+
+	static constexpr bool uniqueKeys = true;
+
+	static bool insert(Engine& engine, const T& elem) { return engine.push(elem) != -1; }
+
+	static bool contains(const Engine& engine, const T& elem) { return engine.exists(elem); }
+
+	static bool remove(Engine& engine, const T& elem) { return engine.removeElement(elem) != -1; }
+
+	static size_t size(const Engine& engine) { return static_cast<size_t>(engine.getNodesCount()); }
+};
+
+#endif // !SPLAY_TREE_HEADER
@@ -0,0 +1,80 @@
+#include "SplayTree.hpp"
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include"../../doctest.h"
+#include<algorithm>
+#include<set>
+#include<string>
+#include<vector>
+
+template<class T>
+bool sameElements(const SplayTree<T>& t, const std::set<T>& expected) {
+	if (t.getNodesCount() != (int)expected.size())
+		return false;
+
+	return std::equal(expected.begin(), expected.end(), t.begin(),
+		[](const T& first, const T& second) { return first == second; });
+}
+
+TEST_CASE("matches std::set under random operations") {
+	SplayTree<int> t;
+	std::set<int> expected;
+
+	for (int i = 0; i < 200000; i++) {
+		int elem = rand() % 5000;
+		int op = rand() % 3;
+
+		if (op == 0)
+			CHECK((t.push(elem) == 1) == expected.insert(elem).second);
+		else if (op == 1)
+			CHECK((t.removeElement(elem) == 1) == (expected.erase(elem) == 1));
+		else
+			CHECK(t.exists(elem) == (expected.count(elem) == 1));
+	}
+
+	CHECK(sameElements(t, expected));
+}
+
+TEST_CASE("sorted pushes make a path that is still freed and copied") {
+	SplayTree<int> t;
+	int count = 1000000;
+
+	for (int i = 0; i < count; i++)
+		t.push(i);
+
+	CHECK(t.getNodesCount() == count);
+	CHECK(t.getHeight() == count);
+
+	SplayTree<int> copy(t);
+	CHECK(copy.getNodesCount() == count);
+
+	// The first access walks the whole path and roughly halves it.
+	CHECK(t.exists(0));
+	CHECK(t.getHeight() < count / 2 + 2);
+	CHECK(!copy.exists(count));
+}
+
+TEST_CASE("copies are independent") {
+	SplayTree<std::string> t;
+	std::set<std::string> expected;
+
+	for (int i = 0; i < 1000; i++) {
+		std::string word = std::to_string(rand() % 300);
+		t.push(word);
+		expected.insert(word);
+	}
+
+	SplayTree<std::string> copy(t);
+	SplayTree<std::string> assigned;
+	assigned = copy;
+
+	t.removeElement(*expected.begin());
+	copy.push("new");
+
+	CHECK(sameElements(assigned, expected));
+	CHECK(!assigned.exists("new"));
+	CHECK(assigned.exists(*expected.begin()));
+
+	SplayTree<std::string> moved(std::move(assigned));
+	CHECK(sameElements(moved, expected));
+	CHECK(assigned.isEmpty());
+}